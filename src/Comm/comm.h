@@ -0,0 +1,196 @@
+#ifndef __COMM_H__
+#define __COMM_H__
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <list>
+#include <vector>
+
+#include <mpi.h>
+#include <pthread.h>
+
+/****************************************************************
+* Transport abstraction over the point-to-point and collective
+* calls used by master and slaves. mpiComm forwards to MPI,
+* threadComm runs every rank as a thread of one process.
+****************************************************************/
+
+#define COMM_ANY_SOURCE -1
+#define COMM_ANY_TAG    -1
+
+// reserved tag for collectives, never matched by COMM_ANY_TAG
+#define COMM_BCAST_TAG  -100
+// threadComm tags the chunks after the first of a message COMM_REST_TAG - tag
+#define COMM_REST_TAG   -1000
+
+enum commType {
+	COMM_INT = 0,
+	COMM_FLOAT,
+	COMM_BYTE,
+	COMM_LONG
+};
+
+struct commStatus {
+	int source;
+	int tag;
+	int count;
+};
+
+// handle of a non-blocking operation
+struct commRequest {
+	MPI_Request mpiRequest;
+	bool done;
+
+	// pending receive, matched when threadComm waits on it
+	void *buf;
+	int count;
+	commType type;
+	int source;
+	int tag;
+};
+
+int commTypeSize (commType type);
+
+class commBase
+{
+public:
+	commBase() {m_chunkBytes = 0;};
+	virtual ~commBase() {};
+
+	/* data */
+	int m_rank;
+	int m_size;
+	long m_chunkBytes;	// 0: chunks as long as an int count allows
+
+	/* method */
+	int rank () {return m_rank;};
+	int size () {return m_size;};
+
+	void virtual send (void *buf, int count, commType type, int dest, int tag) {};
+	void virtual recv (void *buf, int count, commType type, int source, int tag, commStatus *status) {};
+	void virtual bcast (void *buf, int count, commType type, int root) {};
+	// status->count in elements of type, as for recv
+	void virtual probe (int source, int tag, commType type, commStatus *status) {};
+
+	// buf must stay untouched until the request completes; status (may be NULL) describes a completed receive
+	void virtual isend (void *buf, int count, commType type, int dest, int tag, commRequest *request) {};
+	void virtual irecv (void *buf, int count, commType type, int source, int tag, commRequest *request) {};
+	void virtual wait (commRequest *request, commStatus *status) {};
+	void waitAll (std::vector<commRequest> &requests);
+	// chunks after the first travel apart, so any-source / any-tag receives never take them
+	void virtual isendRest (void *buf, int count, commType type, int dest, int tag, commRequest *request) {};
+	void virtual irecvRest (void *buf, int count, commType type, int source, int tag, commRequest *request) {};
+
+	// 64-bit counts: a message goes as consecutive chunks of m_chunkBytes with one tag, all in flight at once
+	void setChunkBytes (long chunkBytes) {m_chunkBytes = chunkBytes;};
+	long chunkCount (commType type);
+	void sendChunked (void *buf, long count, commType type, int dest, int tag);
+	void isendChunked (void *buf, long count, commType type, int dest, int tag, std::vector<commRequest> &requests);
+	// source and tag given: no other message may match the chunks
+	void irecvChunked (void *buf, long count, commType type, int source, int tag, std::vector<commRequest> &requests);
+	// the first chunk may come from any source / tag, the rest follow from its sender
+	void recvChunked (void *buf, long count, commType type, int source, int tag, commStatus *status);
+	// the chunks after a first one that completed with status; a short first chunk is the whole message
+	void recvRest (void *buf, long count, commType type, commStatus *status);
+};
+
+/****************************************************************
+* MPI backend
+****************************************************************/
+class mpiComm: public commBase
+{
+public:
+	mpiComm(MPI_Comm mpiComm);
+	~mpiComm();
+
+	/* method */
+	void send (void *buf, int count, commType type, int dest, int tag);
+	void recv (void *buf, int count, commType type, int source, int tag, commStatus *status);
+	void bcast (void *buf, int count, commType type, int root);
+	void probe (int source, int tag, commType type, commStatus *status);
+
+	void isend (void *buf, int count, commType type, int dest, int tag, commRequest *request);
+	void irecv (void *buf, int count, commType type, int source, int tag, commRequest *request);
+	void wait (commRequest *request, commStatus *status);
+	void isendRest (void *buf, int count, commType type, int dest, int tag, commRequest *request);
+	void irecvRest (void *buf, int count, commType type, int source, int tag, commRequest *request);
+
+private:
+	/* data */
+	MPI_Comm m_comm;
+	MPI_Comm m_restComm;	// duplicate of m_comm carrying the chunks after the first
+
+	/* method */
+	MPI_Datatype mpiType (commType type);
+	void fillStatus (MPI_Status *mpiStatus, commType type, commStatus *status);
+};
+
+/****************************************************************
+* In-process backend: one mailbox per rank, each a lock-free
+* multi-producer single-consumer queue (only the owner pops)
+****************************************************************/
+struct commMsg {
+	commMsg *next;
+	int source;
+	int tag;
+	long bytes;
+	char *data;
+};
+
+class commMailbox
+{
+public:
+	commMailbox();
+	~commMailbox();
+
+	/* method */
+	void push (commMsg *msg);
+	commMsg *pop ();
+
+private:
+	/* data */
+	commMsg *m_head;	// producers exchange onto the head
+	commMsg *m_tail;	// consumer pops from the tail
+	commMsg m_stub;
+};
+
+class threadHub
+{
+public:
+	threadHub(int nProc);
+	~threadHub();
+
+	/* data */
+	int m_nProc;
+	std::vector<commMailbox *> m_mailboxes;
+};
+
+class threadComm: public commBase
+{
+public:
+	threadComm(threadHub *hub, int rank);
+	~threadComm();
+
+	/* method */
+	void send (void *buf, int count, commType type, int dest, int tag);
+	void recv (void *buf, int count, commType type, int source, int tag, commStatus *status);
+	void bcast (void *buf, int count, commType type, int root);
+	void probe (int source, int tag, commType type, commStatus *status);
+
+	void isend (void *buf, int count, commType type, int dest, int tag, commRequest *request);
+	void irecv (void *buf, int count, commType type, int source, int tag, commRequest *request);
+	void wait (commRequest *request, commStatus *status);
+	void isendRest (void *buf, int count, commType type, int dest, int tag, commRequest *request);
+	void irecvRest (void *buf, int count, commType type, int source, int tag, commRequest *request);
+
+private:
+	/* data */
+	threadHub *m_hub;
+	std::list<commMsg *> m_pending;	// popped but not yet matched, in arrival order
+
+	/* method */
+	std::list<commMsg *>::iterator waitMatch (int source, int tag);
+};
+
+#endif
@@ -0,0 +1,177 @@
+#include <limits.h>
+#include <algorithm>
+
+#include "comm.h"
+
+int commTypeSize (commType type) {
+	switch (type) {
+		case COMM_INT:   return sizeof(int);
+		case COMM_FLOAT: return sizeof(float);
+		case COMM_BYTE:  return 1;
+		case COMM_LONG:  return sizeof(long);
+	}
+	return 1;
+}
+
+void commBase::waitAll (std::vector<commRequest> &requests) {
+	for (size_t i=0; i<requests.size(); ++i) {
+		wait(&requests[i], NULL);
+	}
+	requests.clear();
+}
+
+long commBase::chunkCount (commType type) {
+	long count = (m_chunkBytes > 0) ? m_chunkBytes / commTypeSize(type) : (long) INT_MAX;
+	return std::max(1L, std::min(count, (long) INT_MAX));
+}
+
+void commBase::sendChunked (void *buf, long count, commType type, int dest, int tag) {
+	if (count <= chunkCount(type)) {
+		send(buf, (int) count, type, dest, tag);
+		return;
+	}
+	std::vector<commRequest> requests;
+	isendChunked(buf, count, type, dest, tag, requests);
+	waitAll(requests);
+}
+
+void commBase::isendChunked (void *buf, long count, commType type, int dest, int tag, std::vector<commRequest> &requests) {
+	long chunk = chunkCount(type);
+	long first = 0;
+	// an empty message is still one (empty) chunk
+	do {
+		commRequest request;
+		if (first == 0) {
+			isend(buf, (int) std::min(chunk, count), type, dest, tag, &request);
+		} else {
+			isendRest((char *) buf + first * commTypeSize(type), (int) std::min(chunk, count - first), type, dest, tag, &request);
+		}
+		requests.push_back(request);
+		first += chunk;
+	} while (first < count);
+}
+
+void commBase::irecvChunked (void *buf, long count, commType type, int source, int tag, std::vector<commRequest> &requests) {
+	long chunk = chunkCount(type);
+	commRequest request;
+	irecv(buf, (int) std::min(chunk, count), type, source, tag, &request);
+	requests.push_back(request);
+	for (long first = chunk; first < count; first += chunk) {
+		irecvRest((char *) buf + first * commTypeSize(type), (int) std::min(chunk, count - first), type, source, tag, &request);
+		requests.push_back(request);
+	}
+}
+
+void commBase::recvChunked (void *buf, long count, commType type, int source, int tag, commStatus *status) {
+	commStatus firstStatus;
+	recv(buf, (int) std::min(chunkCount(type), count), type, source, tag, &firstStatus);
+	recvRest(buf, count, type, &firstStatus);
+	if (status != NULL) {
+		*status = firstStatus;
+	}
+}
+
+void commBase::recvRest (void *buf, long count, commType type, commStatus *status) {
+	long chunk = chunkCount(type);
+	if (count <= chunk || status->count < chunk) {
+		return;
+	}
+	std::vector<commRequest> requests;
+	for (long first = chunk; first < count; first += chunk) {
+		commRequest request;
+		irecvRest((char *) buf + first * commTypeSize(type), (int) std::min(chunk, count - first), type,
+			status->source, status->tag, &request);
+		requests.push_back(request);
+	}
+	waitAll(requests);
+}
+
+mpiComm::mpiComm (MPI_Comm comm) {
+	m_comm = comm;
+	MPI_Comm_rank(m_comm, &m_rank);
+	MPI_Comm_size(m_comm, &m_size);
+	MPI_Comm_dup(m_comm, &m_restComm);
+}
+
+mpiComm::~mpiComm () {
+	// MPI_Finalize is left to main
+	MPI_Comm_free(&m_restComm);
+}
+
+MPI_Datatype mpiComm::mpiType (commType type) {
+	switch (type) {
+		case COMM_INT:   return MPI_INT;
+		case COMM_FLOAT: return MPI_FLOAT;
+		case COMM_BYTE:  return MPI_BYTE;
+		case COMM_LONG:  return MPI_LONG;
+	}
+	return MPI_BYTE;
+}
+
+void mpiComm::fillStatus (MPI_Status *mpiStatus, commType type, commStatus *status) {
+	if (status == NULL) {
+		return;
+	}
+	status->source = mpiStatus->MPI_SOURCE;
+	status->tag = mpiStatus->MPI_TAG;
+	MPI_Get_count(mpiStatus, mpiType(type), &status->count);
+}
+
+void mpiComm::send (void *buf, int count, commType type, int dest, int tag) {
+	MPI_Send(buf, count, mpiType(type), dest, tag, m_comm);
+}
+
+void mpiComm::recv (void *buf, int count, commType type, int source, int tag, commStatus *status) {
+	MPI_Status mpiStatus;
+	source = (source == COMM_ANY_SOURCE) ? MPI_ANY_SOURCE : source;
+	tag = (tag == COMM_ANY_TAG) ? MPI_ANY_TAG : tag;
+	MPI_Recv(buf, count, mpiType(type), source, tag, m_comm, &mpiStatus);
+	fillStatus(&mpiStatus, type, status);
+}
+
+void mpiComm::bcast (void *buf, int count, commType type, int root) {
+	MPI_Bcast(buf, count, mpiType(type), root, m_comm);
+}
+
+void mpiComm::probe (int source, int tag, commType type, commStatus *status) {
+	MPI_Status mpiStatus;
+	source = (source == COMM_ANY_SOURCE) ? MPI_ANY_SOURCE : source;
+	tag = (tag == COMM_ANY_TAG) ? MPI_ANY_TAG : tag;
+	MPI_Probe(source, tag, m_comm, &mpiStatus);
+	fillStatus(&mpiStatus, type, status);
+}
+
+void mpiComm::isend (void *buf, int count, commType type, int dest, int tag, commRequest *request) {
+	MPI_Isend(buf, count, mpiType(type), dest, tag, m_comm, &request->mpiRequest);
+	request->type = type;
+	request->done = false;
+}
+
+void mpiComm::irecv (void *buf, int count, commType type, int source, int tag, commRequest *request) {
+	source = (source == COMM_ANY_SOURCE) ? MPI_ANY_SOURCE : source;
+	tag = (tag == COMM_ANY_TAG) ? MPI_ANY_TAG : tag;
+	MPI_Irecv(buf, count, mpiType(type), source, tag, m_comm, &request->mpiRequest);
+	request->type = type;
+	request->done = false;
+}
+
+void mpiComm::wait (commRequest *request, commStatus *status) {
+	if (!request->done) {
+		MPI_Status mpiStatus;
+		MPI_Wait(&request->mpiRequest, &mpiStatus);
+		request->done = true;
+		fillStatus(&mpiStatus, request->type, status);
+	}
+}
+
+void mpiComm::isendRest (void *buf, int count, commType type, int dest, int tag, commRequest *request) {
+	MPI_Isend(buf, count, mpiType(type), dest, tag, m_restComm, &request->mpiRequest);
+	request->type = type;
+	request->done = false;
+}
+
+void mpiComm::irecvRest (void *buf, int count, commType type, int source, int tag, commRequest *request) {
+	MPI_Irecv(buf, count, mpiType(type), source, tag, m_restComm, &request->mpiRequest);
+	request->type = type;
+	request->done = false;
+}
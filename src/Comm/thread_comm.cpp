@@ -0,0 +1,216 @@
+#include <sched.h>
+#include <time.h>
+
+#include "comm.h"
+
+/****************************************************************
+* commMailbox: intrusive MPSC queue (Vyukov). push is wait-free
+* for any number of producers, pop is called by the owner only.
+****************************************************************/
+
+commMailbox::commMailbox () {
+	m_stub.next = NULL;
+	m_head = &m_stub;
+	m_tail = &m_stub;
+}
+
+commMailbox::~commMailbox () {
+	commMsg *msg;
+	while ((msg = pop()) != NULL) {
+		delete [] msg->data;
+		delete msg;
+	}
+}
+
+void commMailbox::push (commMsg *msg) {
+	__atomic_store_n(&msg->next, (commMsg *) NULL, __ATOMIC_RELAXED);
+	commMsg *prev = __atomic_exchange_n(&m_head, msg, __ATOMIC_ACQ_REL);
+	__atomic_store_n(&prev->next, msg, __ATOMIC_RELEASE);
+}
+
+commMsg *commMailbox::pop () {
+	commMsg *tail = m_tail;
+	commMsg *next = __atomic_load_n(&tail->next, __ATOMIC_ACQUIRE);
+	if (tail == &m_stub) {
+		if (next == NULL) {
+			return NULL;
+		}
+		m_tail = next;
+		tail = next;
+		next = __atomic_load_n(&next->next, __ATOMIC_ACQUIRE);
+	}
+	if (next != NULL) {
+		m_tail = next;
+		return tail;
+	}
+	// a producer has exchanged the head but not linked it yet
+	commMsg *head = __atomic_load_n(&m_head, __ATOMIC_ACQUIRE);
+	if (tail != head) {
+		return NULL;
+	}
+	push(&m_stub);
+	next = __atomic_load_n(&tail->next, __ATOMIC_ACQUIRE);
+	if (next != NULL) {
+		m_tail = next;
+		return tail;
+	}
+	return NULL;
+}
+
+/****************************************************************
+* threadHub: shared by all ranks of one process
+****************************************************************/
+
+threadHub::threadHub (int nProc) {
+	m_nProc = nProc;
+	for (int rank=0; rank<m_nProc; ++rank) {
+		m_mailboxes.push_back(new commMailbox());
+	}
+}
+
+threadHub::~threadHub () {
+	for (int rank=0; rank<m_nProc; ++rank) {
+		delete m_mailboxes[rank];
+	}
+}
+
+/****************************************************************
+* threadComm: per-rank endpoint, sends are eager copies
+****************************************************************/
+
+static inline bool matchMsg (commMsg *msg, int source, int tag) {
+	if (source != COMM_ANY_SOURCE && msg->source != source) {
+		return false;
+	}
+	if (tag == COMM_ANY_TAG) {
+		return msg->tag >= 0;
+	}
+	return msg->tag == tag;
+}
+
+static inline void backoff (int spin) {
+	if (spin < 64) {
+		sched_yield();
+	} else {
+		struct timespec ts = {0, 20000};
+		nanosleep(&ts, NULL);
+	}
+}
+
+threadComm::threadComm (threadHub *hub, int rank) {
+	m_hub = hub;
+	m_rank = rank;
+	m_size = hub->m_nProc;
+}
+
+threadComm::~threadComm () {
+	for (std::list<commMsg *>::iterator it = m_pending.begin(); it != m_pending.end(); ++it) {
+		delete [] (*it)->data;
+		delete *it;
+	}
+}
+
+void threadComm::send (void *buf, int count, commType type, int dest, int tag) {
+	commMsg *msg = new commMsg;
+	msg->source = m_rank;
+	msg->tag = tag;
+	msg->bytes = (long) count * commTypeSize(type);
+	msg->data = new char[msg->bytes];
+	memcpy(msg->data, buf, msg->bytes);
+	m_hub->m_mailboxes[dest]->push(msg);
+}
+
+std::list<commMsg *>::iterator threadComm::waitMatch (int source, int tag) {
+	// earlier arrivals first, so messages between a pair of ranks never overtake
+	for (std::list<commMsg *>::iterator it = m_pending.begin(); it != m_pending.end(); ++it) {
+		if (matchMsg(*it, source, tag)) {
+			return it;
+		}
+	}
+	commMailbox *mailbox = m_hub->m_mailboxes[m_rank];
+	int spin = 0;
+	while (1) {
+		commMsg *msg = mailbox->pop();
+		if (msg == NULL) {
+			backoff(spin++);
+			continue;
+		}
+		spin = 0;
+		m_pending.push_back(msg);
+		if (matchMsg(msg, source, tag)) {
+			return --m_pending.end();
+		}
+	}
+}
+
+void threadComm::recv (void *buf, int count, commType type, int source, int tag, commStatus *status) {
+	std::list<commMsg *>::iterator it = waitMatch(source, tag);
+	commMsg *msg = *it;
+	m_pending.erase(it);
+
+	long bytes = (long) count * commTypeSize(type);
+	if (msg->bytes > bytes) {
+		printf("Error: threadComm message truncated (%ld > %ld bytes).\n", msg->bytes, bytes);
+		exit(-1);
+	}
+	memcpy(buf, msg->data, msg->bytes);
+	if (status != NULL) {
+		status->source = msg->source;
+		status->tag = msg->tag;
+		status->count = (int) (msg->bytes / commTypeSize(type));
+	}
+	delete [] msg->data;
+	delete msg;
+}
+
+void threadComm::bcast (void *buf, int count, commType type, int root) {
+	if (m_rank == root) {
+		for (int rank=0; rank<m_size; ++rank) {
+			if (rank != root) {
+				send(buf, count, type, rank, COMM_BCAST_TAG);
+			}
+		}
+	} else {
+		recv(buf, count, type, root, COMM_BCAST_TAG, NULL);
+	}
+}
+
+void threadComm::probe (int source, int tag, commType type, commStatus *status) {
+	commMsg *msg = *waitMatch(source, tag);
+	if (status != NULL) {
+		status->source = msg->source;
+		status->tag = msg->tag;
+		status->count = (int) (msg->bytes / commTypeSize(type));
+	}
+}
+
+void threadComm::isend (void *buf, int count, commType type, int dest, int tag, commRequest *request) {
+	// the payload is copied into the mailbox, so the send completes at once
+	send(buf, count, type, dest, tag);
+	request->done = true;
+}
+
+void threadComm::irecv (void *buf, int count, commType type, int source, int tag, commRequest *request) {
+	// nothing to post, the message is matched from the mailbox in wait
+	request->buf = buf;
+	request->count = count;
+	request->type = type;
+	request->source = source;
+	request->tag = tag;
+	request->done = false;
+}
+
+void threadComm::wait (commRequest *request, commStatus *status) {
+	if (!request->done) {
+		recv(request->buf, request->count, request->type, request->source, request->tag, status);
+		request->done = true;
+	}
+}
+
+void threadComm::isendRest (void *buf, int count, commType type, int dest, int tag, commRequest *request) {
+	isend(buf, count, type, dest, COMM_REST_TAG - tag, request);
+}
+
+void threadComm::irecvRest (void *buf, int count, commType type, int source, int tag, commRequest *request) {
+	irecv(buf, count, type, source, COMM_REST_TAG - tag, request);
+}
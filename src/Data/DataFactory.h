@@ -10,18 +10,22 @@ class DataFactory
     public:
 		DataFactory();
 		//DataFactory(int);
-		virtual int getNumberOfData() {return 0;};
+		virtual long getNumberOfData() {return 0;};
 		
-		virtual int getDataSize() {return 0;};
-		virtual int getLabelSize() {return 0;};
+		virtual long getDataSize() {return 0;};
+		virtual long getLabelSize() {return 0;};
 
 		virtual void printOutData() {};
-		virtual void getDataBatch(float*, float*, int*, int) {};
+		virtual void getDataBatch(float*, float*, long*, int) {};
+
+		// sequence data: per-sample lengths, records stay padded to getDataSize / getLabelSize
+		virtual bool hasSeqLengths() {return false;};
+		virtual void getSeqLengths(int*, int*, long*, int) {};
     protected:
-		int numFet;
-		int numData;
+		long numFet;
+		long numData;
 		std::string dataName;
-		virtual float getDataByIndex(int,int) {return 0.0;};
+		virtual float getDataByIndex(long, long) {return 0.0;};
 };
 
 #endif
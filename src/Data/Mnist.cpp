@@ -25,19 +25,19 @@ Mnist::~Mnist(){
     delete [] dataVector;
 }
 
-int Mnist::getNumberOfData(){
+long Mnist::getNumberOfData(){
     return numData;
 }
 
-int Mnist::getDataSize() {
+long Mnist::getDataSize() {
     return 28*28;
 }
 
-int Mnist::getLabelSize() {
+long Mnist::getLabelSize() {
     return 1;
 }
 
-float Mnist::getDataByIndex(int dataIndex, int fetIndex)
+float Mnist::getDataByIndex(long dataIndex, long fetIndex)
 {
    return(dataVector[ dataIndex * (numFet+1) + fetIndex ]);
 }
@@ -53,7 +53,7 @@ void Mnist::loadData(){
         mnFer.read(reinterpret_cast<char*>(&temp),sizeof(int));
         mnFer.read(reinterpret_cast<char*>(&temp),sizeof(int));
     }//skip the first two lines 
-    for (int i=0;i<numData;i++){
+    for (long i=0;i<numData;i++){
         for(int j=0;j<=numFet;j++){
             if(j==numFet){
                 mnLab.read(reinterpret_cast<char*>(&temp8),sizeof(char));
@@ -71,7 +71,7 @@ void Mnist::loadData(){
     mnLab.close();
 }
 
-void Mnist::getDataBatch(float* label, float* data, int* indexs, int num)
+void Mnist::getDataBatch(float* label, float* data, long* indexs, int num)
 {
     for (int i=0; i< num; i++)
     {
@@ -84,7 +84,7 @@ void Mnist::getDataBatch(float* label, float* data, int* indexs, int num)
 }
 
 void Mnist::printOutDataFromData(){
-    for (int i=0;i<numData;i++){
+    for (long i=0;i<numData;i++){
         for(int j=0;j<numFet+1;j++){
             std::cout << dataVector[i*(numFet+1)+j]<<",";
         }
@@ -10,15 +10,15 @@ class Mnist:public DataFactory{
          float* dataVector;
          void loadData();
      protected:
-         float getDataByIndex(int,int);
+         float getDataByIndex(long, long);
      public:
          Mnist(int);
          ~Mnist();
-         int getNumberOfData();
-         int getDataSize();
-         int getLabelSize();
+         long getNumberOfData();
+         long getDataSize();
+         long getLabelSize();
 
-         void getDataBatch(float*,float*,int*,int);
+         void getDataBatch(float*, float*, long*, int);
 
          //for test&debug
          void printLabel();
@@ -21,7 +21,7 @@ void TestData::printOutData()
 {
     std::ifstream ifs( dataName.c_str(), std::ios::binary);
     float read;
-    for (int i=0; i < numData; i++)
+    for (long i=0; i < numData; i++)
     {
 	for (int j=0; j < numFet; j++)
 	{
@@ -38,7 +38,7 @@ void TestData::loadData()
 {
     std::ifstream ifs( dataName.c_str(), std::ios::binary);
     float read;
-    for (int i=0; i < numData; i++)
+    for (long i=0; i < numData; i++)
     {
 	for (int j=0; j < numFet + 1; j++)
 	{
@@ -49,18 +49,18 @@ void TestData::loadData()
     ifs.close();
 }
 
-int TestData::getNumberOfData()
+long TestData::getNumberOfData()
 {
     return numData;
 }
 
 //The first int is for data index, second int is for feature index
-float TestData::getDataByIndex(int dataIndex, int fetIndex)
+float TestData::getDataByIndex(long dataIndex, long fetIndex)
 {
    return(dataVector[ dataIndex * (numFet+1) + fetIndex ]);
 }
 
-void TestData::getDataBatch(float* label, float* data, int* indexs, int num)
+void TestData::getDataBatch(float* label, float* data, long* indexs, int num)
 {
     for (int i=0; i< num; i++)
     {
@@ -13,13 +13,15 @@ class TestData
 	float* dataVector;
 	void loadData();
     protected:
-	float getDataByIndex(int, int);
+	float getDataByIndex(long, long);
     public:
 	TestData();
 	~TestData();
-	int getNumberOfData();
+	long getNumberOfData();
+	long getDataSize() {return numFet;};
+	long getLabelSize() {return 1;};
 	void printOutData();
-	void getDataBatch(float*, float*, int*, int);
+	void getDataBatch(float*, float*, long*, int);
 };
 
 #endif
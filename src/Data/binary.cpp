@@ -47,14 +47,14 @@ void BinaryData::loadData()
 
 }
 
-int BinaryData::getNumberOfData()
+long BinaryData::getNumberOfData()
 {
     return numData;
 }
 
 void BinaryData::printOutData()
 {
-    for (int i=0;i<numData;i++){
+    for (long i=0;i<numData;i++){
         for(int j=0;j<numFet+1;j++){
             std::cout << dataVector[i*(numFet+1)+j]<<",";
         }
@@ -62,12 +62,12 @@ void BinaryData::printOutData()
     }
 }
 
-float BinaryData::getDataByIndex(int dataIndex, int fetIndex)
+float BinaryData::getDataByIndex(long dataIndex, long fetIndex)
 {
    return(dataVector[ dataIndex * (numFet+1) + fetIndex ]);
 }
 
-void BinaryData::getDataBatch(float* label, float* data, int* indexs, int num)
+void BinaryData::getDataBatch(float* label, float* data, long* indexs, int num)
 {
     for (int i=0; i< num; i++)
     {
@@ -11,14 +11,16 @@ class BinaryData
     public:
 	BinaryData();
 	~BinaryData();
-	int getNumberOfData();
+	long getNumberOfData();
+	long getDataSize() {return numFet;};
+	long getLabelSize() {return 1;};
 	void printOutData();
-	void getDataBatch(float*, float*, int*, int);    
+	void getDataBatch(float*, float*, long*, int);    
     private:
 	float* dataVector;
 	void loadData();
 	void parseWord(int*, std::string);
-	float getDataByIndex(int, int);
+	float getDataByIndex(long, long);
 };
 
 #endif
@@ -22,8 +22,8 @@ SequenceData::SequenceData(ConfReader *confReader) {
     ifstream inputfile (inputFile.c_str(), ios::in|ios::binary);
     if (inputfile.is_open()) {
         inputfile.seekg (0, ios::end);
-        int size = inputfile.tellg();
-        if (size != sizeof(float) * numData * m_inputSeqLen * m_inputDim) {
+        long size = inputfile.tellg();
+        if (size != (long) (sizeof(float) * numData * m_inputSeqLen * m_inputDim)) {
             printf("Wrong memory size for sequence input\n");
             inputfile.close();
             exit(1);
@@ -39,8 +39,8 @@ SequenceData::SequenceData(ConfReader *confReader) {
     ifstream outputfile (outputFile.c_str(), ios::in|ios::binary);
     if (outputfile.is_open()) {
         outputfile.seekg (0, ios::end);
-        int size = outputfile.tellg();
-        if (size != sizeof(float) * numData * m_outputSeqLen * m_outputDim) {
+        long size = outputfile.tellg();
+        if (size != (long) (sizeof(float) * numData * m_outputSeqLen * m_outputDim)) {
             printf("Wrong memory size for sequence output\n");
             outputfile.close();
             exit(1);
@@ -52,27 +52,65 @@ SequenceData::SequenceData(ConfReader *confReader) {
         printf("Failed to open outputfile\n");
         exit(1);
     }
+
+	// optional int pairs (input length, output length) per sample, steps past them are padding
+	m_inputLen = NULL;
+	m_outputLen = NULL;
+	string lengthFile = confReader->getString("seqdata_length_file");
+	if (lengthFile == "none") {
+		return;
+	}
+	int *lengths = new int[numData * 2];
+	ifstream lenfile (lengthFile.c_str(), ios::in|ios::binary);
+	if (lenfile.is_open()) {
+		lenfile.seekg (0, ios::end);
+		long size = lenfile.tellg();
+		if (size != (long) (sizeof(int) * numData * 2)) {
+			printf("Wrong memory size for sequence lengths\n");
+			lenfile.close();
+			exit(1);
+		}
+		lenfile.seekg (0, ios::beg);
+		lenfile.read ((char *)lengths, size);
+		lenfile.close();
+	} else {
+		printf("Failed to open lengthfile\n");
+		exit(1);
+	}
+	m_inputLen = new int[numData];
+	m_outputLen = new int[numData];
+	for (long i=0; i<numData; ++i) {
+		m_inputLen[i] = lengths[2*i];
+		m_outputLen[i] = lengths[2*i+1];
+		if (m_inputLen[i] < 1 || m_inputLen[i] > m_inputSeqLen || m_outputLen[i] < 1 || m_outputLen[i] > m_outputSeqLen) {
+			printf("Error sequence lengths of sample %ld: %d, %d.\n", i, m_inputLen[i], m_outputLen[i]);
+			exit(1);
+		}
+	}
+	delete [] lengths;
 }
 
 SequenceData::~SequenceData() {
 	if (m_input != NULL) delete [] m_input;
 	if (m_output != NULL) delete [] m_output;
+	if (m_inputLen != NULL) delete [] m_inputLen;
+	if (m_outputLen != NULL) delete [] m_outputLen;
 }
 
-int SequenceData::getNumberOfData() {
+long SequenceData::getNumberOfData() {
 	return numData;
 }
 
-int SequenceData::getDataSize() {
+long SequenceData::getDataSize() {
 	return m_inputDim * m_inputSeqLen;
 }
-int SequenceData::getLabelSize() {
+long SequenceData::getLabelSize() {
 	return m_outputDim * m_outputSeqLen;
 }
 
-void SequenceData::getDataBatch(float* label, float* data, int* indices, int num) {
+void SequenceData::getDataBatch(float* label, float* data, long* indices, int num) {
 	for (int i=0; i<num; ++i) {
-		int index = indices[i];		
+		long index = indices[i];		
 		memcpy(data + i * m_inputSeqLen * m_inputDim, 
 			m_input + index * m_inputSeqLen * m_inputDim, 
 			sizeof(float) * m_inputSeqLen * m_inputDim);
@@ -81,3 +119,14 @@ void SequenceData::getDataBatch(float* label, float* data, int* indices, int num
 			sizeof(float) * m_outputSeqLen * m_outputDim);
 	}
 }
+
+bool SequenceData::hasSeqLengths() {
+	return m_inputLen != NULL;
+}
+
+void SequenceData::getSeqLengths(int* inputLen, int* outputLen, long* indices, int num) {
+	for (int i=0; i<num; ++i) {
+		inputLen[i] = m_inputLen[indices[i]];
+		outputLen[i] = m_outputLen[indices[i]];
+	}
+}
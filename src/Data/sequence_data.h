@@ -9,6 +9,8 @@ class SequenceData:public DataFactory{
     private:        
         float *m_input;
         float *m_output;
+        int *m_inputLen;    // NULL: every sequence has the full length
+        int *m_outputLen;
 
         int m_inputSeqLen;
         int m_outputSeqLen;
@@ -20,11 +22,14 @@ class SequenceData:public DataFactory{
         SequenceData(ConfReader *confReader);
         ~SequenceData();
 
-        int getNumberOfData();
-        int getDataSize();
-        int getLabelSize();
+        long getNumberOfData();
+        long getDataSize();
+        long getLabelSize();
         
-        void getDataBatch(float* label, float* data, int* indices, int num);
+        void getDataBatch(float* label, float* data, long* indices, int num);
+
+        bool hasSeqLengths();
+        void getSeqLengths(int* inputLen, int* outputLen, long* indices, int num);
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,92 @@
+#include <stdlib.h>
+
+#include "arrival_log.h"
+
+arrivalLog::arrivalLog (ConfReader *confReader, int nSlave) {
+	std::string logFile = confReader->getString("arrival log file");
+	std::string replayFile = confReader->getString("arrival replay file");
+
+	m_replay = false;
+	m_logFile = NULL;
+	m_cursor = 0;
+	m_outstanding.assign(nSlave+1, 0);
+
+	if (!replayFile.empty() && replayFile != "none") {
+		FILE *fp = fopen(replayFile.c_str(), "r");
+		if (fp == NULL) {
+			printf("Error: failed to open arrival replay file %s\n", replayFile.c_str());
+			exit(-1);
+		}
+		int source;
+		while (fscanf(fp, "%d", &source) == 1) {
+			m_sequence.push_back(source);
+		}
+		fclose(fp);
+		m_replay = true;
+		printf("MASTER: replaying %d arrivals from %s\n", (int) m_sequence.size(), replayFile.c_str());
+	}
+
+	if (!logFile.empty() && logFile != "none") {
+		if (m_replay && logFile == replayFile) {
+			printf("Error: arrival log file and arrival replay file must differ.\n");
+			exit(-1);
+		}
+		m_logFile = fopen(logFile.c_str(), "w");
+		if (m_logFile == NULL) {
+			printf("Warning: failed to open arrival log file %s\n", logFile.c_str());
+		}
+	}
+}
+
+arrivalLog::~arrivalLog () {
+	if (m_logFile != NULL) {
+		fclose(m_logFile);
+	}
+}
+
+int arrivalLog::nextSource () {
+	if (!m_replay) {
+		return COMM_ANY_SOURCE;
+	}
+	if (m_cursor >= m_sequence.size()) {
+		printf("Warning: arrival replay exhausted, falling back to any source.\n");
+		m_replay = false;
+		return COMM_ANY_SOURCE;
+	}
+	int source = m_sequence[m_cursor++];
+	// a recorded rank without work in flight would block forever
+	if (source < 1 || source >= (int) m_outstanding.size() || m_outstanding[source] == 0) {
+		printf("Error: arrival replay diverged at step %d (rank %d has no grad in flight).\n", (int) m_cursor, source);
+		exit(-1);
+	}
+	return source;
+}
+
+int arrivalLog::peekSource () {
+	if (!m_replay || m_cursor >= m_sequence.size()) {
+		return COMM_ANY_SOURCE;
+	}
+	return m_sequence[m_cursor];
+}
+
+int arrivalLog::outstanding (int rank) {
+	if (rank != COMM_ANY_SOURCE) {
+		return (rank >= 1 && rank < (int) m_outstanding.size()) ? m_outstanding[rank] : 0;
+	}
+	int total = 0;
+	for (int source=1; source<(int) m_outstanding.size(); ++source) {
+		total += m_outstanding[source];
+	}
+	return total;
+}
+
+void arrivalLog::onSend (int rank) {
+	m_outstanding[rank] += 1;
+}
+
+void arrivalLog::record (int source) {
+	m_outstanding[source] -= 1;
+	if (m_logFile != NULL) {
+		fprintf(m_logFile, "%d\n", source);
+	}
+}
@@ -0,0 +1,44 @@
+#ifndef __ARRIVAL_LOG_H__
+#define __ARRIVAL_LOG_H__
+
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+#include "comm.h"
+#include "confreader.h"
+
+/****************************************************************
+* Order in which slave gradients reach the master.
+* "arrival log file" records the rank of every received gradient,
+* "arrival replay file" makes the master receive in that exact
+* order instead of from any source, so runs with the same seeds
+* follow identical update trajectories.
+****************************************************************/
+
+class arrivalLog
+{
+public:
+	arrivalLog(ConfReader *confReader, int nSlave);
+	~arrivalLog();
+
+	/* method */
+	int nextSource ();
+	// the source nextSource will return, without consuming it (any source when not replaying)
+	int peekSource ();
+	// grads sent for but not yet recorded, of one rank or of all with COMM_ANY_SOURCE
+	int outstanding (int rank);
+	void onSend (int rank);
+	void record (int source);
+	bool replaying () {return m_replay;};
+
+private:
+	/* data */
+	bool m_replay;
+	FILE *m_logFile;
+	std::vector<int> m_sequence;
+	size_t m_cursor;
+	std::vector<int> m_outstanding;	// params sent but grad not received, by rank
+};
+
+#endif
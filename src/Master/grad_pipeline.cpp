@@ -0,0 +1,146 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <algorithm>
+
+#include "grad_pipeline.h"
+#include "segment_stream.h"
+
+gradPipeline::gradPipeline (ConfReader *confReader, commBase *comm, modelBase *model, arrivalLog *arrivals,
+	bool streamed, bool sparse) {
+	m_comm = comm;
+	m_model = model;
+	m_arrivals = arrivals;
+	m_streamed = streamed;
+	m_sparse = sparse;
+	m_nBuffer = confReader->getInt("gradient buffers");
+	if (m_nBuffer < 1) {
+		printf("Error gradient buffers: %d.\n", m_nBuffer);
+		exit(-1);
+	}
+	// backprop finishes the segments in reverse forward order
+	m_headSeg = m_model->forwardSegment(m_model->numSegments() - 1);
+
+	m_grads.assign(m_nBuffer, (float *) NULL);
+	m_sparseMsgs.assign(m_nBuffer, (char *) NULL);
+	for (int buf=0; buf<m_nBuffer; ++buf) {
+		if (m_sparse) {
+			m_sparseMsgs[buf] = new char[sparseMsgBytes(m_model->m_nParamSize)];
+		} else {
+			m_grads[buf] = new float[m_model->m_nParamSize + GRAD_INFO];
+		}
+	}
+	m_requests.resize(m_nBuffer);
+	m_source.assign(m_nBuffer, COMM_ANY_SOURCE);
+	m_free.assign(m_nBuffer, true);
+	m_postedFrom.assign(m_comm->size(), 0);
+}
+
+gradPipeline::~gradPipeline () {
+	for (int buf=0; buf<m_nBuffer; ++buf) {
+		if (m_grads[buf] != NULL) {
+			delete [] m_grads[buf];
+		}
+		if (m_sparseMsgs[buf] != NULL) {
+			delete [] m_sparseMsgs[buf];
+		}
+	}
+}
+
+bool gradPipeline::postOne (bool force) {
+	int buf = 0;
+	while (buf < m_nBuffer && !m_free[buf]) {
+		buf++;
+	}
+	if (buf == m_nBuffer) {
+		return false;
+	}
+	// only grads no posted receive will take, a receive without a sender would never complete
+	int source = m_arrivals->peekSource();
+	int unclaimed;
+	if (source == COMM_ANY_SOURCE) {
+		unclaimed = m_arrivals->outstanding(COMM_ANY_SOURCE) - (int) m_posted.size();
+	} else {
+		unclaimed = m_arrivals->outstanding(source) - (source < (int) m_postedFrom.size() ? m_postedFrom[source] : 0);
+	}
+	if (!force && unclaimed <= 0) {
+		return false;
+	}
+	source = m_arrivals->nextSource();
+
+	// only the first chunk, next() takes the rest from the sender
+	long paramSize = m_model->m_nParamSize;
+	if (m_sparse) {
+		m_comm->irecv(m_sparseMsgs[buf], (int) std::min(m_comm->chunkCount(COMM_BYTE), sparseMsgBytes(paramSize)), COMM_BYTE,
+			source, COMM_ANY_TAG, &m_requests[buf]);
+	} else if (m_streamed) {
+		m_comm->irecv(m_grads[buf] + m_model->m_segOffset[m_headSeg], (int) std::min(m_comm->chunkCount(COMM_FLOAT), m_model->m_segSize[m_headSeg]),
+			COMM_FLOAT, source, GRADSEGTAG + m_headSeg, &m_requests[buf]);
+	} else {
+		m_comm->irecv(m_grads[buf], (int) std::min(m_comm->chunkCount(COMM_FLOAT), paramSize + GRAD_INFO), COMM_FLOAT,
+			source, COMM_ANY_TAG, &m_requests[buf]);
+	}
+	m_free[buf] = false;
+	m_source[buf] = source;
+	m_posted.push_back(buf);
+	if (source != COMM_ANY_SOURCE) {
+		m_postedFrom[source] += 1;
+	}
+	return true;
+}
+
+void gradPipeline::post () {
+	while (postOne(false)) {
+		// keep every free buffer busy
+	}
+}
+
+int gradPipeline::next (commStatus *status) {
+	// nothing unclaimed posted: a plain blocking receive (a diverged replay stops in nextSource)
+	if (m_posted.empty()) {
+		postOne(true);
+	}
+	int buf = m_posted.front();
+	m_posted.erase(m_posted.begin());
+	m_comm->wait(&m_requests[buf], status);
+	if (m_source[buf] != COMM_ANY_SOURCE) {
+		m_postedFrom[m_source[buf]] -= 1;
+	}
+
+	if (m_sparse) {
+		m_comm->recvRest(m_sparseMsgs[buf], sparseMsgBytes(*(int *) m_sparseMsgs[buf]), COMM_BYTE, status);
+	} else if (!m_streamed) {
+		m_comm->recvRest(m_grads[buf], m_model->m_nParamSize + GRAD_INFO, COMM_FLOAT, status);
+	} else {
+		// the head picked the slave, the other segments are already on their way from it
+		m_comm->recvRest(m_grads[buf] + m_model->m_segOffset[m_headSeg], m_model->m_segSize[m_headSeg], COMM_FLOAT, status);
+		std::vector<commRequest> requests;
+		for (int segIdx = 0; segIdx < m_model->numSegments(); ++segIdx) {
+			if (segIdx != m_headSeg) {
+				m_comm->irecvChunked(m_grads[buf] + m_model->m_segOffset[segIdx], m_model->m_segSize[segIdx], COMM_FLOAT,
+					status->source, GRADSEGTAG + segIdx, requests);
+			}
+		}
+		m_comm->irecvChunked(m_grads[buf] + m_model->m_nParamSize, GRAD_INFO, COMM_FLOAT,
+			status->source, GRADSEGTAG + m_model->numSegments(), requests);
+		m_comm->waitAll(requests);
+	}
+	return buf;
+}
+
+void gradPipeline::release (int buf) {
+	m_free[buf] = true;
+}
+
+long gradPipeline::msgBytes (int buf) {
+	if (m_sparse) {
+		return sparseMsgBytes(*(int *) m_sparseMsgs[buf]);
+	}
+	return (long) sizeof(float) * (m_model->m_nParamSize + GRAD_INFO);
+}
+
+float *gradPipeline::gradInfo (int buf) {
+	if (m_sparse) {
+		return sparseMsgInfo(m_sparseMsgs[buf]);
+	}
+	return m_grads[buf] + m_model->m_nParamSize;
+}
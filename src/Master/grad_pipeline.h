@@ -0,0 +1,64 @@
+#ifndef __GRAD_PIPELINE_H__
+#define __GRAD_PIPELINE_H__
+
+#include <vector>
+
+#include "comm.h"
+#include "confreader.h"
+#include "model.h"
+#include "arrival_log.h"
+
+/****************************************************************
+* Grad receives of the master over a ring of "gradient buffers"
+* buffers. Every free buffer holds a posted receive as long as a
+* grad is in flight that no other posted receive will take, so
+* the next grad lands while the solver applies the current one.
+* Receives complete in the order they were posted, which is the
+* arrival order (or the replayed one). Only the first chunk of a
+* grad is posted ahead (of its head segment when streamed), it
+* picks the slave and the rest is then taken from that slave.
+****************************************************************/
+
+class gradPipeline
+{
+public:
+	gradPipeline(ConfReader *confReader, commBase *comm, modelBase *model, arrivalLog *arrivals,
+		bool streamed, bool sparse);
+	~gradPipeline();
+
+	/* method */
+	// post receives on the free buffers (call after params were sent)
+	void post ();
+	// wait for the oldest posted grad, its buffer stays busy until release
+	int next (commStatus *status);
+	void release (int buf);
+
+	float *grad (int buf) {return m_grads[buf];};
+	char *sparseMsg (int buf) {return m_sparseMsgs[buf];};
+	// GRAD_INFO floats of the grad: |grad|^2 and the minibatch cost
+	float *gradInfo (int buf);
+	long msgBytes (int buf);
+
+private:
+	/* data */
+	commBase *m_comm;
+	modelBase *m_model;
+	arrivalLog *m_arrivals;
+	bool m_streamed;
+	bool m_sparse;
+	int m_nBuffer;
+	int m_headSeg;		// segment the slaves publish first
+
+	std::vector<float *> m_grads;
+	std::vector<char *> m_sparseMsgs;
+	std::vector<commRequest> m_requests;
+	std::vector<int> m_source;	// source each buffer was posted for
+	std::vector<bool> m_free;
+	std::vector<int> m_posted;	// buffer indices in posting order
+	std::vector<int> m_postedFrom;	// posted receives by rank, any-source ones are not counted
+
+	/* method */
+	bool postOne (bool force);
+};
+
+#endif
@@ -1,9 +1,14 @@
 #include <stdio.h>
-#include <mpi.h>
 #include <math.h>
 #include <algorithm>
+#include <time.h>
+#include <limits.h>
 
 #include "master.h"
+#include "segment_stream.h"
+#include "master_stats.h"
+#include "arrival_log.h"
+#include "grad_pipeline.h"
 #include "confreader.h"
 #include "model.h"
 #include "svm.h"
@@ -54,67 +59,125 @@ modelBase * initModelMaster (ConfReader *modelConf, int validBatchSize) {
     return model;
 }
 
-sgdBase * initSgdSolver (ConfReader *confReader, int paramSize) {
+/****************************************************************
+* Solver table, indexed by "solver type". Each solver already runs
+* the kernel instance of its momentum / weight decay setting (see
+* sgd_kernel.h), the table only binds the type to a constructor.
+****************************************************************/
+
+static sgdBase * newSgdBasic (ConfReader *conf, long paramSize, int nSlave, modelBase *model) {
+    return new sgdBasic(conf, paramSize);
+}
+static sgdBase * newAdagrad (ConfReader *conf, long paramSize, int nSlave, modelBase *model) {
+    return new adagrad(conf, paramSize);
+}
+static sgdBase * newAdadelta (ConfReader *conf, long paramSize, int nSlave, modelBase *model) {
+    return new adadelta(conf, paramSize);
+}
+static sgdBase * newRmsprop (ConfReader *conf, long paramSize, int nSlave, modelBase *model) {
+    return new rmsprop(conf, paramSize);
+}
+static sgdBase * newKernelAdadelta (ConfReader *conf, long paramSize, int nSlave, modelBase *model) {
+    return new kernelAdadelta(conf, paramSize, nSlave);
+}
+static sgdBase * newDelayedAdagrad (ConfReader *conf, long paramSize, int nSlave, modelBase *model) {
+    return new delayedAdagrad(conf, paramSize, nSlave);
+}
+static sgdBase * newFutureAdagrad (ConfReader *conf, long paramSize, int nSlave, modelBase *model) {
+    return new futureAdagrad(conf, paramSize, nSlave);
+}
+static sgdBase * newDelayedAdadelta (ConfReader *conf, long paramSize, int nSlave, modelBase *model) {
+    return new DelayedAdadelta(conf, paramSize, nSlave);
+}
+static sgdBase * newAdam (ConfReader *conf, long paramSize, int nSlave, modelBase *model) {
+    return new adam(conf, paramSize);
+}
+static sgdBase * newAdamW (ConfReader *conf, long paramSize, int nSlave, modelBase *model) {
+    return new adamW(conf, paramSize);
+}
+// trust ratio per weight block of the model
+static sgdBase * newLamb (ConfReader *conf, long paramSize, int nSlave, modelBase *model) {
+    printf("MASTER: lamb over %d layers\n", model->numSegments());
+    return new lamb(conf, paramSize, model->m_segOffset, model->m_segSize);
+}
+
+struct sgdSolverEntry {
+    const char *name;
+    sgdBase * (*create) (ConfReader *conf, long paramSize, int nSlave, modelBase *model);
+};
+
+static const sgdSolverEntry sgdSolverTable[] = {
+    {"basic sgd",        newSgdBasic},
+    {"adagrad",          newAdagrad},
+    {"adadelta",         newAdadelta},
+    {"rmsprop",          newRmsprop},
+    {"kernel adadelta",  newKernelAdadelta},
+    {"delayed adagrad",  newDelayedAdagrad},
+    {"future adagrad",   newFutureAdagrad},
+    {"delayed adadelta", newDelayedAdadelta},
+    {"adam",             newAdam},
+    {"adamW",            newAdamW},
+    {"lamb",             newLamb},
+};
+
+sgdBase * initSgdSolver (ConfReader *confReader, long paramSize, int nSlave, modelBase *model) {
     int solverType = confReader->getInt("solver type");
-    sgdBase *sgdSolver;
-    switch (solverType) {
-        // sgdBasic
-        case 0: {
-            printf("Init basic sgd solver.\n");
-            sgdSolver = new sgdBasic(confReader, paramSize);
-            break;
-        }
-        // adagrad
-        case 1: { 
-            printf("Init adagrad solver.\n");
-            sgdSolver = new adagrad(confReader, paramSize);
-            break;
-        }
-        // adadelta
-        case 2: {            
-            sgdSolver = new adadelta(confReader, paramSize);
-            printf("Init adadelta solver.\n");
-            break;
-        }
-        // rmsprop
-        case 3: {
-            sgdSolver = new rmsprop(confReader, paramSize);
-            printf("Init rmsprop solver.\n");
-            break;
-        }
-        // kernel adadelta
-        case 4: {
-            sgdSolver = new kernelAdadelta(confReader, paramSize);
-            printf("Init kernel adadelta solver.\n");
-            break;
-        }
-        // delayed adagrad
-        case 5: {
-            sgdSolver = new delayedAdagrad(confReader, paramSize);
-            printf("Init delayed adagrad solver.\n");
-            break;
-        }
-        // future adagrad
-        case 6: {
-            sgdSolver = new futureAdagrad(confReader, paramSize);
-            printf("Init future adagrad solver.\n");
-            break;
-        }
-        // delayed adadelta
-        case 7: {
-            sgdSolver = new DelayedAdadelta(confReader, paramSize);
-            printf("Init delayed adadelta solver.\n");
-            break;
-        }
-        default: {
-            printf("Error solver type.\n");
-            exit(-1);
-        }
+    int nSolver = sizeof(sgdSolverTable) / sizeof(sgdSolverTable[0]);
+    if (solverType < 0 || solverType >= nSolver) {
+        printf("Error solver type.\n");
+        exit(-1);
+    }
+    printf("Init %s solver.\n", sgdSolverTable[solverType].name);
+    sgdBase *sgdSolver = sgdSolverTable[solverType].create(confReader, paramSize, nSlave, model);
+    // < 0: the clip norm the model was tuned with
+    if (sgdSolver->clipNorm() < 0.f) {
+        sgdSolver->setClipNorm(model->defaultClipNorm());
     }
+    printf("MASTER: clip gradient norm %g\n", sgdSolver->clipNorm());
     return sgdSolver;
 }
 
-void masterFunc () {
+// send params to a slave, whole or in segments ordered by when its forward pass needs them
+void sendParams (commBase *comm, modelBase *model, float *params, int rank, bool streamed, std::vector<commRequest> &requests) {
+    if (!streamed) {
+        comm->sendChunked(params, model->m_nParamSize, COMM_FLOAT, rank, WORKTAG);
+        return;
+    }
+    for (int order = 0; order < model->numSegments(); ++order) {
+        int segIdx = model->forwardSegment(order);
+        comm->isendChunked(params + model->m_segOffset[segIdx], model->m_segSize[segIdx], COMM_FLOAT,
+            rank, PARAMSEGTAG + segIdx, requests);
+    }
+}
+
+// take the oldest grad of the pipeline and apply it to params, returns the rank that sent it
+static int applyNextGrad (commBase *comm, gradPipeline *pipeline, arrivalLog *arrivals, masterStats *stats,
+    sgdBase *sgdSolver, float *params, bool sparseGrad, std::vector<commRequest> &sendRequests) {
+    commStatus status;
+    int buf = pipeline->next(&status);
+    arrivals->record(status.source);
+    stats->onRecv(status.source, pipeline->msgBytes(buf));
+    // keep the other buffers receiving during the update
+    pipeline->post();
+
+    // params may only change once the chunks sent from them have left
+    comm->waitAll(sendRequests);
+    double updateStart = masterStats::wallTime();
+    float *gradInfo = pipeline->gradInfo(buf);
+    sgdSolver->setGradSqNorm(gradInfo[0]);
+    if (sparseGrad) {
+        char *sparseMsg = pipeline->sparseMsg(buf);
+        int nnz = *(int *) sparseMsg;
+        sgdSolver->updateSparse(params, nnz, sparseMsgIndex(sparseMsg), sparseMsgValue(sparseMsg, nnz), status.source);
+    } else {
+        sgdSolver->updateParams(params, pipeline->grad(buf), status.source);
+    }
+    stats->onUpdate(masterStats::wallTime() - updateStart, gradInfo[1]);
+    pipeline->release(buf);
+    return status.source;
+}
+
+void masterFunc (commBase *comm) {
     /****************************************************************
     * Step 1: Setup and Initialization
     * Load conf, init model, allocate mem, init params, init solver
@@ -131,25 +194,32 @@ void masterFunc () {
     // Step 1.2 Initialize model
     ConfReader *modelConf = new ConfReader("config.conf", "Model");
     modelBase *model = initModelMaster(modelConf, validBatchSize);
-    int paramSize = model->m_nParamSize;
-    printf("paramSize: %d\n", paramSize);
+    long paramSize = model->m_nParamSize;
+    printf("paramSize: %ld\n", paramSize);
 
     // Step 1.3: Allocate master memory
     float *params = new float[paramSize];
-    float *grad = new float[paramSize];
 
-    // Step 1.4: Initialize params
+    // Step 1.4: Initialize params (explicit seed makes the run reproducible)
+    int seed = masterConf->getInt("random seed");
+    if (seed == 0) {
+        seed = time(NULL);
+    }
+    printf("MASTER: random seed %d\n", seed);
+    srand(seed);
     model->initParams(params);
     #ifdef DEBUG_MASTER
     printf("MASTER: check initialized params\n");
-    for (int i = 0; i < paramSize; i++) {
+    for (long i = 0; i < paramSize; i++) {
         printf("%f\t", params[i]);
     }
     printf("\n");
     #endif
 	
     // Step 1.5: Initialize SGD Solver
-    sgdBase *sgdSolver = initSgdSolver(masterConf, paramSize);
+    int nProc = comm->size();
+    int nSlave = nProc - 1;
+    sgdBase *sgdSolver = initSgdSolver(masterConf, paramSize, nSlave, model);
     printf("MASTER: finish step 1\n");
 
     // Step 1.6: Load cross-validation data
@@ -160,18 +230,43 @@ void masterFunc () {
     * (1) Broadcast paramSize to all slaves
     * (2) Send the same initial params with WORKTAG to all slaves
     ****************************************************************/
-    int nProc;
-    MPI_Comm_size(MPI_COMM_WORLD, &nProc);
-    int nSlave = nProc - 1;
+    comm->bcast(&paramSize, 1, COMM_LONG, ROOT);    
 
-    MPI_Bcast(&paramSize, 1, MPI_INT, ROOT, MPI_COMM_WORLD);    
+    // runtime counters (samples/sec needs the slaves' minibatch size)
+    ConfReader *slaveConf = new ConfReader("config.conf", "Slave");
+    masterStats *stats = new masterStats(masterConf, nSlave, slaveConf->getInt("training batch size"));
+    bool streamGrad = slaveConf->getInt("stream gradients") != 0;
+    bool streamParams = slaveConf->getInt("stream parameters") != 0;
+    std::vector<commRequest> sendRequests;  // param chunks still in flight
+    long msgBytes = (long) sizeof(float) * paramSize;
+    comm->setChunkBytes(messageChunkBytes(slaveConf));
+
+    // (index, value) grads from models that know their nonzeros, applied lazily by the solver
+    bool sparseGrad = slaveConf->getInt("sparse gradients") != 0 && model->hasSparseGrad();
+    if (sparseGrad) {
+        if (paramSize > INT_MAX) {
+            printf("Error sparse gradients: %ld params, indices are 32-bit.\n", paramSize);
+            exit(-1);
+        }
+        streamGrad = false;
+        printf("MASTER: sparse gradients\n");
+    }
+
+    // record or replay the order in which slave gradients arrive
+    arrivalLog *arrivals = new arrivalLog(masterConf, nSlave);
+
+    // grads received into a ring of buffers, the next one lands while the solver applies this one
+    gradPipeline *pipeline = new gradPipeline(masterConf, comm, model, arrivals, streamGrad, sparseGrad);
 	
     int nSend = 0;
     int nRecv = 0;
     for (int rank = 1; rank < nProc; ++rank) {
-        MPI_Send(params, paramSize, MPI_FLOAT, rank, WORKTAG, MPI_COMM_WORLD);
+        sendParams(comm, model, params, rank, streamParams, sendRequests);
+        stats->onSend(rank, msgBytes);
+        arrivals->onSend(rank);
         nSend++;
     }
+    pipeline->post();
     printf("MASTER: finish step 2\n");
 
     /****************************************************************
@@ -181,18 +276,15 @@ void masterFunc () {
 	* Re-send params to slave to process next mini-batch
 	****************************************************************/
 	
-    MPI_Status status;
     int nSendMax = masterConf->getInt("max iteration number");
     
     // TEMP while loop condition
     while (nSend < nSendMax) {        
-        MPI_Recv(grad, paramSize, MPI_FLOAT, MPI_ANY_SOURCE, MPI_ANY_TAG, MPI_COMM_WORLD, &status);        
+        int source = applyNextGrad(comm, pipeline, arrivals, stats, sgdSolver, params, sparseGrad, sendRequests);
         nRecv++;
-        
-    	sgdSolver->updateParams(params, grad, status.MPI_SOURCE);
 
         // Check recv tag (eg. local new epoch info)
-        // if (status.MPI_TAG == SOME_TAG) {}
+        // if (status.tag == SOME_TAG) {}
 
         // Cross-validation (need a model tester)
         // TODO
@@ -204,8 +296,14 @@ void masterFunc () {
         }
         
         // Send updated params to corresponding slave
-        MPI_Send(params, paramSize, MPI_FLOAT, status.MPI_SOURCE, WORKTAG, MPI_COMM_WORLD);
+        sendParams(comm, model, params, source, streamParams, sendRequests);
+        stats->onSend(source, msgBytes);
+        arrivals->onSend(source);
         nSend++;
+        pipeline->post();
+
+        // print the rolling summary line when the interval has elapsed
+        stats->tick();
     }    
     printf("MASTER: finish step 3\n");
     
@@ -216,29 +314,41 @@ void masterFunc () {
     // Step 4.1: Receive all dispatched but irreceived grad result
     while (nRecv < nSend) {
         // printf("Master, nSend:%d, nRecv:%d\n", nSend, nRecv);
-        MPI_Recv(grad, paramSize, MPI_FLOAT, MPI_ANY_SOURCE, MPI_ANY_TAG, MPI_COMM_WORLD, &status);
-        sgdSolver->updateParams(params, grad, status.MPI_SOURCE);
+        applyNextGrad(comm, pipeline, arrivals, stats, sgdSolver, params, sparseGrad, sendRequests);
         nRecv++;
     }
     // Step 4.2: Send STOPTAG to all slaves
+    comm->waitAll(sendRequests);
     for (int rank = 1; rank < nProc; ++rank) {
-        MPI_Send(&rank, 1, MPI_INT, rank, STOPTAG, MPI_COMM_WORLD);
+        comm->send(&rank, 1, COMM_INT, rank, STOPTAG);
     }    
     printf("MASTER: finish step 4\n");
+
+    // final machine-readable report
+    stats->report();
+
+    // checksum of the trained params, equal across runs that replay the same arrivals
+    double checksum = 0.0;
+    for (long i = 0; i < paramSize; i++) {
+        checksum += fabs(params[i]);
+    }
+    printf("MASTER: params checksum %.10e\n", checksum);
     
     /****************************************************************
     * Step 5: deallocate mem and clear things
     ****************************************************************/
     #ifdef DEBUG_MASTER
     printf("MASTER: check trained params\n");
-    for (int i = 0; i < paramSize; i++) {
+    for (long i = 0; i < paramSize; i++) {
         printf("%f\t", params[i]);
     }
     printf("\n");
     #endif
 
+    delete pipeline;
+    delete arrivals;
+    delete stats;
     delete sgdSolver;
 
     delete [] params;
-    delete [] grad;
 }
\ No newline at end of file
@@ -1,9 +1,10 @@
 #ifndef __MASTER_H__
 #define __MASTER_H__
 
-#include <mpi.h>
 #include <stdio.h>
+#include "comm.h"
 #include "sgd.h"
+#include "model.h"
 
 #define ROOT 0
 
@@ -11,7 +12,7 @@
 #define STOPTAG 2
 
 struct masterConfInfo {
-	int paramSize;
+	long paramSize;
 	int nIterMax;
 	int solverType;
 
@@ -19,12 +20,12 @@ struct masterConfInfo {
 	float initRange;
 };
 
-void masterFunc ();
+void masterFunc (commBase *comm);
 
 void loadConf (masterConfInfo &confInfo);
 
 void initParams (masterConfInfo confInfo, float *params);
 
-sgdBase * initSgdSolver (masterConfInfo confInfo);
+sgdBase * initSgdSolver (ConfReader *confReader, long paramSize, int nSlave, modelBase *model);
 
 #endif
\ No newline at end of file
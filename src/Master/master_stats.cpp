@@ -0,0 +1,166 @@
+#include <sys/time.h>
+
+#include "master_stats.h"
+
+#define MEGA (1024.0 * 1024.0)
+
+masterStats::masterStats (ConfReader *confReader, int nSlave, int batchSize) {
+	m_nSlave = nSlave;
+	m_batchSize = batchSize;
+	m_printInterval = confReader->getFloat("stats print interval");
+	m_reportFile = confReader->getString("stats report file");
+
+	m_nUpdate = 0;
+	m_bytesIn = 0;
+	m_bytesOut = 0;
+	m_sumStaleness = 0;
+	m_maxStaleness = 0;
+	m_updateTime = 0.0;
+	m_sumCost = 0.0;
+
+	m_lastUpdate = 0;
+	m_lastBytesIn = 0;
+	m_lastBytesOut = 0;
+	m_lastStaleness = 0;
+	m_lastUpdateTime = 0.0;
+	m_lastSumCost = 0.0;
+	m_lastRoundTrip = 0.0;
+	m_lastNRoundTrip = 0;
+
+	// rank 0 is the master, slaves are 1..nSlave
+	m_sentVersion.assign(m_nSlave+1, 0);
+	m_sentTime.assign(m_nSlave+1, 0.0);
+	m_nRoundTrip.assign(m_nSlave+1, 0);
+	m_roundTrip.assign(m_nSlave+1, 0.0);
+	m_maxRoundTrip.assign(m_nSlave+1, 0.0);
+	m_sumRoundTrip = 0.0;
+	m_sumNRoundTrip = 0;
+
+	start();
+}
+
+masterStats::~masterStats () {
+	// nothing to do here
+}
+
+double masterStats::wallTime () {
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	return (double) tv.tv_sec + (double) tv.tv_usec * 1e-6;
+}
+
+void masterStats::start () {
+	m_startTime = wallTime();
+	m_lastPrintTime = m_startTime;
+}
+
+void masterStats::onSend (int rank, long bytes) {
+	m_bytesOut += bytes;
+	m_sentVersion[rank] = m_nUpdate;
+	m_sentTime[rank] = wallTime();
+}
+
+void masterStats::onRecv (int rank, long bytes) {
+	m_bytesIn += bytes;
+
+	// staleness: number of updates applied since the slave got its params
+	int staleness = (int) (m_nUpdate - m_sentVersion[rank]);
+	m_sumStaleness += staleness;
+	if (staleness > m_maxStaleness) {
+		m_maxStaleness = staleness;
+	}
+
+	double roundTrip = wallTime() - m_sentTime[rank];
+	m_nRoundTrip[rank] += 1;
+	m_roundTrip[rank] += roundTrip;
+	if (roundTrip > m_maxRoundTrip[rank]) {
+		m_maxRoundTrip[rank] = roundTrip;
+	}
+	m_sumRoundTrip += roundTrip;
+	m_sumNRoundTrip += 1;
+}
+
+void masterStats::onUpdate (double seconds, float cost) {
+	m_nUpdate += 1;
+	m_updateTime += seconds;
+	m_sumCost += cost;
+}
+
+void masterStats::tick () {
+	if (m_printInterval <= 0.f) {
+		return;
+	}
+	double now = wallTime();
+	double elapsed = now - m_lastPrintTime;
+	if (elapsed < m_printInterval) {
+		return;
+	}
+
+	long nUpdate = m_nUpdate - m_lastUpdate;
+	long nRoundTrip = m_sumNRoundTrip - m_lastNRoundTrip;
+	double updatesPerSec = nUpdate / elapsed;
+	double avgStaleness = nUpdate > 0 ? (double) (m_sumStaleness - m_lastStaleness) / nUpdate : 0.0;
+	double avgUpdate = nUpdate > 0 ? (m_updateTime - m_lastUpdateTime) / nUpdate : 0.0;
+	double avgCost = nUpdate > 0 ? (m_sumCost - m_lastSumCost) / nUpdate : 0.0;
+	double avgRoundTrip = nRoundTrip > 0 ? (m_sumRoundTrip - m_lastRoundTrip) / nRoundTrip : 0.0;
+
+	printf("STATS t=%.1fs upd/s=%.1f samples/s=%.1f in=%.2fMB/s out=%.2fMB/s stale=%.2f rtt=%.2fms update=%.3fms cost=%.6f\n",
+		now - m_startTime, updatesPerSec, updatesPerSec * m_batchSize,
+		(m_bytesIn - m_lastBytesIn) / MEGA / elapsed, (m_bytesOut - m_lastBytesOut) / MEGA / elapsed,
+		avgStaleness, avgRoundTrip * 1e3, avgUpdate * 1e3, avgCost);
+	fflush(stdout);
+
+	m_lastPrintTime = now;
+	m_lastUpdate = m_nUpdate;
+	m_lastBytesIn = m_bytesIn;
+	m_lastBytesOut = m_bytesOut;
+	m_lastStaleness = m_sumStaleness;
+	m_lastUpdateTime = m_updateTime;
+	m_lastSumCost = m_sumCost;
+	m_lastRoundTrip = m_sumRoundTrip;
+	m_lastNRoundTrip = m_sumNRoundTrip;
+}
+
+void masterStats::report () {
+	double elapsed = wallTime() - m_startTime;
+	double updatesPerSec = elapsed > 0.0 ? m_nUpdate / elapsed : 0.0;
+	double avgStaleness = m_nUpdate > 0 ? (double) m_sumStaleness / m_nUpdate : 0.0;
+	double avgUpdate = m_nUpdate > 0 ? m_updateTime / m_nUpdate : 0.0;
+	double avgCost = m_nUpdate > 0 ? m_sumCost / m_nUpdate : 0.0;
+
+	printf("STATS total: %ld updates in %.2fs, upd/s=%.1f samples/s=%.1f stale=%.2f update=%.3fms cost=%.6f\n",
+		m_nUpdate, elapsed, updatesPerSec, updatesPerSec * m_batchSize, avgStaleness, avgUpdate * 1e3, avgCost);
+
+	if (m_reportFile.empty() || m_reportFile == "none") {
+		return;
+	}
+	FILE *fp = fopen(m_reportFile.c_str(), "w");
+	if (fp == NULL) {
+		printf("Warning: failed to open stats report file %s\n", m_reportFile.c_str());
+		return;
+	}
+
+	fprintf(fp, "{\n");
+	fprintf(fp, "  \"num_slave\": %d,\n", m_nSlave);
+	fprintf(fp, "  \"batch_size\": %d,\n", m_batchSize);
+	fprintf(fp, "  \"elapsed_sec\": %.6f,\n", elapsed);
+	fprintf(fp, "  \"updates\": %ld,\n", m_nUpdate);
+	fprintf(fp, "  \"updates_per_sec\": %.3f,\n", updatesPerSec);
+	fprintf(fp, "  \"samples_per_sec\": %.3f,\n", updatesPerSec * m_batchSize);
+	fprintf(fp, "  \"bytes_in\": %ld,\n", m_bytesIn);
+	fprintf(fp, "  \"bytes_out\": %ld,\n", m_bytesOut);
+	fprintf(fp, "  \"avg_staleness\": %.4f,\n", avgStaleness);
+	fprintf(fp, "  \"max_staleness\": %d,\n", m_maxStaleness);
+	fprintf(fp, "  \"avg_update_ms\": %.6f,\n", avgUpdate * 1e3);
+	fprintf(fp, "  \"avg_cost\": %.6f,\n", avgCost);
+	fprintf(fp, "  \"slaves\": [\n");
+	for (int rank=1; rank<=m_nSlave; ++rank) {
+		double avgRoundTrip = m_nRoundTrip[rank] > 0 ? m_roundTrip[rank] / m_nRoundTrip[rank] : 0.0;
+		fprintf(fp, "    {\"rank\": %d, \"round_trips\": %ld, \"avg_rtt_ms\": %.6f, \"max_rtt_ms\": %.6f}%s\n",
+			rank, m_nRoundTrip[rank], avgRoundTrip * 1e3, m_maxRoundTrip[rank] * 1e3, rank < m_nSlave ? "," : "");
+	}
+	fprintf(fp, "  ]\n");
+	fprintf(fp, "}\n");
+	fclose(fp);
+	printf("MASTER: stats report written to %s\n", m_reportFile.c_str());
+}
@@ -0,0 +1,73 @@
+#ifndef __MASTER_STATS_H__
+#define __MASTER_STATS_H__
+
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+#include "confreader.h"
+
+/****************************************************************
+* Runtime counters kept by the master: throughput, traffic,
+* staleness, per-slave round-trip latency, solver update time and
+* the minibatch cost the slaves report with their grads.
+* A compact summary line is printed every "stats print interval"
+* seconds and a final report is written to "stats report file".
+****************************************************************/
+
+class masterStats
+{
+public:
+	masterStats(ConfReader *confReader, int nSlave, int batchSize);
+	~masterStats();
+
+	/* method */
+	void start ();
+	void onSend (int rank, long bytes);
+	void onRecv (int rank, long bytes);
+	void onUpdate (double seconds, float cost);
+	void tick ();
+	void report ();
+
+	static double wallTime ();
+
+private:
+	/* data */
+	int m_nSlave;
+	int m_batchSize;
+	double m_printInterval;
+	std::string m_reportFile;
+
+	double m_startTime;
+	double m_lastPrintTime;
+
+	// cumulative counters
+	long m_nUpdate;
+	long m_bytesIn;
+	long m_bytesOut;
+	long m_sumStaleness;
+	int m_maxStaleness;
+	double m_updateTime;
+	double m_sumCost;
+
+	// counters at the last printed summary (rolling window)
+	long m_lastUpdate;
+	long m_lastBytesIn;
+	long m_lastBytesOut;
+	long m_lastStaleness;
+	double m_lastUpdateTime;
+	double m_lastSumCost;
+	double m_lastRoundTrip;
+	long m_lastNRoundTrip;
+
+	// per-slave state, indexed by rank
+	std::vector<long> m_sentVersion;
+	std::vector<double> m_sentTime;
+	std::vector<long> m_nRoundTrip;
+	std::vector<double> m_roundTrip;
+	std::vector<double> m_maxRoundTrip;
+	double m_sumRoundTrip;
+	long m_sumNRoundTrip;
+};
+
+#endif
@@ -3,6 +3,7 @@
 
 feedForwardNN::feedForwardNN (ConfReader *confReader, int minibatchSize) {	
 	m_nMinibatchSize = minibatchSize;
+	m_printCost = confReader->getInt("print minibatch cost") != 0;
 
 	m_numLayer = confReader->getInt("num_layer");
 	m_numNeuronList = new int[m_numLayer];
@@ -23,12 +24,12 @@ feedForwardNN::feedForwardNN (ConfReader *confReader, int minibatchSize) {
 
 		m_vecLayers.push_back(layer);
 	}
-	m_softmaxLayer = new softmaxLayer(m_numNeuronList[m_numLayer-1]);
+	m_softmaxLayer = new softmaxLayer(m_numNeuronList[m_numLayer-1], m_nMinibatchSize);
 
 	// Allocate memory to hold forward input to each non-input layer
 	for (int connectIdx=0; connectIdx<m_numLayer-1; connectIdx++) {
 		int numNeuron = m_numNeuronList[connectIdx+1];
-		float * forwardInfo = new float[numNeuron];
+		float * forwardInfo = new float[numNeuron * m_nMinibatchSize];
 
 		m_vecForwardInfo.push_back(forwardInfo);
 	}
@@ -36,17 +37,18 @@ feedForwardNN::feedForwardNN (ConfReader *confReader, int minibatchSize) {
 	// Allocate memory to hold backprop error to each non-output layer
 	for (int connectIdx=0; connectIdx<m_numLayer-1; connectIdx++) {
 		int numNeuron = m_numNeuronList[connectIdx];
-		float * backpropInfo = new float[numNeuron];
+		float * backpropInfo = new float[numNeuron * m_nMinibatchSize];
 
 		m_vecBackpropInfo.push_back(backpropInfo);
 	}
 
-	// Compute m_nParamSize
+	// Compute m_nParamSize, one grad segment per connection
 	m_nParamSize = 0;
 	for (int connectIdx=0; connectIdx<m_numLayer-1; connectIdx++) {
 		int fanIn = m_numNeuronList[connectIdx]+1;
 		int fanOut = m_numNeuronList[connectIdx+1];
 
+		addSegment(m_nParamSize, fanIn*fanOut);
 		m_nParamSize += fanIn*fanOut;
 	}
 
@@ -81,10 +83,10 @@ layerBase *feedForwardNN::initLayer (int numNeuron, int layerType) {
 	layerBase *layer;
 	switch (layerType) {
 		case 0:
-			layer = new linearLayer(numNeuron);
+			layer = new linearLayer(numNeuron, m_nMinibatchSize);
 			break;
 		case 1:
-			layer = new sigmoidLayer(numNeuron);
+			layer = new sigmoidLayer(numNeuron, m_nMinibatchSize);
 			break;		
 		default:
 			printf("Error in initLayer.");
@@ -94,7 +96,6 @@ layerBase *feedForwardNN::initLayer (int numNeuron, int layerType) {
 }
 
 void feedForwardNN::initParams (float *params) {
-	srand (time(NULL));
 	// Initialize values for weights
 	float *cursor = params;
 	for (int connectIdx=0; connectIdx<m_numLayer-1; ++connectIdx) {
@@ -139,7 +140,8 @@ void feedForwardNN::feedForward (float *input) {
 		int fanIn = m_numNeuronList[connectIdx]+1;
 		int fanOut = m_numNeuronList[connectIdx+1];
 
-		// create ptr to corresponding weights
+		// create ptr to corresponding weights (they may still be arriving)
+		awaitSegment(connectIdx);
 		weights = m_vecWeights[connectIdx];
 
 		// create ptr to associated layers (in & out)
@@ -148,11 +150,13 @@ void feedForwardNN::feedForward (float *input) {
 
 		// create ptr to associated forwardInfo & clean the buffer
 		forwarInfo = m_vecForwardInfo[connectIdx];
-		memset(forwarInfo, 0x00, sizeof(float)*m_numNeuronList[connectIdx+1]);
+		memset(forwarInfo, 0x00, sizeof(float)*fanOut*m_nMinibatchSize);
 	
-		// // matrix computation
-		dot(forwarInfo, weights, fanOut, fanIn-1, inLayer->m_activation, fanIn-1, 1);
-		elem_accum(forwarInfo, weights + fanOut*(fanIn-1), fanOut);
+		// matrix computation for the whole minibatch: [batch x fanOut] = [batch x fanIn-1] * W^T, plus bias per row
+		dot_trans(forwarInfo, inLayer->m_activation, m_nMinibatchSize, fanIn-1, weights, fanOut, fanIn-1);
+		for (int sample=0; sample<m_nMinibatchSize; ++sample) {
+			elem_accum(forwarInfo + sample*fanOut, weights + fanOut*(fanIn-1), fanOut);
+		}
 
 		// compute forwarInfo
 		// for (int in=0; in<fanIn-1; in++) {
@@ -213,11 +217,17 @@ void feedForwardNN::backProp (float *target) {
 		
 		// create ptr to associated backpropInfo & clean the buffer
 		backpropInfo = m_vecBackpropInfo[connectIdx];
-		memset(backpropInfo, 0x00, sizeof(float)*m_numNeuronList[connectIdx]);
+		memset(backpropInfo, 0x00, sizeof(float)*m_numNeuronList[connectIdx]*m_nMinibatchSize);
+
+		// compute weightsGrad summed over the minibatch: [fanOut x fanIn-1] = delta^T * activation
+		trans_dot(weightsGrad, outLayer->m_delta, m_nMinibatchSize, fanOut, inLayer->m_activation, m_nMinibatchSize, fanIn-1);
+		for (int sample=0; sample<m_nMinibatchSize; ++sample) {
+			elem_accum(weightsGrad + fanOut * (fanIn-1), outLayer->m_delta + sample*fanOut, fanOut);
+		}
 
-		// compute weightsGrad
-		outer(weightsGrad, outLayer->m_delta, fanOut, inLayer->m_activation, fanIn-1);
-		elem_accum(weightsGrad + fanOut * (fanIn-1), outLayer->m_delta, fanOut);
+		// weightsGrad of this connection is complete
+		m_gradSqNorm += elem_scale_sqnorm(weightsGrad, 1.f / (float) m_nMinibatchSize, fanIn*fanOut);
+		publishSegment(connectIdx);
 
 		// // printf("compute weightsGrad\n");
 		// for (int in=0; in<fanIn-1; in++) {
@@ -234,8 +244,8 @@ void feedForwardNN::backProp (float *target) {
 		// 	weightsGrad[wIdx+out] += outLayer->m_delta[out];
 		// }
 		
-		// compute backpropInfo
-		trans_dot(backpropInfo, weights, fanOut, fanIn-1, outLayer->m_delta, fanOut, 1);
+		// compute backpropInfo: [batch x fanIn-1] = delta * W
+		dot(backpropInfo, outLayer->m_delta, m_nMinibatchSize, fanOut, weights, fanOut, fanIn-1);
 		// // printf("compute backpropInfo\n");
 		// for (int in=0; in<fanIn-1; in++) {
 		// 	int wIdx = in * fanOut;
@@ -252,80 +262,75 @@ void feedForwardNN::backProp (float *target) {
 
 }
 
-float feedForwardNN::computeGrad (float *grad, float *params, float *data, float *label) {
-	// bind weights
-	// printf("Bind weights\n");
+void feedForwardNN::bindWeights (float *params, float *grad) {
+	// rebind on every call, the buffers may differ between calls
+	m_vecWeights.clear();
+	m_vecWeightsGrad.clear();
+
 	float *paramsCursor = params;
+	float *gradCursor = grad;
 	for (int connectIdx=0; connectIdx<m_numLayer-1; ++connectIdx) {
 		int fanIn = m_numNeuronList[connectIdx]+1;
 		int fanOut = m_numNeuronList[connectIdx+1];
 
-		float *weights = paramsCursor;
-		m_vecWeights.push_back(weights);
+		m_vecWeights.push_back(paramsCursor);
+		m_vecWeightsGrad.push_back(gradCursor);
 
 		paramsCursor += fanIn * fanOut;
+		gradCursor += fanIn * fanOut;
 	}
+}
 
-	// clean the grad buffer and bind it to 
-	// printf("Bind weights grad\n");
+float feedForwardNN::computeGrad (float *grad, float *params, float *data, float *label) {
+	// clean the grad buffer and bind weights and grad
 	memset(grad, 0x00, sizeof(float)*m_nParamSize);
-	float *gradCursor = grad;
-	for (int connectIdx=0; connectIdx<m_numLayer-1; ++connectIdx) {
-		int fanIn = m_numNeuronList[connectIdx]+1;
-		int fanOut = m_numNeuronList[connectIdx+1];
-
-		float *weightsGrad = gradCursor;		
-		m_vecWeightsGrad.push_back(weightsGrad);
-
-		gradCursor += fanIn * fanOut;
-	}
+	bindWeights(params, grad);
+	m_gradSqNorm = 0.f;
 
-	// compute grad by several forward pass and backward pass
-	int dataDim = m_numNeuronList[0];
+	// compute grad by one forward pass and one backward pass over the whole minibatch
 	int labelDim = m_numNeuronList[m_numLayer-1];
-	float *dataCursor = data;
-	float *oneOnlabel = new float[dataDim];
-	int labelInt;
+	float *oneOnlabel = new float[labelDim * m_nMinibatchSize];
+	int *labelInt = new int[m_nMinibatchSize];
 	float error = 0.f;
 	float correctCount = 0.f;
 
+	// produce one-on label representation, one row per sample
+	memset(oneOnlabel, 0x00, sizeof(float)*labelDim*m_nMinibatchSize);
 	for (int dataIdx=0; dataIdx<m_nMinibatchSize; dataIdx++) {
-		// produce one-on label representation
-		memset(oneOnlabel, 0x00, sizeof(float)*labelDim);
-		labelInt = (int)label[dataIdx];
-		if (labelInt < 0) {
-			labelInt = 0;
+		labelInt[dataIdx] = (int)label[dataIdx];
+		if (labelInt[dataIdx] < 0) {
+			labelInt[dataIdx] = 0;
 		}
-		oneOnlabel[labelInt] = 1.f;
-		
-		// feedforward and backpropagation
-		feedForward(dataCursor);
-		backProp(oneOnlabel);
+		oneOnlabel[dataIdx*labelDim + labelInt[dataIdx]] = 1.f;
+	}
+
+	// feedforward and backpropagation, grad is normalized segment by segment
+	feedForward(data);
+	backProp(oneOnlabel);
 
-		// compute some statistics
+	// compute some statistics
+	for (int dataIdx=0; dataIdx<m_nMinibatchSize; dataIdx++) {
+		float *prob = m_softmaxLayer->m_activation + dataIdx*labelDim;
 		float maxP = 0.f;
 		int maxIndex = -1;
 		for (int i=0; i<labelDim; i++) {
-			error += - oneOnlabel[i] * log(m_softmaxLayer->m_activation[i]);
-			if (m_softmaxLayer->m_activation[i] > maxP) {
-				maxP = m_softmaxLayer->m_activation[i];
+			error += - oneOnlabel[dataIdx*labelDim + i] * log(prob[i]);
+			if (prob[i] > maxP) {
+				maxP = prob[i];
 				maxIndex = i;
 			}
 		}
-		if (maxIndex == labelInt) {
+		if (maxIndex == labelInt[dataIdx]) {
 			correctCount ++;
 		}
-
-		// move the dataCursor
-		dataCursor += dataDim;		
 	}
-	printf("Error: %f\n", error / m_nMinibatchSize);
-	printf("Correct rate: %d/%d=%f\n", int(correctCount), m_nMinibatchSize, correctCount / float(m_nMinibatchSize));
-
-	for (int dim=0; dim<m_nParamSize; ++dim) {
-		grad[dim] /= m_nMinibatchSize;
+	error /= m_nMinibatchSize;
+	if (m_printCost) {
+		printf("Error: %f\n", error);
+		printf("Correct rate: %d/%d=%f\n", int(correctCount), m_nMinibatchSize, correctCount / float(m_nMinibatchSize));
 	}
 
 	delete [] oneOnlabel;
+	delete [] labelInt;
 	return error;
 }
\ No newline at end of file
@@ -4,10 +4,11 @@
 * Method definition for linearLayer
 ****************************************************************/
 
-linearLayer::linearLayer (int numNeuron) {
+linearLayer::linearLayer (int numNeuron, int batchSize) {
 	m_numNeuron = numNeuron;
-	m_activation = new float[m_numNeuron];
-	m_delta = new float[m_numNeuron];
+	m_batchSize = batchSize;
+	m_activation = new float[m_numNeuron * m_batchSize];
+	m_delta = new float[m_numNeuron * m_batchSize];
 }
 
 linearLayer::~linearLayer () {
@@ -20,13 +21,13 @@ linearLayer::~linearLayer () {
 }
 
 void linearLayer::activateFunc (float *input) {
-	for (int i=0; i<m_numNeuron; ++i) {
+	for (int i=0; i<m_numNeuron*m_batchSize; ++i) {
 		m_activation[i] = input[i];
 	}
 }
 
 void linearLayer::computeDelta (float *error) {
-	for (int i=0; i<m_numNeuron; ++i) {
+	for (int i=0; i<m_numNeuron*m_batchSize; ++i) {
 		m_delta[i] = error[i];
 	}
 }
@@ -35,10 +36,11 @@ void linearLayer::computeDelta (float *error) {
 * Method definition for softmaxLayer
 ****************************************************************/
 
-softmaxLayer::softmaxLayer (int numNeuron) {
+softmaxLayer::softmaxLayer (int numNeuron, int batchSize) {
 	m_numNeuron = numNeuron;
-	m_activation = new float[m_numNeuron];
-	m_delta = new float[m_numNeuron];
+	m_batchSize = batchSize;
+	m_activation = new float[m_numNeuron * m_batchSize];
+	m_delta = new float[m_numNeuron * m_batchSize];
 }
 
 softmaxLayer::~softmaxLayer () {
@@ -51,21 +53,27 @@ softmaxLayer::~softmaxLayer () {
 }
 
 void softmaxLayer::activateFunc (float *input) {
-	// Pairwise exp
-	float sumActivation = 0.f;
-	for (int i=0; i<m_numNeuron; ++i) {
-		m_activation[i] = exp(input[i]);
-		sumActivation += m_activation[i];
-	}
-
-	// Normalization
-	for (int i=0; i<m_numNeuron; ++i) {
-		m_activation[i] /= sumActivation;
+	// normalized over each sample's row
+	for (int sample=0; sample<m_batchSize; ++sample) {
+		float *in = input + sample * m_numNeuron;
+		float *act = m_activation + sample * m_numNeuron;
+
+		// Pairwise exp
+		float sumActivation = 0.f;
+		for (int i=0; i<m_numNeuron; ++i) {
+			act[i] = exp(in[i]);
+			sumActivation += act[i];
+		}
+
+		// Normalization
+		for (int i=0; i<m_numNeuron; ++i) {
+			act[i] /= sumActivation;
+		}
 	}
 }
 
 void softmaxLayer::computeDelta (float *target) {
-	for (int i=0; i<m_numNeuron; ++i) {
+	for (int i=0; i<m_numNeuron*m_batchSize; ++i) {
 		m_delta[i] = m_activation[i] - target[i];
 	}
 }
@@ -74,10 +82,11 @@ void softmaxLayer::computeDelta (float *target) {
 * Method definition for softmaxLayer
 ****************************************************************/
 
-sigmoidLayer::sigmoidLayer(int numNeuron) {
+sigmoidLayer::sigmoidLayer(int numNeuron, int batchSize) {
 	m_numNeuron = numNeuron;
-	m_activation = new float[m_numNeuron];
-	m_delta = new float[m_numNeuron];
+	m_batchSize = batchSize;
+	m_activation = new float[m_numNeuron * m_batchSize];
+	m_delta = new float[m_numNeuron * m_batchSize];
 }
 
 sigmoidLayer::~sigmoidLayer() {
@@ -90,13 +99,13 @@ sigmoidLayer::~sigmoidLayer() {
 }
 
 void sigmoidLayer::activateFunc (float *input) {
-	for (int i=0; i<m_numNeuron; ++i) {
+	for (int i=0; i<m_numNeuron*m_batchSize; ++i) {
 		m_activation[i] = 1 / (1 + exp(-input[i]));
 	}
 }
 
 void sigmoidLayer::computeDelta (float *error) {
-	for (int i=0; i<m_numNeuron; ++i) {
+	for (int i=0; i<m_numNeuron*m_batchSize; ++i) {
 		m_delta[i] = error[i] * m_activation[i] * (1 - m_activation[i]);
 	}
 }
@@ -16,7 +16,8 @@ public:
 
 	/* data */
 	int m_numNeuron;
-	float *m_activation;
+	int m_batchSize;
+	float *m_activation;	// [m_batchSize x m_numNeuron], one row per sample
 	float *m_delta;
 
 	/* method */
@@ -27,7 +28,7 @@ public:
 class linearLayer: public layerBase
 {
 public:
-	linearLayer (int numNeuron);
+	linearLayer (int numNeuron, int batchSize);
 	~linearLayer ();
 
 	/* data */
@@ -40,7 +41,7 @@ public:
 class softmaxLayer: public layerBase
 {
 public:
-	softmaxLayer (int numNeuron);
+	softmaxLayer (int numNeuron, int batchSize);
 	~softmaxLayer ();
 
 	/* data */
@@ -53,7 +54,7 @@ public:
 class sigmoidLayer: public layerBase
 {
 public:
-	sigmoidLayer (int m_numNeuron);
+	sigmoidLayer (int numNeuron, int batchSize);
 	~sigmoidLayer ();
 
 	/* data */
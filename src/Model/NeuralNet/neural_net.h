@@ -20,6 +20,7 @@ public:
 	layerBase *m_softmaxLayer;
 	std::vector<layerBase *> m_vecLayers;
 
+	// per connection, [m_nMinibatchSize x neurons]: the whole minibatch is one GEMM per layer
 	std::vector<float *> m_vecForwardInfo;
 	std::vector<float *> m_vecBackpropInfo;
 
@@ -33,6 +34,7 @@ public:
 private:
 	layerBase *initLayer (int numNeuron, int layerType);
 	void initWeights (float *weights, int fanIn, int fanOut, int type=0);
+	void bindWeights (float *params, float *grad);
 	void feedForward (float *input);
 	void backProp (float *target);
 };
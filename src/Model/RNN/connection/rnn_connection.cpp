@@ -45,25 +45,28 @@ void RNNFullConnection::bindWeights(float *params, float *grad) {
 void RNNFullConnection::feedForward(int inputSeqLen) {
 	int preNumNeuron = m_preLayer->m_numNeuron;
 	int postNumNeuron = m_postLayer->m_numNeuron;
-	for (int seqIdx=1; seqIdx<=inputSeqLen; ++seqIdx) {		
-		// m_weights
-		float *weights = m_weights;
-		dot(m_postLayer->m_inputActs[seqIdx], weights, postNumNeuron, preNumNeuron, m_preLayer->m_outputActs[seqIdx], preNumNeuron, 1);
-		// m_bias
-		elem_accum(m_postLayer->m_inputActs[seqIdx], m_bias, postNumNeuron);
+	// no recurrence: time steps 1..T are contiguous and go through as one [T*batch x pre] matrix
+	int batchSteps = m_preLayer->m_batchSize * inputSeqLen;
+	// m_weights, [T*batch x pre] x [post x pre]^T
+	float *weights = m_weights;
+	dot_trans(m_postLayer->m_inputActs[1], m_preLayer->m_outputActs[1], batchSteps, preNumNeuron, weights, postNumNeuron, preNumNeuron);
+	// m_bias
+	for (int rowIdx=0; rowIdx<batchSteps; ++rowIdx) {
+		elem_accum(m_postLayer->m_inputActs[1] + rowIdx*postNumNeuron, m_bias, postNumNeuron);
 	}
 }
 
 void RNNFullConnection::feedBackward(int inputSeqLen) {
 	int preNumNeuron = m_preLayer->m_numNeuron;
 	int postNumNeuron = m_postLayer->m_numNeuron;	
-	for (int seqIdx=1; seqIdx<=inputSeqLen; ++seqIdx) {
-		// m_preLayer->m_outputErrs
-		trans_dot(m_preLayer->m_outputErrs[seqIdx], m_weights, postNumNeuron, preNumNeuron, m_postLayer->m_inputErrs[seqIdx], postNumNeuron, 1);
-		// m_gradWeights
-		outer(m_gradWeights, m_postLayer->m_inputErrs[seqIdx], postNumNeuron, m_preLayer->m_outputActs[seqIdx], preNumNeuron);
-		// m_gradBias
-		elem_accum(m_gradBias, m_postLayer->m_inputErrs[seqIdx], postNumNeuron);
+	int batchSteps = m_preLayer->m_batchSize * inputSeqLen;
+	// m_preLayer->m_outputErrs
+	dot(m_preLayer->m_outputErrs[1], m_postLayer->m_inputErrs[1], batchSteps, postNumNeuron, m_weights, postNumNeuron, preNumNeuron);
+	// m_gradWeights, summed over the minibatch and the time steps
+	trans_dot(m_gradWeights, m_postLayer->m_inputErrs[1], batchSteps, postNumNeuron, m_preLayer->m_outputActs[1], batchSteps, preNumNeuron);
+	// m_gradBias
+	for (int rowIdx=0; rowIdx<batchSteps; ++rowIdx) {
+		elem_accum(m_gradBias, m_postLayer->m_inputErrs[1] + rowIdx*postNumNeuron, postNumNeuron);
 	}
 }
 
@@ -77,7 +80,7 @@ LSTMConnection::LSTMConnection(RecurrentLayer *preLayer, RecurrentLayer *postLay
 
 void LSTMConnection::feedForward(int inputSeqLen) {
 	// independent loop -> use OpenMP potentially
-	int inputSize = m_preLayer->m_numNeuron;
+	int inputSize = m_preLayer->m_batchSize * m_preLayer->m_numNeuron;
 	for (int seqIdx=1; seqIdx<=inputSeqLen; ++seqIdx) {
 		float *preOutActs = m_preLayer->m_outputActs[seqIdx];
 		float *postInActs = m_postLayer->m_inputActs[seqIdx];
@@ -87,7 +90,7 @@ void LSTMConnection::feedForward(int inputSeqLen) {
 
 void LSTMConnection::feedBackward(int inputSeqLen) {
 	// independent loop -> use OpenMP potentially
-	int errorSize = m_preLayer->m_numNeuron;
+	int errorSize = m_preLayer->m_batchSize * m_preLayer->m_numNeuron;
 	for (int seqIdx=1; seqIdx<=inputSeqLen; ++seqIdx) {
 		float *preOutErrs = m_preLayer->m_outputErrs[seqIdx];
 		float *postInErrs = m_postLayer->m_inputErrs[seqIdx];
@@ -27,8 +27,10 @@ void dot (float *result, float *A, int dim1_A, int dim2_A, float *B, int dim1_B,
 				}
 			}
 		}
-	} else {
+	} else if (dim2_B == 1) {
 		cblas_sgemv(CblasRowMajor, CblasNoTrans, dim1_A, dim2_A, 1.0, A, dim2_A, B, 1, 1.0, result, 1);
+	} else {
+		cblas_sgemm(CblasRowMajor, CblasNoTrans, CblasNoTrans, dim1_A, dim2_B, dim2_A, 1.0, A, dim2_A, B, dim2_B, 1.0, result, dim2_B);
 	}
 }
 
@@ -44,8 +46,45 @@ void trans_dot (float *result, float *A, int dim1_A, int dim2_A, float *B, int d
 				}
 			}
 		}
-	} else {
+	} else if (dim2_B == 1) {
 		cblas_sgemv(CblasRowMajor, CblasTrans, dim1_A, dim2_A, 1.0, A, dim2_A, B, 1, 1.0, result, 1);
+	} else {
+		cblas_sgemm(CblasRowMajor, CblasTrans, CblasNoTrans, dim2_A, dim2_B, dim1_A, 1.0, A, dim2_A, B, dim2_B, 1.0, result, dim2_B);
+	}
+}
+
+void dot_trans (float *result, float *A, int dim1_A, int dim2_A, float *B, int dim1_B, int dim2_B) {
+	assert(dim2_A == dim2_B);
+	if (!SIMD) {
+		int dim_inner = dim2_A;
+		for (int i=0; i<dim1_A; ++i) {
+			for (int j=0; j<dim1_B; ++j) {
+				for (int k=0; k<dim_inner; ++k) {
+					// R_ij += A_ik * B_jk
+					result[i*dim1_B+j] += A[i*dim2_A+k] * B[j*dim2_B+k];
+				}
+			}
+		}
+	} else {
+		cblas_sgemm(CblasRowMajor, CblasNoTrans, CblasTrans, dim1_A, dim1_B, dim2_A, 1.0, A, dim2_A, B, dim2_B, 1.0, result, dim1_B);
+	}
+}
+
+// result [dim1 x dim2] += op(A) * op(B), each operand may be a block of a wider matrix (row stride ld_*)
+void block_dot (float *result, int ld_result, float *A, int ld_A, bool trans_A, float *B, int ld_B, bool trans_B, int dim1, int dim2, int dim_inner) {
+	if (!SIMD) {
+		for (int i=0; i<dim1; ++i) {
+			for (int j=0; j<dim2; ++j) {
+				for (int k=0; k<dim_inner; ++k) {
+					float a = trans_A ? A[k*ld_A+i] : A[i*ld_A+k];
+					float b = trans_B ? B[j*ld_B+k] : B[k*ld_B+j];
+					result[i*ld_result+j] += a * b;
+				}
+			}
+		}
+	} else {
+		cblas_sgemm(CblasRowMajor, trans_A ? CblasTrans : CblasNoTrans, trans_B ? CblasTrans : CblasNoTrans, dim1, dim2, dim_inner, 
+			1.0, A, ld_A, B, ld_B, 1.0, result, ld_result);
 	}
 }
 
@@ -155,4 +194,61 @@ void elem_accum (float *result, float *a, int dim) {
 			result[i] += a[i];
 		}
 	#endif
-}
\ No newline at end of file
+}
+
+void elem_scale (float *result, float scale, int dim) {
+	#ifdef __APPLE__
+		for (int i=0; i<dim; ++i) {
+			result[i] *= scale;
+		}
+	#elif __linux
+		int residual = dim % SIMD_WIDTH;
+		int stopSIMD = dim - residual;
+
+		__m256 vec_scale = _mm256_set1_ps(scale);
+		__m256 vec_res;
+		for (int i=0; i<stopSIMD; i+=SIMD_WIDTH) {
+			vec_res = _mm256_loadu_ps(result + i);
+			vec_res = _mm256_mul_ps(vec_res, vec_scale);
+			_mm256_storeu_ps(result + i, vec_res);
+		}
+
+		for (int i=stopSIMD; i<dim; ++i) {
+			result[i] *= scale;
+		}
+	#endif
+}
+
+float elem_scale_sqnorm (float *result, float scale, int dim) {
+	float sqnorm = 0.f;
+	#ifdef __APPLE__
+		for (int i=0; i<dim; ++i) {
+			result[i] *= scale;
+			sqnorm += result[i] * result[i];
+		}
+	#elif __linux
+		int residual = dim % SIMD_WIDTH;
+		int stopSIMD = dim - residual;
+
+		__m256 vec_scale = _mm256_set1_ps(scale);
+		__m256 vec_sum = _mm256_setzero_ps();
+		__m256 vec_res;
+		for (int i=0; i<stopSIMD; i+=SIMD_WIDTH) {
+			vec_res = _mm256_loadu_ps(result + i);
+			vec_res = _mm256_mul_ps(vec_res, vec_scale);
+			_mm256_storeu_ps(result + i, vec_res);
+			vec_sum = _mm256_add_ps(vec_sum, _mm256_mul_ps(vec_res, vec_res));
+		}
+
+		float lanes[SIMD_WIDTH];
+		_mm256_storeu_ps(lanes, vec_sum);
+		for (int i=0; i<SIMD_WIDTH; ++i) {
+			sqnorm += lanes[i];
+		}
+		for (int i=stopSIMD; i<dim; ++i) {
+			result[i] *= scale;
+			sqnorm += result[i] * result[i];
+		}
+	#endif
+	return sqnorm;
+}
@@ -14,6 +14,10 @@ void dot (float *result, float *A, int dim1_A, int dim2_A, float *B, int dim1_B,
 
 void trans_dot (float *result, float *A, int dim1_A, int dim2_A, float *B, int dim1_B, int dim2_B);
 
+void dot_trans (float *result, float *A, int dim1_A, int dim2_A, float *B, int dim1_B, int dim2_B);
+
+void block_dot (float *result, int ld_result, float *A, int ld_A, bool trans_A, float *B, int ld_B, bool trans_B, int dim1, int dim2, int dim_inner);
+
 void elem_mul (float *result, float *a, float *b, int dim);
 
 void elem_mul_triple (float *result, float *a, float *b, float *c, int dim);
@@ -22,4 +26,9 @@ void elem_sub (float *result, float *a, float *b, int dim);
 
 void elem_accum (float *result, float *a, int dim);
 
+void elem_scale (float *result, float scale, int dim);
+
+// result *= scale, returns the sum of squares of the scaled result
+float elem_scale_sqnorm (float *result, float scale, int dim);
+
 #endif
\ No newline at end of file
@@ -2,14 +2,11 @@
 
 using namespace std;
 
-LSTMLayer::LSTMLayer(int numNeuron, int maxSeqLen, int inputSize) : RecurrentLayer(numNeuron, maxSeqLen, inputSize) {
-	// resize all vectors
-	resize(m_maxSeqLen);
+LSTMLayer::LSTMLayer(int numNeuron, int maxSeqLen, int inputSize, int batchSize, bool fusedGates) : RecurrentLayer(numNeuron, maxSeqLen, inputSize, batchSize) {
+	m_fusedGates = fusedGates;
 
 	// allocate memory
-	for (int seqIdx=0; seqIdx<m_maxSeqLen+2; ++seqIdx) {
-		allocateMem(seqIdx);
-	}
+	allocateMem();
 
 	for (int idx=0; idx<4; ++idx) {
 		float *neuronSizeBuf = new float[m_numNeuron];
@@ -17,7 +14,7 @@ LSTMLayer::LSTMLayer(int numNeuron, int maxSeqLen, int inputSize) : RecurrentLay
 		float *inputSizeBuf = new float[m_inputSize];
 		m_inputSizeBuf.push_back(inputSizeBuf);
 	}
-	m_derivBuf = new float[m_numNeuron];
+	m_derivBuf = new float[m_batchSize * m_numNeuron];
 
 	// compute m_nParamSize
 	m_nParamSize = 0;
@@ -36,13 +33,11 @@ LSTMLayer::LSTMLayer(int numNeuron, int maxSeqLen, int inputSize) : RecurrentLay
 	m_nParamSize += m_numNeuron * m_inputSize;	// W_o_x : [m_numNeuron x m_inputSize]
 	m_nParamSize += m_numNeuron * m_numNeuron;	// W_o_h : [m_numNeuron x m_numNeuron]
 	m_nParamSize += m_numNeuron;				// W_o_c : [m_numNeuron x 1]	
+
+	// the fused layout holds the same weights: W_gates [4 * m_numNeuron x (m_inputSize + m_numNeuron)], W_i_c, W_f_c, W_o_c
 }
 
 LSTMLayer::~LSTMLayer() {
-	for (int seqIdx=0; seqIdx<m_maxSeqLen+2; ++seqIdx) {
-		releaseMem(seqIdx);
-	}
-
 	for (int idx=0; idx<4; ++idx) {
 		if (m_neuronSizeBuf[idx] != NULL) {delete [] m_neuronSizeBuf[idx];}
 		if (m_inputSizeBuf[idx] != NULL) {delete [] m_inputSizeBuf[idx];}
@@ -59,224 +54,326 @@ void LSTMLayer::initParams(float *params) {
 	}
 }
 
-void LSTMLayer::resize(int newSeqLen) {
-	// three gate units
-	m_inGateActs.resize(newSeqLen+2);
-	m_forgetGateActs.resize(newSeqLen+2);
-	m_outGateActs.resize(newSeqLen+2);
-	
-	// states related
-	m_preOutGateActs.resize(newSeqLen+2);
-	m_states.resize(newSeqLen+2);
-	m_preGateStates.resize(newSeqLen+2);
-	
-	// states errors
-	m_cellStateErrs.resize(newSeqLen+2);
-
-	// four delta
-	m_preGateStateDelta.resize(newSeqLen+2);
-	m_inGateDelta.resize(newSeqLen+2);
-	m_forgetGateDelta.resize(newSeqLen+2);
-	m_outGateDelta.resize(newSeqLen+2);
-}
+void LSTMLayer::allocateMem() {
+	int stepSize = m_batchSize * m_numNeuron;
 
-void LSTMLayer::allocateMem(int seqIdx) {
 	// three gate units
-	m_inGateActs[seqIdx] = new float [m_numNeuron];
-	m_forgetGateActs[seqIdx] = new float [m_numNeuron];
-	m_outGateActs[seqIdx] = new float [m_numNeuron];
+	allocateSteps(m_inGateActs, stepSize);
+	allocateSteps(m_forgetGateActs, stepSize);
+	allocateSteps(m_outGateActs, stepSize);
 
 	// states related
-	m_preOutGateActs[seqIdx] = new float [m_numNeuron];
-	m_states[seqIdx] = new float [m_numNeuron];
-	m_preGateStates[seqIdx] = new float [m_numNeuron];
+	allocateSteps(m_preOutGateActs, stepSize);
+	allocateSteps(m_states, stepSize);
+	allocateSteps(m_preGateStates, stepSize);
 
 	// states errors
-	m_cellStateErrs[seqIdx] = new float [m_numNeuron];
+	allocateSteps(m_cellStateErrs, stepSize);
 
 	// four deltas
-	m_preGateStateDelta[seqIdx] = new float [m_numNeuron];
-	m_inGateDelta[seqIdx] = new float [m_numNeuron];
-	m_forgetGateDelta[seqIdx] = new float [m_numNeuron];
-	m_outGateDelta[seqIdx] = new float [m_numNeuron];
-}
-
-void LSTMLayer::releaseMem(int seqIdx) {
-	// three gate units
-	if (m_inGateActs[seqIdx] != NULL) {delete [] m_inGateActs[seqIdx];}
-	if (m_forgetGateActs[seqIdx] != NULL) {delete [] m_forgetGateActs[seqIdx];}
-	if (m_outGateActs[seqIdx] != NULL) {delete [] m_outGateActs[seqIdx];}
-
-	// states related
-	if (m_preOutGateActs[seqIdx] != NULL) {delete [] m_preOutGateActs[seqIdx];}
-	if (m_states[seqIdx] != NULL) {delete [] m_states[seqIdx];}
-	if (m_preGateStates[seqIdx] != NULL) {delete [] m_preGateStates[seqIdx];}	
+	allocateSteps(m_preGateStateDelta, stepSize);
+	allocateSteps(m_inGateDelta, stepSize);
+	allocateSteps(m_forgetGateDelta, stepSize);
+	allocateSteps(m_outGateDelta, stepSize);
+
+	if (m_fusedGates) {
+		allocateSteps(m_gatePreActs, 4 * stepSize);
+		allocateSteps(m_gateDeltas, 4 * stepSize);
+	}
 
-	// states errors
-	if (m_cellStateErrs[seqIdx] != NULL) {delete [] m_cellStateErrs[seqIdx];}
+	// the base class quantities share the arena
+	layoutArena();
+}
 
-	// four deltas
-	if (m_preGateStateDelta[seqIdx] != NULL) {delete [] m_preGateStateDelta[seqIdx];}
-	if (m_inGateDelta[seqIdx] != NULL) {delete [] m_inGateDelta[seqIdx];}
-	if (m_forgetGateDelta[seqIdx] != NULL) {delete [] m_forgetGateDelta[seqIdx];}
-	if (m_outGateDelta[seqIdx] != NULL) {delete [] m_outGateDelta[seqIdx];}
+long LSTMLayer::stepSize() {
+	// 11 [batch x N] buffers, the fused layout adds two [batch x 4N]
+	long internalSize = (long) m_batchSize * m_numNeuron * (m_fusedGates ? 19 : 11);
+	return RecurrentLayer::stepSize() + internalSize;
 }
 
-void LSTMLayer::reshape(int newSeqLen) {
-	// release mem if needed
-	if (newSeqLen < m_maxSeqLen) {
-		for (int seqIdx=newSeqLen+2; seqIdx<m_maxSeqLen+2; ++seqIdx) {
-			releaseMem(seqIdx);
-		}
+void LSTMLayer::peephole(float *result, float *weights, float *acts) {
+	// the diagonal peephole weights apply to every sequence of the minibatch
+	for (int rowIdx=0; rowIdx<m_batchSize; ++rowIdx) {
+		elem_mul(result + rowIdx*m_numNeuron, weights, acts + rowIdx*m_numNeuron, m_numNeuron);
 	}
-	
-	// resize vectors
-	resize(newSeqLen);	
+}
 
-	// allocate new mem if needed
-	if (newSeqLen > m_maxSeqLen) {
-		for (int seqIdx=m_maxSeqLen+2; seqIdx<newSeqLen+2; ++seqIdx) {
-			allocateMem(seqIdx);
-		}
+void LSTMLayer::peepholeGrad(float *grad, float *delta, float *acts, int numRows) {
+	// summed over numRows rows of [batch x N] blocks
+	for (int rowIdx=0; rowIdx<numRows; ++rowIdx) {
+		elem_mul(grad, delta + rowIdx*m_numNeuron, acts + rowIdx*m_numNeuron, m_numNeuron);
 	}
-
-	// call parent class reshape
-	RecurrentLayer::reshape(newSeqLen);
 }
 
-void LSTMLayer::resetStates(int inputSeqLen) {
-	/* all states and activations are initialised to zero at t = 0 */
-	/* all delta and error terms are zero at t = T + 1 */
-
-	for (int seqIdx=0; seqIdx<inputSeqLen+2; ++seqIdx) {
-		// three gate units
-		memset(m_inGateActs[seqIdx], 0x00, sizeof(float) * m_numNeuron);
-		memset(m_forgetGateActs[seqIdx], 0x00, sizeof(float) * m_numNeuron);
-		memset(m_outGateActs[seqIdx], 0x00, sizeof(float) * m_numNeuron);
-
-		// three states
-		memset(m_preOutGateActs[seqIdx], 0x00, sizeof(float) * m_numNeuron);
-		memset(m_states[seqIdx], 0x00, sizeof(float) * m_numNeuron);
-		memset(m_preGateStates[seqIdx], 0x00, sizeof(float) * m_numNeuron);
-
-		// cell errors
-		memset(m_cellStateErrs[seqIdx], 0x00, sizeof(float) * m_numNeuron);
-
-		// four deltas at Time t=T+1
-		memset(m_outGateDelta[seqIdx], 0x00, sizeof(float) * m_numNeuron);
-		memset(m_preGateStateDelta[seqIdx], 0x00, sizeof(float) * m_numNeuron);
-		memset(m_forgetGateDelta[seqIdx], 0x00, sizeof(float) * m_numNeuron);
-		memset(m_inGateDelta[seqIdx], 0x00, sizeof(float) * m_numNeuron);
+void LSTMLayer::feedForward(int inputSeqLen) {
+	if (m_fusedGates) {
+		feedForwardFused(inputSeqLen);
+		return;
 	}
 
-	// call parent class resetStates
-	RecurrentLayer::resetStates(inputSeqLen);
-}
+	// all buffers are [m_batchSize x size], each product is one GEMM over the minibatch
+	int batchNeuron = m_batchSize * m_numNeuron;
+	int batchSteps = m_batchSize * inputSeqLen;
 
-void LSTMLayer::feedForward(int inputSeqLen) {
-	// for each time step from 1 to T
+	// the input projections do not depend on the recurrence: one GEMM per gate over time steps 1..T
+	dot_trans(m_inGateActs[1], m_inputActs[1], batchSteps, m_inputSize, W_i_x, m_numNeuron, m_inputSize);
+	dot_trans(m_forgetGateActs[1], m_inputActs[1], batchSteps, m_inputSize, W_f_x, m_numNeuron, m_inputSize);
+	dot_trans(m_preGateStates[1], m_inputActs[1], batchSteps, m_inputSize, W_c_x, m_numNeuron, m_inputSize);
+	dot_trans(m_outGateActs[1], m_inputActs[1], batchSteps, m_inputSize, W_o_x, m_numNeuron, m_inputSize);
+
+	// for each time step from 1 to T, only the recurrent part
 	for (int seqIdx=1; seqIdx<=inputSeqLen; ++seqIdx) {
 		// compute input gate activation
-		dot(m_inGateActs[seqIdx], W_i_x, m_numNeuron, m_inputSize, m_inputActs[seqIdx], m_inputSize, 1);
-		dot(m_inGateActs[seqIdx], W_i_h, m_numNeuron, m_numNeuron, m_outputActs[seqIdx-1], m_numNeuron, 1);
-		elem_mul(m_inGateActs[seqIdx], W_i_c, m_states[seqIdx-1], m_numNeuron);
-		sigm(m_inGateActs[seqIdx], m_inGateActs[seqIdx], m_numNeuron);
+		dot_trans(m_inGateActs[seqIdx], m_outputActs[seqIdx-1], m_batchSize, m_numNeuron, W_i_h, m_numNeuron, m_numNeuron);
+		peephole(m_inGateActs[seqIdx], W_i_c, m_states[seqIdx-1]);
+		sigm(m_inGateActs[seqIdx], m_inGateActs[seqIdx], batchNeuron);
 		
 		// compute forget gate activation
-		dot(m_forgetGateActs[seqIdx], W_f_x, m_numNeuron, m_inputSize, m_inputActs[seqIdx], m_inputSize, 1);
-		dot(m_forgetGateActs[seqIdx], W_f_h, m_numNeuron, m_numNeuron, m_outputActs[seqIdx-1], m_numNeuron, 1);
-		elem_mul(m_forgetGateActs[seqIdx], W_f_c, m_states[seqIdx-1], m_numNeuron);
-		sigm(m_forgetGateActs[seqIdx], m_forgetGateActs[seqIdx], m_numNeuron);
+		dot_trans(m_forgetGateActs[seqIdx], m_outputActs[seqIdx-1], m_batchSize, m_numNeuron, W_f_h, m_numNeuron, m_numNeuron);
+		peephole(m_forgetGateActs[seqIdx], W_f_c, m_states[seqIdx-1]);
+		sigm(m_forgetGateActs[seqIdx], m_forgetGateActs[seqIdx], batchNeuron);
 
 		// compute pre-gate states
-		dot(m_preGateStates[seqIdx], W_c_x, m_numNeuron, m_inputSize, m_inputActs[seqIdx], m_inputSize, 1);
-		dot(m_preGateStates[seqIdx], W_c_h, m_numNeuron, m_numNeuron, m_outputActs[seqIdx-1], m_numNeuron, 1);
-		tanh(m_preGateStates[seqIdx], m_preGateStates[seqIdx], m_numNeuron);		
+		dot_trans(m_preGateStates[seqIdx], m_outputActs[seqIdx-1], m_batchSize, m_numNeuron, W_c_h, m_numNeuron, m_numNeuron);
+		tanh(m_preGateStates[seqIdx], m_preGateStates[seqIdx], batchNeuron);		
 
 		// compute cell states
-		elem_mul(m_states[seqIdx], m_forgetGateActs[seqIdx], m_states[seqIdx-1], m_numNeuron);
-		elem_mul(m_states[seqIdx], m_inGateActs[seqIdx], m_preGateStates[seqIdx], m_numNeuron);
+		elem_mul(m_states[seqIdx], m_forgetGateActs[seqIdx], m_states[seqIdx-1], batchNeuron);
+		elem_mul(m_states[seqIdx], m_inGateActs[seqIdx], m_preGateStates[seqIdx], batchNeuron);
 
 		// compute output gate activation
-		dot(m_outGateActs[seqIdx], W_o_x, m_numNeuron, m_inputSize, m_inputActs[seqIdx], m_inputSize, 1);
-		dot(m_outGateActs[seqIdx], W_o_h, m_numNeuron, m_numNeuron, m_outputActs[seqIdx-1], m_numNeuron, 1);
-		elem_mul(m_outGateActs[seqIdx], W_o_c, m_states[seqIdx], m_numNeuron);
-		sigm(m_outGateActs[seqIdx], m_outGateActs[seqIdx], m_numNeuron);
+		dot_trans(m_outGateActs[seqIdx], m_outputActs[seqIdx-1], m_batchSize, m_numNeuron, W_o_h, m_numNeuron, m_numNeuron);
+		peephole(m_outGateActs[seqIdx], W_o_c, m_states[seqIdx]);
+		sigm(m_outGateActs[seqIdx], m_outGateActs[seqIdx], batchNeuron);
 
 		// compute pre-output-gate activation
-		tanh(m_preOutGateActs[seqIdx], m_states[seqIdx], m_numNeuron);
+		tanh(m_preOutGateActs[seqIdx], m_states[seqIdx], batchNeuron);
 
 		// compute output activation
-		elem_mul(m_outputActs[seqIdx], m_outGateActs[seqIdx], m_preOutGateActs[seqIdx], m_numNeuron);
+		elem_mul(m_outputActs[seqIdx], m_outGateActs[seqIdx], m_preOutGateActs[seqIdx], batchNeuron);
 	}
 }
 
 void LSTMLayer::feedBackward(int inputSeqLen) {	
+	if (m_fusedGates) {
+		feedBackwardFused(inputSeqLen);
+		return;
+	}
+
+	int batchNeuron = m_batchSize * m_numNeuron;
+	int batchSteps = m_batchSize * inputSeqLen;
+
 	// sequential for each time step from T to 1
 	for (int seqIdx=inputSeqLen; seqIdx>0; --seqIdx) {
 		// four computations are independent but write to the same memory
 		// output error: m_outputErrs[seqIdx]. all deltas are from Time t=seqIdx+1		
-		trans_dot(m_outputErrs[seqIdx], W_i_h, m_numNeuron, m_numNeuron, m_inGateDelta[seqIdx+1], m_numNeuron, 1);
-		trans_dot(m_outputErrs[seqIdx], W_f_h, m_numNeuron, m_numNeuron, m_forgetGateDelta[seqIdx+1], m_numNeuron, 1);
-		trans_dot(m_outputErrs[seqIdx], W_c_h, m_numNeuron, m_numNeuron, m_preGateStateDelta[seqIdx+1], m_numNeuron, 1);
-		trans_dot(m_outputErrs[seqIdx], W_o_h, m_numNeuron, m_numNeuron, m_outGateDelta[seqIdx+1], m_numNeuron, 1);		
+		dot(m_outputErrs[seqIdx], m_inGateDelta[seqIdx+1], m_batchSize, m_numNeuron, W_i_h, m_numNeuron, m_numNeuron);
+		dot(m_outputErrs[seqIdx], m_forgetGateDelta[seqIdx+1], m_batchSize, m_numNeuron, W_f_h, m_numNeuron, m_numNeuron);
+		dot(m_outputErrs[seqIdx], m_preGateStateDelta[seqIdx+1], m_batchSize, m_numNeuron, W_c_h, m_numNeuron, m_numNeuron);
+		dot(m_outputErrs[seqIdx], m_outGateDelta[seqIdx+1], m_batchSize, m_numNeuron, W_o_h, m_numNeuron, m_numNeuron);
 
 		// computations are independent but use the same m_derivBuf
 		// output gate delta (Time t = seqIdx): m_outGateDelta[seqIdx]
-		sigm_deriv(m_derivBuf, m_outGateActs[seqIdx], m_numNeuron);
-		elem_mul_triple(m_outGateDelta[seqIdx], m_outputErrs[seqIdx], m_derivBuf, m_preOutGateActs[seqIdx], m_numNeuron);
+		sigm_deriv(m_derivBuf, m_outGateActs[seqIdx], batchNeuron);
+		elem_mul_triple(m_outGateDelta[seqIdx], m_outputErrs[seqIdx], m_derivBuf, m_preOutGateActs[seqIdx], batchNeuron);
 
 		// computations are independent but write to the same memory and depend on the seqIdx+1 time step
 		// cell state error
-		tanh_deriv(m_derivBuf, m_preOutGateActs[seqIdx], m_numNeuron);
-		elem_mul_triple(m_cellStateErrs[seqIdx], m_outputErrs[seqIdx], m_outGateActs[seqIdx], m_derivBuf, m_numNeuron);
+		tanh_deriv(m_derivBuf, m_preOutGateActs[seqIdx], batchNeuron);
+		elem_mul_triple(m_cellStateErrs[seqIdx], m_outputErrs[seqIdx], m_outGateActs[seqIdx], m_derivBuf, batchNeuron);
 
-		elem_mul(m_cellStateErrs[seqIdx], m_cellStateErrs[seqIdx+1], m_forgetGateActs[seqIdx+1], m_numNeuron);
-		elem_mul(m_cellStateErrs[seqIdx], W_i_c, m_inGateDelta[seqIdx+1], m_numNeuron);
-		elem_mul(m_cellStateErrs[seqIdx], W_f_c, m_forgetGateDelta[seqIdx+1], m_numNeuron);
-		elem_mul(m_cellStateErrs[seqIdx], W_o_c, m_outGateDelta[seqIdx], m_numNeuron);
+		elem_mul(m_cellStateErrs[seqIdx], m_cellStateErrs[seqIdx+1], m_forgetGateActs[seqIdx+1], batchNeuron);
+		peephole(m_cellStateErrs[seqIdx], W_i_c, m_inGateDelta[seqIdx+1]);
+		peephole(m_cellStateErrs[seqIdx], W_f_c, m_forgetGateDelta[seqIdx+1]);
+		peephole(m_cellStateErrs[seqIdx], W_o_c, m_outGateDelta[seqIdx]);
 
 		// computations are independent but use the same m_derivBuf
 		// pre-gate state delta (Time t = seqIdx): m_preGateStateDelta[seqIdx]
-		tanh_deriv(m_derivBuf, m_preGateStates[seqIdx], m_numNeuron);
-		elem_mul_triple(m_preGateStateDelta[seqIdx], m_cellStateErrs[seqIdx], m_inGateActs[seqIdx], m_derivBuf, m_numNeuron);
+		tanh_deriv(m_derivBuf, m_preGateStates[seqIdx], batchNeuron);
+		elem_mul_triple(m_preGateStateDelta[seqIdx], m_cellStateErrs[seqIdx], m_inGateActs[seqIdx], m_derivBuf, batchNeuron);
 
 		// computations are independent but use the same m_derivBuf
 		// forget gates delta (Time t = seqIdx): m_forgetGateDelta[seqIdx]
-		sigm_deriv(m_derivBuf, m_forgetGateActs[seqIdx], m_numNeuron);
-		elem_mul_triple(m_forgetGateDelta[seqIdx], m_cellStateErrs[seqIdx], m_states[seqIdx-1], m_derivBuf, m_numNeuron);
+		sigm_deriv(m_derivBuf, m_forgetGateActs[seqIdx], batchNeuron);
+		elem_mul_triple(m_forgetGateDelta[seqIdx], m_cellStateErrs[seqIdx], m_states[seqIdx-1], m_derivBuf, batchNeuron);
 
 		// computations are independent but use the same m_derivBuf
 		// input gates delta (Time t = seqIdx): m_inGateDelta[seqIdx]
-		sigm_deriv(m_derivBuf, m_inGateActs[seqIdx], m_numNeuron);
-		elem_mul_triple(m_inGateDelta[seqIdx], m_cellStateErrs[seqIdx], m_preGateStates[seqIdx], m_derivBuf, m_numNeuron);
-
-		// computations are independent but write to the same memory
-		// spatial input error: m_inputErrs[seqIdx]
-		trans_dot(m_inputErrs[seqIdx], W_i_x, m_numNeuron, m_inputSize, m_inGateDelta[seqIdx], m_numNeuron, 1);
-		trans_dot(m_inputErrs[seqIdx], W_f_x, m_numNeuron, m_inputSize, m_forgetGateDelta[seqIdx], m_numNeuron, 1);
-		trans_dot(m_inputErrs[seqIdx], W_c_x, m_numNeuron, m_inputSize, m_preGateStateDelta[seqIdx], m_numNeuron, 1);
-		trans_dot(m_inputErrs[seqIdx], W_o_x, m_numNeuron, m_inputSize, m_outGateDelta[seqIdx], m_numNeuron, 1);
-
-		// grad
-		outer(gradW_i_x, m_inGateDelta[seqIdx], m_numNeuron, m_inputActs[seqIdx], m_inputSize);
-		outer(gradW_i_h, m_inGateDelta[seqIdx], m_numNeuron, m_outputActs[seqIdx-1], m_numNeuron);
-		elem_mul(gradW_i_c, m_inGateDelta[seqIdx], m_states[seqIdx-1], m_numNeuron);
-
-		outer(gradW_f_x, m_forgetGateDelta[seqIdx], m_numNeuron, m_inputActs[seqIdx], m_inputSize);
-		outer(gradW_f_h, m_forgetGateDelta[seqIdx], m_numNeuron, m_outputActs[seqIdx-1], m_numNeuron);
-		elem_mul(gradW_f_c, m_forgetGateDelta[seqIdx], m_states[seqIdx-1], m_numNeuron);
-
-		outer(gradW_c_x, m_preGateStateDelta[seqIdx], m_numNeuron, m_inputActs[seqIdx], m_inputSize);
-		outer(gradW_c_h, m_preGateStateDelta[seqIdx], m_numNeuron, m_outputActs[seqIdx-1], m_numNeuron);
-
-		outer(gradW_o_x, m_outGateDelta[seqIdx], m_numNeuron, m_inputActs[seqIdx], m_inputSize);
-		outer(gradW_o_h, m_outGateDelta[seqIdx], m_numNeuron, m_outputActs[seqIdx-1], m_numNeuron);
-		elem_mul(gradW_o_c, m_outGateDelta[seqIdx], m_states[seqIdx-1], m_numNeuron);
+		sigm_deriv(m_derivBuf, m_inGateActs[seqIdx], batchNeuron);
+		elem_mul_triple(m_inGateDelta[seqIdx], m_cellStateErrs[seqIdx], m_preGateStates[seqIdx], m_derivBuf, batchNeuron);
+
+	}
+
+	// the deltas of time steps 1..T are contiguous: spatial input error and every grad in one GEMM per block
+	dot(m_inputErrs[1], m_inGateDelta[1], batchSteps, m_numNeuron, W_i_x, m_numNeuron, m_inputSize);
+	dot(m_inputErrs[1], m_forgetGateDelta[1], batchSteps, m_numNeuron, W_f_x, m_numNeuron, m_inputSize);
+	dot(m_inputErrs[1], m_preGateStateDelta[1], batchSteps, m_numNeuron, W_c_x, m_numNeuron, m_inputSize);
+	dot(m_inputErrs[1], m_outGateDelta[1], batchSteps, m_numNeuron, W_o_x, m_numNeuron, m_inputSize);
+
+	trans_dot(gradW_i_x, m_inGateDelta[1], batchSteps, m_numNeuron, m_inputActs[1], batchSteps, m_inputSize);
+	trans_dot(gradW_f_x, m_forgetGateDelta[1], batchSteps, m_numNeuron, m_inputActs[1], batchSteps, m_inputSize);
+	trans_dot(gradW_c_x, m_preGateStateDelta[1], batchSteps, m_numNeuron, m_inputActs[1], batchSteps, m_inputSize);
+	trans_dot(gradW_o_x, m_outGateDelta[1], batchSteps, m_numNeuron, m_inputActs[1], batchSteps, m_inputSize);
+
+	// recurrent grads pair the deltas of 1..T with h of 0..T-1, the peepholes with c of 0..T-1
+	trans_dot(gradW_i_h, m_inGateDelta[1], batchSteps, m_numNeuron, m_outputActs[0], batchSteps, m_numNeuron);
+	trans_dot(gradW_f_h, m_forgetGateDelta[1], batchSteps, m_numNeuron, m_outputActs[0], batchSteps, m_numNeuron);
+	trans_dot(gradW_c_h, m_preGateStateDelta[1], batchSteps, m_numNeuron, m_outputActs[0], batchSteps, m_numNeuron);
+	trans_dot(gradW_o_h, m_outGateDelta[1], batchSteps, m_numNeuron, m_outputActs[0], batchSteps, m_numNeuron);
+
+	peepholeGrad(gradW_i_c, m_inGateDelta[1], m_states[0], batchSteps);
+	peepholeGrad(gradW_f_c, m_forgetGateDelta[1], m_states[0], batchSteps);
+	peepholeGrad(gradW_o_c, m_outGateDelta[1], m_states[0], batchSteps);
+}
+
+void LSTMLayer::feedForwardFused(int inputSeqLen) {
+	int gateSize = 4 * m_numNeuron;
+	int concatSize = m_inputSize + m_numNeuron;
+	int batchSteps = m_batchSize * inputSeqLen;
+
+	// input projections of all four gates over time steps 1..T: [T*batch x I] x W_gates[:, :I]^T
+	block_dot(m_gatePreActs[1], gateSize, m_inputActs[1], m_inputSize, false, W_gates, concatSize, true, batchSteps, gateSize, m_inputSize);
+
+	// for each time step from 1 to T
+	for (int seqIdx=1; seqIdx<=inputSeqLen; ++seqIdx) {
+		// recurrent part of all four gates: [batch x N] x W_gates[:, I:]^T
+		block_dot(m_gatePreActs[seqIdx], gateSize, m_outputActs[seqIdx-1], m_numNeuron, false, W_gates + m_inputSize, concatSize, true, 
+			m_batchSize, gateSize, m_numNeuron);
+
+		gateKernel(seqIdx);
+	}
+}
+
+void LSTMLayer::gateKernel(int seqIdx) {
+	// peepholes, nonlinearities, cell state and output row by row while the pre-activations are in cache
+	int numNeuron = m_numNeuron;
+	for (int rowIdx=0; rowIdx<m_batchSize; ++rowIdx) {
+		int offset = rowIdx * numNeuron;
+		float *preActs = m_gatePreActs[seqIdx] + 4 * offset;
+		float *prevStates = m_states[seqIdx-1] + offset;
+		float *states = m_states[seqIdx] + offset;
+
+		elem_mul(preActs, W_i_c, prevStates, numNeuron);
+		elem_mul(preActs + numNeuron, W_f_c, prevStates, numNeuron);
+		sigm(m_inGateActs[seqIdx] + offset, preActs, numNeuron);
+		sigm(m_forgetGateActs[seqIdx] + offset, preActs + numNeuron, numNeuron);
+		tanh(m_preGateStates[seqIdx] + offset, preActs + 2*numNeuron, numNeuron);
+
+		elem_mul(states, m_forgetGateActs[seqIdx] + offset, prevStates, numNeuron);
+		elem_mul(states, m_inGateActs[seqIdx] + offset, m_preGateStates[seqIdx] + offset, numNeuron);
+
+		elem_mul(preActs + 3*numNeuron, W_o_c, states, numNeuron);
+		sigm(m_outGateActs[seqIdx] + offset, preActs + 3*numNeuron, numNeuron);
+		tanh(m_preOutGateActs[seqIdx] + offset, states, numNeuron);
+		elem_mul(m_outputActs[seqIdx] + offset, m_outGateActs[seqIdx] + offset, m_preOutGateActs[seqIdx] + offset, numNeuron);
 	}
 }
 
+void LSTMLayer::deltaKernel(int seqIdx) {
+	// the four gate deltas of seqIdx in one pass, also packed as [batch x 4N] into m_gateDeltas
+	int numNeuron = m_numNeuron;
+	for (int rowIdx=0; rowIdx<m_batchSize; ++rowIdx) {
+		float *packed = m_gateDeltas[seqIdx] + rowIdx * 4 * numNeuron;
+		int offset = rowIdx * numNeuron;
+		for (int i=0; i<numNeuron; ++i) {
+			int idx = offset + i;
+			float outErr = m_outputErrs[seqIdx][idx];
+			float outGate = m_outGateActs[seqIdx][idx];
+			float preOutGate = m_preOutGateActs[seqIdx][idx];
+			float outDelta = outErr * outGate * (1 - outGate) * preOutGate;
+
+			float cellErr = outErr * outGate * (1 - preOutGate * preOutGate);
+			cellErr += m_cellStateErrs[seqIdx+1][idx] * m_forgetGateActs[seqIdx+1][idx];
+			cellErr += W_i_c[i] * m_inGateDelta[seqIdx+1][idx];
+			cellErr += W_f_c[i] * m_forgetGateDelta[seqIdx+1][idx];
+			cellErr += W_o_c[i] * outDelta;
+
+			float inGate = m_inGateActs[seqIdx][idx];
+			float forgetGate = m_forgetGateActs[seqIdx][idx];
+			float preGateState = m_preGateStates[seqIdx][idx];
+			float preGateDelta = cellErr * inGate * (1 - preGateState * preGateState);
+			float forgetDelta = cellErr * m_states[seqIdx-1][idx] * forgetGate * (1 - forgetGate);
+			float inDelta = cellErr * preGateState * inGate * (1 - inGate);
+
+			m_outGateDelta[seqIdx][idx] = outDelta;
+			m_cellStateErrs[seqIdx][idx] = cellErr;
+			m_preGateStateDelta[seqIdx][idx] = preGateDelta;
+			m_forgetGateDelta[seqIdx][idx] = forgetDelta;
+			m_inGateDelta[seqIdx][idx] = inDelta;
+
+			packed[i] = inDelta;
+			packed[numNeuron+i] = forgetDelta;
+			packed[2*numNeuron+i] = preGateDelta;
+			packed[3*numNeuron+i] = outDelta;
+		}
+	}
+}
+
+void LSTMLayer::feedBackwardFused(int inputSeqLen) {
+	int gateSize = 4 * m_numNeuron;
+	int concatSize = m_inputSize + m_numNeuron;
+	int batchSteps = m_batchSize * inputSeqLen;
+	float *W_gates_h = W_gates + m_inputSize;
+	float *gradW_gates_h = gradW_gates + m_inputSize;
+
+	// deltas at Time t=T+1 are zero unless a decoder handed them over, then they give the recurrent error of h_T
+	float *nextDeltas[4] = {m_inGateDelta[inputSeqLen+1], m_forgetGateDelta[inputSeqLen+1], 
+		m_preGateStateDelta[inputSeqLen+1], m_outGateDelta[inputSeqLen+1]};
+	float *packed = m_gateDeltas[inputSeqLen+1];
+	bool handedOver = false;
+	for (int rowIdx=0; rowIdx<m_batchSize; ++rowIdx) {
+		for (int gateIdx=0; gateIdx<4; ++gateIdx) {
+			float *delta = nextDeltas[gateIdx] + rowIdx*m_numNeuron;
+			memcpy(packed + rowIdx*gateSize + gateIdx*m_numNeuron, delta, sizeof(float) * m_numNeuron);
+			for (int i=0; i<m_numNeuron && !handedOver; ++i) {
+				handedOver = (delta[i] != 0.f);
+			}
+		}
+	}
+	if (handedOver) {
+		block_dot(m_outputErrs[inputSeqLen], m_numNeuron, packed, gateSize, false, W_gates_h, concatSize, false, 
+			m_batchSize, m_numNeuron, gateSize);
+	}
+
+	// sequential for each time step from T to 1, m_outputErrs[seqIdx] is complete on entry
+	for (int seqIdx=inputSeqLen; seqIdx>0; --seqIdx) {
+		deltaKernel(seqIdx);
+
+		// recurrent error of h_t-1: [batch x 4N] x W_gates[:, I:]
+		block_dot(m_outputErrs[seqIdx-1], m_numNeuron, m_gateDeltas[seqIdx], gateSize, false, W_gates_h, concatSize, false, 
+			m_batchSize, m_numNeuron, gateSize);
+
+	}
+
+	// the packed deltas of time steps 1..T are contiguous: spatial input error and every grad in one GEMM each
+	block_dot(m_inputErrs[1], m_inputSize, m_gateDeltas[1], gateSize, false, W_gates, concatSize, false, 
+		batchSteps, m_inputSize, gateSize);
+	block_dot(gradW_gates, concatSize, m_gateDeltas[1], gateSize, true, m_inputActs[1], m_inputSize, false, 
+		gateSize, m_inputSize, batchSteps);
+
+	// recurrent grad pairs the deltas of 1..T with h of 0..T-1: [4N x T*batch] x [T*batch x N], then the peepholes
+	block_dot(gradW_gates_h, concatSize, m_gateDeltas[1], gateSize, true, m_outputActs[0], m_numNeuron, false, 
+		gateSize, m_numNeuron, batchSteps);
+	peepholeGrad(gradW_i_c, m_inGateDelta[1], m_states[0], batchSteps);
+	peepholeGrad(gradW_f_c, m_forgetGateDelta[1], m_states[0], batchSteps);
+	peepholeGrad(gradW_o_c, m_outGateDelta[1], m_states[0], batchSteps);
+}
+
 void LSTMLayer::bindWeights(float *params, float *grad) {
+	if (m_fusedGates) {
+		long gateParamSize = 4L * m_numNeuron * (m_inputSize + m_numNeuron);
+		W_gates = params;							// [4 * m_numNeuron x (m_inputSize + m_numNeuron)]
+		W_i_c = params + gateParamSize;				// [m_numNeuron x 1] each
+		W_f_c = W_i_c + m_numNeuron;
+		W_o_c = W_f_c + m_numNeuron;
+
+		gradW_gates = grad;
+		gradW_i_c = grad + gateParamSize;
+		gradW_f_c = gradW_i_c + m_numNeuron;
+		gradW_o_c = gradW_f_c + m_numNeuron;
+		return;
+	}
+
 	// weights
 	float *paramCursor = params;
 	
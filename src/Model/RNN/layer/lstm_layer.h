@@ -8,10 +8,12 @@ using namespace std;
 class LSTMLayer: public RecurrentLayer
 {
 public:
-	LSTMLayer(int numNeuron, int maxSeqLen, int inputSize);
+	LSTMLayer(int numNeuron, int maxSeqLen, int inputSize, int batchSize, bool fusedGates = false);
 	~LSTMLayer();
 
 	/* data */	
+	// fused layout: W_gates stacks the i, f, c, o rows over the [x | h] columns, the peepholes follow
+	bool m_fusedGates;
 
 	// weight matrices
 	float *W_i_x;
@@ -25,6 +27,7 @@ public:
 	float *W_o_x;
 	float *W_o_h;
 	float *W_o_c;
+	float *W_gates;		// [4 * m_numNeuron x (m_inputSize + m_numNeuron)]
 
 	// grad matrices
 	float *gradW_i_x;
@@ -38,6 +41,7 @@ public:
 	float *gradW_o_x;
 	float *gradW_o_h;
 	float *gradW_o_c;
+	float *gradW_gates;
 
 	// forward pass
 	vector<float *> m_inGateActs;
@@ -62,21 +66,30 @@ public:
 
 	float *m_derivBuf;
 
+	// fused layout only: [batch x 4N] gate pre-activations and packed gate deltas of every step
+	vector<float *> m_gatePreActs;
+	vector<float *> m_gateDeltas;
+
 	/* method */
 	void initParams(float *params);
 
 	void feedForward(int inputSeqLen);
 	void feedBackward(int inputSeqLen);
-	void resetStates(int inputSeqLen);
 
-	void reshape(int newSeqLen);
+	long stepSize();
 	void bindWeights(float *params, float *grad);
 
 private:
 	/* method */
-	void resize (int newSeqLen);
-	void releaseMem (int seqIdx);
-	void allocateMem (int seqIdx);	
+	void peephole (float *result, float *weights, float *acts);
+	void peepholeGrad (float *grad, float *delta, float *acts, int numRows);
+
+	void feedForwardFused (int inputSeqLen);
+	void feedBackwardFused (int inputSeqLen);
+	void gateKernel (int seqIdx);
+	void deltaKernel (int seqIdx);
+
+	void allocateMem ();	
 };
 
 #endif
\ No newline at end of file
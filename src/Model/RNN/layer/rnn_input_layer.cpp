@@ -4,7 +4,7 @@ using namespace std;
 
 void RNN_InputLayer::feedForward(int inputSeqLen) {		
 	for (int seqIdx=1; seqIdx<=inputSeqLen; ++seqIdx) {		
-		memcpy(m_outputActs[seqIdx], m_inputActs[seqIdx], sizeof(float) * m_numNeuron);
+		memcpy(m_outputActs[seqIdx], m_inputActs[seqIdx], sizeof(float) * m_batchSize * m_numNeuron);
 	}	
 }
 
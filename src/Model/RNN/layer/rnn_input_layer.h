@@ -9,7 +9,7 @@
 class RNN_InputLayer : public RecurrentLayer
 {
 public:
-	RNN_InputLayer(int numNeuron, int maxSeqLen) : RecurrentLayer(numNeuron, maxSeqLen, numNeuron) {};
+	RNN_InputLayer(int numNeuron, int maxSeqLen, int batchSize) : RecurrentLayer(numNeuron, maxSeqLen, numNeuron, batchSize) {};
 	~RNN_InputLayer() {};
 
 	/* data */
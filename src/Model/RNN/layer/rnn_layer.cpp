@@ -2,85 +2,98 @@
 
 using namespace std;
 
-RecurrentLayer::RecurrentLayer (int numNeuron, int maxSeqLen, int inputSize) {	
+RecurrentLayer::RecurrentLayer (int numNeuron, int maxSeqLen, int inputSize, int batchSize) {	
 	m_numNeuron = numNeuron;
 	m_maxSeqLen = maxSeqLen;
 	m_inputSize = inputSize;
+	m_batchSize = batchSize;
 
-	// resize all vectors
-	resize(m_maxSeqLen);
+	m_arena = NULL;
+	m_arenaCapacity = 0;
+	m_arenaUsed = 0;
 
 	// allocate memory for sequence of length T+2 (t=0 & t=T+1 are extra space for neat code)
-	for (int seqIdx=0; seqIdx<m_maxSeqLen+2; ++seqIdx) {
-		allocateMem(seqIdx);
-	}
+	allocateMem();
 
 	m_nParamSize = 0;
 }
 
 RecurrentLayer::~RecurrentLayer () {
-	// release memory for sequence of length T+2 (t=0 & t=T+1 are extra space for neat code)
-	for (int seqIdx=0; seqIdx<m_maxSeqLen+2; ++seqIdx) {
-		releaseMem(seqIdx);
-	}
+	if (m_arena != NULL) {free(m_arena);}
 }
 
 void RecurrentLayer::resetStates(int inputSeqLen) {
-	for (int seqIdx=0; seqIdx<inputSeqLen+2; ++seqIdx) {
-		memset(m_inputActs[seqIdx], 0x00, sizeof(float)*m_inputSize);
-		memset(m_inputErrs[seqIdx], 0x00, sizeof(float)*m_inputSize);
+	/* all states and activations are initialised to zero at t = 0 */
+	/* all delta and error terms are zero at t = T + 1 */
 
-		memset(m_outputActs[seqIdx], 0x00, sizeof(float)*m_numNeuron);
-		memset(m_outputErrs[seqIdx], 0x00, sizeof(float)*m_numNeuron);
+	if (inputSeqLen == m_maxSeqLen) {
+		// every quantity of the arena, used steps only
+		memset(m_arena, 0x00, sizeof(float) * m_arenaUsed);
+		return;
+	}
+	// shorter sequences: the first T+2 steps of each quantity
+	for (int quantIdx=0; quantIdx<(int) m_arenaSteps.size(); ++quantIdx) {
+		memset((*m_arenaSteps[quantIdx])[0], 0x00, sizeof(float) * (inputSeqLen+2) * m_arenaStepSizes[quantIdx]);
 	}
 }
 
-void RecurrentLayer::resize (int newSeqLen) {
-	m_inputActs.resize(newSeqLen+2);
-	m_outputActs.resize(newSeqLen+2);
+long RecurrentLayer::stepSize () {
+	return (long) m_batchSize * (2 * m_inputSize + 2 * m_numNeuron);
+}
 
-	m_inputErrs.resize(newSeqLen+2);
-	m_outputErrs.resize(newSeqLen+2);
+void RecurrentLayer::allocateSteps (vector<float *> &steps, int stepSize) {
+	// takes effect with the next layoutArena
+	m_arenaSteps.push_back(&steps);
+	m_arenaStepSizes.push_back(stepSize);
 }
 
-void RecurrentLayer::allocateMem (int seqIdx) {
-	// m_inputActs and m_inputErrs
-	m_inputActs[seqIdx] = new float [m_inputSize];
-	m_inputErrs[seqIdx] = new float [m_inputSize];
+void RecurrentLayer::layoutArena () {
+	// struct of arrays: one 64-byte aligned block per quantity, time steps 0..T+1 back to back,
+	// so rows 1..T of a quantity form one [T*m_batchSize x size] matrix for whole-sequence GEMMs
+	const long align = ARENA_ALIGN / sizeof(float);
+	long used = 0;
+	for (int quantIdx=0; quantIdx<(int) m_arenaSteps.size(); ++quantIdx) {
+		used += ((m_maxSeqLen+2) * m_arenaStepSizes[quantIdx] + align - 1) / align * align;
+	}
 
-	// m_outputActs and m_outputErrs
-	m_outputActs[seqIdx] = new float [m_numNeuron];
-	m_outputErrs[seqIdx] = new float [m_numNeuron];
+	// grow geometrically, reshape to a shorter (or a slightly longer) length keeps the arena
+	if (used > m_arenaCapacity) {
+		long capacity = max(used, 2 * m_arenaCapacity);
+		if (m_arena != NULL) {free(m_arena);}
+		if (posix_memalign((void **) &m_arena, ARENA_ALIGN, sizeof(float) * capacity) != 0) {
+			printf("Error recurrent layer: cannot allocate %ld MB of time step buffers.\n", (long) (sizeof(float) * capacity >> 20));
+			exit(-1);
+		}
+		m_arenaCapacity = capacity;
+	}
+	m_arenaUsed = used;
+
+	float *block = m_arena;
+	for (int quantIdx=0; quantIdx<(int) m_arenaSteps.size(); ++quantIdx) {
+		vector<float *> &steps = *m_arenaSteps[quantIdx];
+		long stepSize = m_arenaStepSizes[quantIdx];
+		steps.resize(m_maxSeqLen+2);
+		for (int seqIdx=0; seqIdx<m_maxSeqLen+2; ++seqIdx) {
+			steps[seqIdx] = block + seqIdx * stepSize;
+		}
+		block += ((m_maxSeqLen+2) * stepSize + align - 1) / align * align;
+	}
 }
 
-void RecurrentLayer::releaseMem (int seqIdx) {
+void RecurrentLayer::allocateMem () {
 	// m_inputActs and m_inputErrs
-	if (m_inputActs[seqIdx] != NULL) {delete [] m_inputActs[seqIdx];}
-	if (m_inputErrs[seqIdx] != NULL) {delete [] m_inputErrs[seqIdx];}
+	allocateSteps(m_inputActs, m_batchSize * m_inputSize);
+	allocateSteps(m_inputErrs, m_batchSize * m_inputSize);
 
 	// m_outputActs and m_outputErrs
-	if (m_outputActs[seqIdx] != NULL) {delete [] m_outputActs[seqIdx];}
-	if (m_outputErrs[seqIdx] != NULL) {delete [] m_outputErrs[seqIdx];}
+	allocateSteps(m_outputActs, m_batchSize * m_numNeuron);
+	allocateSteps(m_outputErrs, m_batchSize * m_numNeuron);
+
+	layoutArena();
 }
 
 void RecurrentLayer::reshape(int newSeqLen) {
-	// release mem if needed
-	if (newSeqLen < m_maxSeqLen) {
-		for (int seqIdx=newSeqLen+2; seqIdx<m_maxSeqLen+2; ++seqIdx) {
-			releaseMem(seqIdx);
-		}
-	}	
-	
-	// resize all vectors
-	resize(newSeqLen);	
-
-	// allocate new mem if needed
-	if (newSeqLen > m_maxSeqLen) {
-		for (int seqIdx=m_maxSeqLen+2; seqIdx<newSeqLen+2; ++seqIdx) {
-			allocateMem(seqIdx);
-		}
-	}
-
-	// change parameter
+	// states are reset before every use, nothing to carry over
 	m_maxSeqLen = newSeqLen;
-}
\ No newline at end of file
+	layoutArena();
+}
@@ -10,22 +10,26 @@
 
 using namespace std;
 
+#define ARENA_ALIGN 64
+
 /****************************************************************
 * Recurrent Layer
 ****************************************************************/
 class RecurrentLayer
 {
 public:
-	RecurrentLayer(int numNeuron, int maxSeqLen, int inputSize);
+	RecurrentLayer(int numNeuron, int maxSeqLen, int inputSize, int batchSize);
 	virtual ~RecurrentLayer();
 
 	/* data */
 	int m_numNeuron;
 	int m_inputSize;
 	int m_maxSeqLen;
+	int m_batchSize;
 
 	int m_nParamSize;
 
+	// one [m_batchSize x size] row-major matrix per time step, row b is sequence b of the minibatch
 	vector<float *> m_inputActs;
 	vector<float *> m_outputActs;
 
@@ -45,11 +49,22 @@ public:
 
 	void virtual resetStates(int inputSeqLen);
 	void virtual reshape(int newSeqLen);	
+	long virtual stepSize();	// floats the buffers hold per time step
+
+protected:
+	// registers a quantity of the arena, layoutArena places it and sets the step pointers
+	void allocateSteps (vector<float *> &steps, int stepSize);
+	void layoutArena ();
 
 private:
-	void resize (int newSeqLen);
-	void releaseMem (int seqIdx);
-	void allocateMem (int seqIdx);
+	// every time step buffer of the layer lives in one aligned arena
+	float *m_arena;
+	long m_arenaCapacity;	// floats allocated
+	long m_arenaUsed;		// floats the current m_maxSeqLen lays out
+	vector<vector<float *> *> m_arenaSteps;
+	vector<long> m_arenaStepSizes;
+
+	void allocateMem ();
 };
 
 #endif
\ No newline at end of file
@@ -8,7 +8,7 @@ using namespace std;
 class RNN_MSELayer: public RecurrentLayer
 {
 public:
-	RNN_MSELayer(int numNeuron, int maxSeqLen) : RecurrentLayer(numNeuron, maxSeqLen, numNeuron){};
+	RNN_MSELayer(int numNeuron, int maxSeqLen, int batchSize) : RecurrentLayer(numNeuron, maxSeqLen, numNeuron, batchSize){};
 	~RNN_MSELayer() {};
 
 	/* data */
@@ -2,12 +2,15 @@
 
 void RNN_SoftmaxLayer::feedForward(int inputSeqLen) {
 	for (int seqIdx=1; seqIdx<=inputSeqLen; ++seqIdx) {
-		softmax(m_outputActs[seqIdx], m_inputActs[seqIdx], m_numNeuron);		
+		// normalized per sequence
+		for (int rowIdx=0; rowIdx<m_batchSize; ++rowIdx) {
+			softmax(m_outputActs[seqIdx] + rowIdx*m_numNeuron, m_inputActs[seqIdx] + rowIdx*m_numNeuron, m_numNeuron);
+		}
 	}	
 }
 
 void RNN_SoftmaxLayer::feedBackward(int inputSeqLen) {	
 	for (int seqIdx=1; seqIdx<=inputSeqLen; ++seqIdx) {		
-		elem_sub(m_inputErrs[seqIdx], m_outputActs[seqIdx], m_outputErrs[seqIdx], m_numNeuron);
+		elem_sub(m_inputErrs[seqIdx], m_outputActs[seqIdx], m_outputErrs[seqIdx], m_batchSize * m_numNeuron);
 	}
 }
\ No newline at end of file
@@ -8,7 +8,7 @@ using namespace std;
 class RNN_SoftmaxLayer: public RecurrentLayer
 {
 public:
-	RNN_SoftmaxLayer(int numNeuron, int maxSeqLen) : RecurrentLayer(numNeuron, maxSeqLen, numNeuron){};
+	RNN_SoftmaxLayer(int numNeuron, int maxSeqLen, int batchSize) : RecurrentLayer(numNeuron, maxSeqLen, numNeuron, batchSize){};
 	~RNN_SoftmaxLayer() {};
 
 	/* data */
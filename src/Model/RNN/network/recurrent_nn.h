@@ -40,6 +40,8 @@ public:
 	/* method */
 	float virtual computeGrad (float *grad, float *params, float *data, float *label) {return 0.f;};
 	void virtual initParams (float *params) {};
+	// the rnn models were tuned with their grads bounded
+	float virtual defaultClipNorm () {return 5.f;};
 };
 
 #endif
\ No newline at end of file
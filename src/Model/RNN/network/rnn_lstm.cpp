@@ -1,4 +1,5 @@
 #include <sstream> 
+#include <algorithm>
 #include "rnn_lstm.h"
 
 using namespace std;
@@ -13,6 +14,29 @@ RNN_LSTM::RNN_LSTM(ConfReader *confReader, int minibatchSize, string prefix) {
 	
 	m_inputSize = confReader->getInt(prefix+"input_size");
 	m_outputSize = confReader->getInt(prefix+"output_size");
+	m_fusedGates = (confReader->getInt("lstm_fused_gates") != 0);
+	m_tbpttK1 = confReader->getInt("tbptt_k1");
+	m_tbpttK2 = confReader->getInt("tbptt_k2");
+	if (m_tbpttK1 < 0 || (m_tbpttK1 > 0 && m_tbpttK2 < m_tbpttK1)) {
+		printf("Error tbptt_k1 / tbptt_k2: %d, %d.\n", m_tbpttK1, m_tbpttK2);
+		exit(-1);
+	}
+	m_ckptLen = 0;
+	if (confReader->getInt("lstm_checkpointing") != 0) {
+		if (m_tbpttK1 > 0) {
+			printf("Error: lstm_checkpointing and truncated BPTT are exclusive.\n");
+			exit(-1);
+		}
+		m_ckptLen = (int) ceil(sqrt((float) m_maxSeqLen));
+	}
+	// a window never spans more than k2 steps
+	if (m_tbpttK1 > 0) {
+		m_bufferLen = min(m_tbpttK2, m_maxSeqLen);
+	} else if (m_ckptLen > 0) {
+		m_bufferLen = m_ckptLen;
+	} else {
+		m_bufferLen = m_maxSeqLen;
+	}
 
 	// allocate memory
 	m_numNeuronList = new int[m_numLayer];
@@ -50,6 +74,64 @@ RNN_LSTM::RNN_LSTM(ConfReader *confReader, int minibatchSize, string prefix) {
 		m_nParamSize += conn->m_nParamSize;
 		m_vecConnections.push_back(conn);
 	}
+
+	// grad segments follow the bindWeights layout: layers, then connections
+	long offset = 0;
+	for (int layerIdx=0; layerIdx<m_numLayer; layerIdx++) {
+		int size = m_vecLayers[layerIdx]->m_nParamSize;
+		m_layerSegIdx.push_back(size > 0 ? addSegment(offset, size) : -1);
+		offset += size;
+	}
+	for (int connIdx=0; connIdx<m_numLayer-1; connIdx++) {
+		int size = m_vecConnections[connIdx]->m_nParamSize;
+		m_connSegIdx.push_back(size > 0 ? addSegment(offset, size) : -1);
+		offset += size;
+	}
+	// the forward pass alternates layers and connections from the input up
+	for (int layerIdx=0; layerIdx<m_numLayer; layerIdx++) {
+		if (m_layerSegIdx[layerIdx] >= 0) {
+			m_segForward.push_back(m_layerSegIdx[layerIdx]);
+		}
+		if (layerIdx < m_numLayer-1 && m_connSegIdx[layerIdx] >= 0) {
+			m_segForward.push_back(m_connSegIdx[layerIdx]);
+		}
+	}
+	m_gradBase = NULL;
+	m_seqLen = NULL;
+	m_finalPass = true;
+
+	// slot w holds the start of window w when checkpointing, slot 0 the carry of truncated BPTT
+	int numSlots = (m_ckptLen > 0) ? (m_maxSeqLen + m_ckptLen - 1) / m_ckptLen : 1;
+	m_slotStates.resize(numSlots);
+	m_slotOutputs.resize(numSlots);
+	for (int layerIdx=0; layerIdx<m_numLayer; layerIdx++) {
+		LSTMLayer *layer = dynamic_cast<LSTMLayer*>(m_vecLayers[layerIdx]);
+		int batchNeuron = m_nMinibatchSize * m_numNeuronList[layerIdx];
+		for (int slot=0; slot<numSlots; ++slot) {
+			m_slotStates[slot].push_back(layer != NULL ? new float[batchNeuron] : NULL);
+			m_slotOutputs[slot].push_back(layer != NULL ? new float[batchNeuron] : NULL);
+		}
+		m_handoverErrs.push_back(layer != NULL && m_ckptLen > 0 ? new float[6 * batchNeuron] : NULL);
+	}
+
+	if (m_ckptLen > 0) {
+		// step buffers of all layers for a window instead of the whole sequence, plus the checkpoints
+		long fullBytes = 0;
+		long windowBytes = 0;
+		long slotBytes = 0;
+		for (int layerIdx=0; layerIdx<m_numLayer; layerIdx++) {
+			fullBytes += sizeof(float) * m_vecLayers[layerIdx]->stepSize() * (m_maxSeqLen + 2);
+			windowBytes += sizeof(float) * m_vecLayers[layerIdx]->stepSize() * (m_bufferLen + 2);
+			if (m_handoverErrs[layerIdx] != NULL) {
+				slotBytes += sizeof(float) * m_nMinibatchSize * m_numNeuronList[layerIdx] * (2 * numSlots + 6);
+			}
+		}
+		int recomputed = m_maxSeqLen - ((m_maxSeqLen - 1) % m_ckptLen + 1);
+		string name = prefix.empty() ? "RNN_LSTM" : prefix.substr(0, prefix.length()-1);
+		printf("Slave Model: %s checkpoints every %d steps: step buffers %.2f MB + checkpoints %.2f MB instead of %.2f MB, "
+			"backward runs %d of %d steps forward again\n", name.c_str(), m_ckptLen, windowBytes / 1048576.0, 
+			slotBytes / 1048576.0, fullBytes / 1048576.0, recomputed, m_maxSeqLen);
+	}
 }
 
 RNN_LSTM::~RNN_LSTM() {
@@ -64,6 +146,16 @@ RNN_LSTM::~RNN_LSTM() {
 	for (int connIdx=0; connIdx<m_numLayer-1; ++connIdx) {
 		if (m_vecConnections[connIdx] != NULL) {delete m_vecConnections[connIdx];}
 	}
+
+	for (int slot=0; slot<(int) m_slotStates.size(); ++slot) {
+		for (int layerIdx=0; layerIdx<m_numLayer; ++layerIdx) {
+			if (m_slotStates[slot][layerIdx] != NULL) {delete [] m_slotStates[slot][layerIdx];}
+			if (m_slotOutputs[slot][layerIdx] != NULL) {delete [] m_slotOutputs[slot][layerIdx];}
+		}
+	}
+	for (int layerIdx=0; layerIdx<m_numLayer; ++layerIdx) {
+		if (m_handoverErrs[layerIdx] != NULL) {delete [] m_handoverErrs[layerIdx];}
+	}
 }
 
 RNNConnection *RNN_LSTM::initConnection(int connIdx) {
@@ -87,7 +179,7 @@ RecurrentLayer *RNN_LSTM::initLayer(int layerIdx) {
 	int numNeuron = m_numNeuronList[layerIdx];
 	RecurrentLayer *layer;
 	if (layerType == "input_layer") {
-		layer = new RNN_InputLayer(numNeuron, m_maxSeqLen);
+		layer = new RNN_InputLayer(numNeuron, m_bufferLen, m_nMinibatchSize);
 	} else if (layerType == "lstm_layer") {
 		int inputSize;
 		if (layerIdx == 0) {
@@ -95,13 +187,13 @@ RecurrentLayer *RNN_LSTM::initLayer(int layerIdx) {
 		} else {
 			inputSize = m_numNeuronList[layerIdx-1];
 		}
-		layer = new LSTMLayer(numNeuron, m_maxSeqLen, inputSize);
+		layer = new LSTMLayer(numNeuron, m_bufferLen, inputSize, m_nMinibatchSize, m_fusedGates);
 	} else if (layerType == "softmax_layer") {
 		m_taskType = "classification";
-		layer = new RNN_SoftmaxLayer(numNeuron, m_maxSeqLen);
+		layer = new RNN_SoftmaxLayer(numNeuron, m_bufferLen, m_nMinibatchSize);
 	} else if (layerType == "mse_layer") {
 		m_taskType = "regression";
-		layer = new RNN_MSELayer(numNeuron, m_maxSeqLen);
+		layer = new RNN_MSELayer(numNeuron, m_bufferLen, m_nMinibatchSize);
 	} else {		
 		exit(-1);
 	}
@@ -124,38 +216,193 @@ void RNN_LSTM::initParams(float *params) {
 
 void RNN_LSTM::feedForward(int inputSeqLen) {
 	/* feed forward through connections and layers */
+	requireSegment(m_layerSegIdx[0]);
 	m_vecLayers[0]->feedForward(inputSeqLen);
 	for (int connIdx=0; connIdx<m_numLayer-1; ++connIdx) {
+		requireSegment(m_connSegIdx[connIdx]);
 		m_vecConnections[connIdx]->feedForward(inputSeqLen);
+		requireSegment(m_layerSegIdx[connIdx+1]);
 		m_vecLayers[connIdx+1]->feedForward(inputSeqLen);
 	}
 }
 
+void RNN_LSTM::requireSegment(int segIdx) {
+	// params of the block may still be arriving
+	if (segIdx >= 0) {
+		awaitSegment(segIdx);
+	}
+}
+
 void RNN_LSTM::feedBackward(int inputSeqLen) {
 	/* feed backward through connections and layers */
 	m_vecLayers[m_numLayer-1]->feedBackward(inputSeqLen);
+	finishSegment(m_layerSegIdx[m_numLayer-1]);
 	for (int connIdx=m_numLayer-2; connIdx>=0; --connIdx) {
 		m_vecConnections[connIdx]->feedBackward(inputSeqLen);
+		finishSegment(m_connSegIdx[connIdx]);
 		m_vecLayers[connIdx]->feedBackward(inputSeqLen);
+		finishSegment(m_layerSegIdx[connIdx]);
 	}
 }
 
-float RNN_LSTM::computeError(float *sampleTarget, int inputSeqLen) {
-	float sampleError = 0.f;
-	float *targetCursor = sampleTarget;
+void RNN_LSTM::finishSegment(int segIdx) {
+	if (segIdx < 0 || !m_finalPass) {
+		return;
+	}
+	// normalization by number of input sequences, the master's solver clips by the summed |grad|^2
+	float normFactor = 1.f / (float) m_nMinibatchSize;
+	m_gradSqNorm += elem_scale_sqnorm(m_gradBase + m_segOffset[segIdx], normFactor, m_segSize[segIdx]);
+	publishSegment(segIdx);
+}
+
+void RNN_LSTM::setSeqLengths(int *inputLen, int *outputLen) {
+	// one output per input step
+	m_seqLen = inputLen;
+}
+
+int RNN_LSTM::batchSeqLen() {
+	// the minibatch runs as many steps as its longest sequence
+	if (m_seqLen == NULL) {
+		return m_maxSeqLen;
+	}
+	int maxLen = 0;
+	for (int dataIdx=0; dataIdx<m_nMinibatchSize; ++dataIdx) {
+		maxLen = max(maxLen, m_seqLen[dataIdx]);
+	}
+	return maxLen;
+}
+
+bool RNN_LSTM::zeroPrefixExact() {
+	// bias-free LSTM layers joined by lstm_connection stay at the zero state through zero inputs
+	for (int layerIdx=0; layerIdx<m_numLayer; ++layerIdx) {
+		if (m_layerTypeList[layerIdx] != "lstm_layer" && m_layerTypeList[layerIdx] != "input_layer") {
+			return false;
+		}
+	}
+	for (int connIdx=0; connIdx<m_numLayer-1; ++connIdx) {
+		if (m_connTypeList[connIdx] != "lstm_connection") {
+			return false;
+		}
+	}
+	return true;
+}
+
+float RNN_LSTM::computeError(float *target, int inputSeqLen, int stepOffset, int countedSteps) {
+	// step seqIdx of the buffers is step stepOffset+seqIdx of the sequences, those up to countedSteps are done
+	float error = 0.f;
 	RecurrentLayer *curLayer = m_vecLayers[m_numLayer-1];
-	for (int seqIdx=1; seqIdx<=inputSeqLen; ++seqIdx) {
-		for (int i=0; i<m_outputSize; ++i) {
-			if (m_taskType == "classification") {
-				sampleError += targetCursor[i] * log(curLayer->m_outputActs[seqIdx][i]);
-			} else if (m_taskType == "regression") {
-				float diff = targetCursor[i] - curLayer->m_outputActs[seqIdx][i];
-				sampleError += diff * diff;
+	// targets are stored sequence after sequence, sequence dataIdx is row dataIdx of the output layer
+	for (int dataIdx=0; dataIdx<m_nMinibatchSize; ++dataIdx) {
+		float *targetCursor = target + dataIdx * m_maxSeqLen * m_outputSize;
+		int lastIdx = min(seqLen(dataIdx) - stepOffset, inputSeqLen);
+		for (int seqIdx=max(1, countedSteps-stepOffset+1); seqIdx<=lastIdx; ++seqIdx) {
+			float *outputActs = curLayer->m_outputActs[seqIdx] + dataIdx*m_outputSize;
+			float *stepTarget = targetCursor + (stepOffset+seqIdx-1) * m_outputSize;
+			for (int i=0; i<m_outputSize; ++i) {
+				if (m_taskType == "classification") {
+					error += stepTarget[i] * log(outputActs[i]);
+				} else if (m_taskType == "regression") {
+					float diff = stepTarget[i] - outputActs[i];
+					error += diff * diff;
+				}
 			}
 		}
-		targetCursor += m_outputSize;
 	}
-	return sampleError;
+	return error;
+}
+
+void RNN_LSTM::bindTargets(float *target, int inputSeqLen, int stepOffset, int countedSteps) {
+	// target sequence dataIdx to row dataIdx of m_outputErrs of the output layer, steps as in computeError
+	RecurrentLayer *outputLayer = m_vecLayers[m_numLayer-1];
+	for (int dataIdx=0; dataIdx<m_nMinibatchSize; ++dataIdx) {
+		float *targetCursor = target + dataIdx * m_maxSeqLen * m_outputSize;
+		int len = seqLen(dataIdx);
+		for (int seqIdx=1; seqIdx<=inputSeqLen; ++seqIdx) {
+			int step = stepOffset + seqIdx;
+			float *outputErrs = outputLayer->m_outputErrs[seqIdx] + dataIdx*m_outputSize;
+			if (step > countedSteps && step <= len) {
+				memcpy(outputErrs, targetCursor + (step-1) * m_outputSize, sizeof(float)*m_outputSize);
+			} else {
+				// past the end or already counted the target is the output itself: zero error, nothing flows back
+				memcpy(outputErrs, outputLayer->m_outputActs[seqIdx] + dataIdx*m_outputSize, sizeof(float)*m_outputSize);
+			}
+		}
+	}
+}
+
+void RNN_LSTM::saveStates(int slot, int seqIdx) {
+	// h and c at step seqIdx of the current window
+	for (int layerIdx=0; layerIdx<m_numLayer; ++layerIdx) {
+		LSTMLayer *layer = dynamic_cast<LSTMLayer*>(m_vecLayers[layerIdx]);
+		if (layer != NULL) {
+			int batchNeuron = m_nMinibatchSize * layer->m_numNeuron;
+			memcpy(m_slotStates[slot][layerIdx], layer->m_states[seqIdx], sizeof(float) * batchNeuron);
+			memcpy(m_slotOutputs[slot][layerIdx], layer->m_outputActs[seqIdx], sizeof(float) * batchNeuron);
+		}
+	}
+}
+
+void RNN_LSTM::startWindow(int slot, int windowLen) {
+	// reset the buffers for windowLen steps, h and c at step 0 from the slot, -1: zero states
+	resetStates(windowLen);
+	if (slot < 0) {
+		return;
+	}
+	for (int layerIdx=0; layerIdx<m_numLayer; ++layerIdx) {
+		LSTMLayer *layer = dynamic_cast<LSTMLayer*>(m_vecLayers[layerIdx]);
+		if (layer != NULL) {
+			int batchNeuron = m_nMinibatchSize * layer->m_numNeuron;
+			memcpy(layer->m_states[0], m_slotStates[slot][layerIdx], sizeof(float) * batchNeuron);
+			memcpy(layer->m_outputActs[0], m_slotOutputs[slot][layerIdx], sizeof(float) * batchNeuron);
+		}
+	}
+}
+
+void RNN_LSTM::saveHandover() {
+	// what the backward pass of the window before needs from step 1 of this one
+	for (int layerIdx=0; layerIdx<m_numLayer; ++layerIdx) {
+		LSTMLayer *layer = dynamic_cast<LSTMLayer*>(m_vecLayers[layerIdx]);
+		if (layer != NULL) {
+			int batchNeuron = m_nMinibatchSize * layer->m_numNeuron;
+			float *cursor = m_handoverErrs[layerIdx];
+			memcpy(cursor + 0 * batchNeuron, layer->m_cellStateErrs[1], sizeof(float) * batchNeuron);
+			memcpy(cursor + 1 * batchNeuron, layer->m_inGateDelta[1], sizeof(float) * batchNeuron);
+			memcpy(cursor + 2 * batchNeuron, layer->m_forgetGateDelta[1], sizeof(float) * batchNeuron);
+			memcpy(cursor + 3 * batchNeuron, layer->m_outGateDelta[1], sizeof(float) * batchNeuron);
+			memcpy(cursor + 4 * batchNeuron, layer->m_preGateStateDelta[1], sizeof(float) * batchNeuron);
+			memcpy(cursor + 5 * batchNeuron, layer->m_forgetGateActs[1], sizeof(float) * batchNeuron);
+		}
+	}
+}
+
+void RNN_LSTM::loadHandover(int seqIdx) {
+	// as the decoder hands over to the encoder: into step seqIdx = windowLen+1
+	for (int layerIdx=0; layerIdx<m_numLayer; ++layerIdx) {
+		LSTMLayer *layer = dynamic_cast<LSTMLayer*>(m_vecLayers[layerIdx]);
+		if (layer != NULL) {
+			int batchNeuron = m_nMinibatchSize * layer->m_numNeuron;
+			float *cursor = m_handoverErrs[layerIdx];
+			memcpy(layer->m_cellStateErrs[seqIdx], cursor + 0 * batchNeuron, sizeof(float) * batchNeuron);
+			memcpy(layer->m_inGateDelta[seqIdx], cursor + 1 * batchNeuron, sizeof(float) * batchNeuron);
+			memcpy(layer->m_forgetGateDelta[seqIdx], cursor + 2 * batchNeuron, sizeof(float) * batchNeuron);
+			memcpy(layer->m_outGateDelta[seqIdx], cursor + 3 * batchNeuron, sizeof(float) * batchNeuron);
+			memcpy(layer->m_preGateStateDelta[seqIdx], cursor + 4 * batchNeuron, sizeof(float) * batchNeuron);
+			memcpy(layer->m_forgetGateActs[seqIdx], cursor + 5 * batchNeuron, sizeof(float) * batchNeuron);
+		}
+	}
+}
+
+void RNN_LSTM::bindInputs(float *data, int stepOffset, int windowLen) {
+	// input sequence dataIdx to row dataIdx of m_inputActs of the input layer, step seqIdx is step stepOffset+seqIdx
+	RecurrentLayer *RNN_InputLayer = m_vecLayers[0];
+	for (int dataIdx=0; dataIdx<m_nMinibatchSize; ++dataIdx) {
+		float *dataCursor = data + ((long) dataIdx * m_maxSeqLen + stepOffset) * m_inputSize;
+		int lastIdx = min(seqLen(dataIdx) - stepOffset, windowLen);
+		for (int seqIdx=1; seqIdx<=lastIdx; ++seqIdx) {
+			memcpy(RNN_InputLayer->m_inputActs[seqIdx] + dataIdx*m_inputSize, dataCursor, sizeof(float)*m_inputSize);
+			dataCursor += m_inputSize;
+		}
+	}
 }
 
 float RNN_LSTM::computeGrad(float *grad, float *params, float *data, float *target) {
@@ -163,57 +410,80 @@ float RNN_LSTM::computeGrad(float *grad, float *params, float *data, float *targ
 	
 	memset(grad, 0x00, sizeof(float)*m_nParamSize);
 	bindWeights(params, grad);
+	m_gradSqNorm = 0.f;
 	
-	float *sampleData = data;
-	float *sampleTarget = target;
+	/*** feed forward and feed backward, all sequences of the minibatch at once ***/
+	// steps of the longest sequence only, shorter ones are zero-padded at the end
+	int inputSeqLen = batchSeqLen();
 
-	/*** feed forward and feed backward ***/
-	for (int dataIdx=0; dataIdx<m_nMinibatchSize; ++dataIdx) {
-		// TODO
-		int inputSeqLen = m_maxSeqLen;
-		
-		/* reset internal states of LSTM layers */
-		resetStates(inputSeqLen); // this is subject to change
-		
-		/* feedforward */
-		float *dataCursor = sampleData;
-		// bind input sequence to m_inputActs of the input layer 
-		RecurrentLayer *RNN_InputLayer = m_vecLayers[0];
-		for (int seqIdx=1; seqIdx<=inputSeqLen; ++seqIdx) {
-			memcpy(RNN_InputLayer->m_inputActs[seqIdx], dataCursor, sizeof(float)*m_inputSize);
-			dataCursor += m_inputSize;
+	if (m_ckptLen > 0) {
+		// forward through all windows keeping h and c at their starts
+		int numWindows = (inputSeqLen + m_ckptLen - 1) / m_ckptLen;
+		for (int window=0; window<numWindows; ++window) {
+			int windowLen = min(m_ckptLen, inputSeqLen - window * m_ckptLen);
+			if (window > 0) {
+				saveStates(window, m_ckptLen);
+			}
+			startWindow(window > 0 ? window : -1, windowLen);
+			bindInputs(data, window * m_ckptLen, windowLen);
+			feedForward(windowLen);
+		}
+		// backward from the last window, the ones before it run forward again from their checkpoint
+		for (int window=numWindows-1; window>=0; --window) {
+			int windowStart = window * m_ckptLen;
+			int windowLen = min(m_ckptLen, inputSeqLen - windowStart);
+			if (window < numWindows-1) {
+				saveHandover();
+				startWindow(window > 0 ? window : -1, windowLen);
+				bindInputs(data, windowStart, windowLen);
+				feedForward(windowLen);
+				loadHandover(windowLen+1);
+			}
+			error += computeError(target, windowLen, windowStart);
+			bindTargets(target, windowLen, windowStart);
+			m_finalPass = (window == 0);
+			feedBackward(windowLen);
 		}
-		// feedForward through connections and layers
-		feedForward(inputSeqLen);
+	} else {
+		int k1 = (m_tbpttK1 > 0) ? m_tbpttK1 : inputSeqLen;
+		int k2 = (m_tbpttK1 > 0) ? m_tbpttK2 : inputSeqLen;
 
-		/* compute error */
-		error += computeError(sampleTarget, inputSeqLen);
+		// windows of the last k2 steps every k1 steps, grads of all of them add up
+		// (a window overlapping the previous one runs its shared steps forward again)
+		int prevStart = 0;
+		int prevEnd = 0;
+		while (prevEnd < inputSeqLen) {
+			int windowEnd = min(prevEnd + k1, inputSeqLen);
+			int windowLen = min(k2, windowEnd);
+			int windowStart = windowEnd - windowLen;
 
-		/* feedbackword */
-		float *targetCursor = sampleTarget;
-		// bind target sequence to m_outputErrs of the output layer
-		RecurrentLayer *outputLayer = m_vecLayers[m_numLayer-1];
-		for (int seqIdx=1; seqIdx<=inputSeqLen; ++seqIdx) {
-			memcpy(outputLayer->m_outputErrs[seqIdx], targetCursor, sizeof(float)*m_outputSize);
-			targetCursor += m_outputSize;
-		}
-		// feedback through connections and layers
-		feedBackward(inputSeqLen);
+			/* reset internal states of LSTM layers, carry over those at windowStart */
+			if (prevEnd > 0) {
+				saveStates(0, windowStart - prevStart);
+			}
+			startWindow(prevEnd > 0 ? 0 : -1, windowLen);
 
-		sampleData += m_inputSize * inputSeqLen;
-		sampleTarget += m_outputSize * inputSeqLen;
-	}
+			/* feedforward */
+			bindInputs(data, windowStart, windowLen);
+			// feedForward through connections and layers
+			feedForward(windowLen);
 
-	// normalization by number of input sequences and clip gradients to [-1, 1]
-	float normFactor = 1.f / (float) m_nMinibatchSize;
-	for (int dim=0; dim<m_nParamSize; ++dim) {
-		grad[dim] *= normFactor;
-		if (grad[dim] < -1.f) {
-			grad[dim] = -1.f;
-		} else if (grad[dim] > 1.f) {
-			grad[dim] = 1.f;
+			/* compute error of the steps new to this window */
+			error += computeError(target, windowLen, windowStart, prevEnd);
+
+			/* feedbackword */
+			bindTargets(target, windowLen, windowStart, prevEnd);
+			// feedback through connections and layers, each segment is final once its block is done in the last window
+			m_finalPass = (windowEnd == inputSeqLen);
+			feedBackward(windowLen);
+
+			prevStart = windowStart;
+			prevEnd = windowEnd;
 		}
 	}
+
+	// grad was normalized segment by segment in feedBackward
+	float normFactor = 1.f / (float) m_nMinibatchSize;
 	error *= normFactor;
 
 	return error;
@@ -230,6 +500,7 @@ void RNN_LSTM::bindWeights(float *params, float *grad) {
 	// define cursors
 	float *paramsCursor = params;
 	float *gradCursor = grad;
+	m_gradBase = grad;
 	// layer part
 	for (int layerIdx=0; layerIdx<m_numLayer; ++layerIdx) {
 		m_vecLayers[layerIdx]->bindWeights(paramsCursor, gradCursor);
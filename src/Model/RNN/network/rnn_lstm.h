@@ -14,12 +14,38 @@ public:
 
 	/* data */
 	string m_taskType;
+	bool m_fusedGates;	// LSTM layers use the stacked [4N x (I+N)] gate weights
+	int *m_seqLen;	// length of each sequence of the minibatch, NULL: all m_maxSeqLen
+
+	// truncated BPTT: every m_tbpttK1 steps a window of the last m_tbpttK2 steps is run and backpropagated
+	int m_tbpttK1;	// 0: whole sequences
+	int m_tbpttK2;
+	// gradient checkpointing: windows of m_ckptLen (about sqrt(T)) steps, only h and c at their starts are kept,
+	// the backward pass runs every window but the last forward again
+	int m_ckptLen;	// 0: off
+	int m_bufferLen;	// steps held by the layer buffers
+	bool m_finalPass;	// grads are complete after this backward pass, segments get published
+
+	// grad segment of each layer / connection, -1 when it has no params
+	vector<int> m_layerSegIdx;
+	vector<int> m_connSegIdx;
+	float *m_gradBase;
 
 	/* method */
 	float computeGrad (float *grad, float *params, float *data, float *label);
 	void initParams (float *params);
 
-	float computeError(float *sampleTarget, int inputSeqLen);
+	void setSeqLengths (int *inputLen, int *outputLen);
+	int seqLen (int dataIdx) {return m_seqLen == NULL ? m_maxSeqLen : m_seqLen[dataIdx];};
+	int batchSeqLen ();
+	bool zeroPrefixExact ();
+
+	float computeError(float *target, int inputSeqLen, int stepOffset = 0, int countedSteps = 0);
+	void bindTargets(float *target, int inputSeqLen, int stepOffset = 0, int countedSteps = 0);
+	void saveStates(int slot, int seqIdx);
+	void startWindow(int slot, int windowLen);
+	void saveHandover();
+	void loadHandover(int seqIdx);
 
 	void feedBackward(int inputSeqLen);
 	void feedForward(int inputSeqLen);
@@ -28,6 +54,15 @@ public:
 	void resetStates(int inputSeqLen);
 	
 private:
+	// [slot][layer] h and c of every LSTM layer at the start of a window, NULL for other layers
+	vector<vector<float *> > m_slotStates;
+	vector<vector<float *> > m_slotOutputs;
+	// [layer] errors at step 1 of a window, they continue at the last step of the window before it
+	vector<float *> m_handoverErrs;
+
+	void bindInputs(float *data, int stepOffset, int windowLen);
+	void requireSegment(int segIdx);
+	void finishSegment(int segIdx);
 	RecurrentLayer *initLayer (int layerIdx);
 	RNNConnection *initConnection(int connIdx);	
 };
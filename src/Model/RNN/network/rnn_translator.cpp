@@ -1,5 +1,6 @@
 #include <iostream>
 #include <cmath>
+#include <algorithm>
 #include "rnn_translator.h"
 
 using namespace std;
@@ -8,6 +9,7 @@ RNNTranslator::RNNTranslator(ConfReader *confReader, int minibatchSize, string p
 	// init encoder and decoder
 	m_nMinibatchSize = minibatchSize;
 	m_reverseEncoder = confReader->getInt(prefix + "reverse_encoder");
+	m_printCost = confReader->getInt("print minibatch cost") != 0;
 	m_encoder = new RNN_LSTM(confReader, m_nMinibatchSize, "encoder_");
 	m_decoder = new RNN_LSTM(confReader, m_nMinibatchSize, "decoder_");
 	
@@ -16,6 +18,121 @@ RNNTranslator::RNNTranslator(ConfReader *confReader, int minibatchSize, string p
 	m_nParamSize += m_encoder->m_nParamSize;
 	m_nParamSize += m_decoder->m_nParamSize;
 	m_nParamSize += m_decoder->m_inputSize * m_encoder->m_outputSize;
+
+	// grad segments: those of the encoder, of the decoder, then m_encodingW
+	long offset = 0;
+	RNN_LSTM *subNets[2] = {m_encoder, m_decoder};
+	for (int netIdx=0; netIdx<2; ++netIdx) {
+		RNN_LSTM *net = subNets[netIdx];
+		net->m_segIdxBase = (int) m_segOffset.size();
+		for (int segIdx=0; segIdx<net->numSegments(); ++segIdx) {
+			addSegment(offset + net->m_segOffset[segIdx], net->m_segSize[segIdx]);
+		}
+		offset += net->m_nParamSize;
+	}
+	m_encodingSegIdx = addSegment(offset, m_decoder->m_inputSize * m_encoder->m_outputSize);
+
+	// forward order: encoder, m_encodingW, decoder
+	for (int order=0; order<m_encoder->numSegments(); ++order) {
+		m_segForward.push_back(m_encoder->m_segIdxBase + m_encoder->forwardSegment(order));
+	}
+	m_segForward.push_back(m_encodingSegIdx);
+	for (int order=0; order<m_decoder->numSegments(); ++order) {
+		m_segForward.push_back(m_decoder->m_segIdxBase + m_decoder->forwardSegment(order));
+	}
+}
+
+void RNNTranslator::setSegmentHandler (segmentHandler *handler) {
+	m_segHandler = handler;
+	m_encoder->setSegmentHandler(handler);
+	m_decoder->setSegmentHandler(handler);
+}
+
+void RNNTranslator::setSeqLengths (int *inputLen, int *outputLen) {
+	// shorter input sequences are zero-padded in front so that all of them end where the decoder starts
+	if (inputLen != NULL && !m_encoder->zeroPrefixExact()) {
+		printf("Error: variable-length inputs need an encoder of lstm_layer joined by lstm_connection.\n");
+		exit(-1);
+	}
+	m_encoder->m_seqLen = inputLen;
+	m_decoder->m_seqLen = outputLen;
+}
+
+void RNNTranslator::bindEncoderInputs(float *data, int stepOffset, int windowLen, int encoderSeqLen) {
+	// step seqIdx of the window is step stepOffset+seqIdx of the encoder, shorter sequences start late
+	int enInputSize = m_encoder->m_inputSize;
+	long enRecordSize = (long) m_encoder->m_maxSeqLen * enInputSize;
+	RecurrentLayer *enInputLayer = m_encoder->m_vecLayers[0];
+	for (int dataIdx=0; dataIdx<m_nMinibatchSize; ++dataIdx) {
+		int firstStep = encoderSeqLen - m_encoder->seqLen(dataIdx) + 1;
+		for (int seqIdx=max(1, firstStep-stepOffset); seqIdx<=windowLen; ++seqIdx) {
+			int step = stepOffset + seqIdx;
+			// the reversed encoder reads the sequence from its last element
+			int elemIdx = m_reverseEncoder ? encoderSeqLen - step : step - firstStep;
+			memcpy(enInputLayer->m_inputActs[seqIdx] + dataIdx*enInputSize, data + dataIdx*enRecordSize + elemIdx*enInputSize, 
+				sizeof(float)*enInputSize);
+		}
+	}
+}
+
+void RNNTranslator::bindDecoderInputs(float *data, float *target, int stepOffset, int windowLen, int enWindowLen) {
+	// step seqIdx of the window is step stepOffset+seqIdx of the decoder
+	int deInputSize = m_decoder->m_inputSize;
+	long enRecordSize = (long) m_encoder->m_maxSeqLen * m_encoder->m_inputSize;
+	long deRecordSize = (long) m_decoder->m_maxSeqLen * m_decoder->m_outputSize;
+	RecurrentLayer *deInputLayer  = m_decoder->m_vecLayers[0];
+	RecurrentLayer *enOutputLayer = m_encoder->m_vecLayers[m_encoder->m_numLayer-1];
+	if (stepOffset == 0) {
+		// step 1 reads the encoding of the last encoder step
+		dot_trans(deInputLayer->m_inputActs[1], enOutputLayer->m_outputActs[enWindowLen], m_nMinibatchSize, m_encoder->m_outputSize, 
+			m_encodingW, deInputSize, m_encoder->m_outputSize);
+	}
+	for (int dataIdx=0; dataIdx<m_nMinibatchSize; ++dataIdx) {
+		float *sampleData = data + dataIdx * enRecordSize;
+		int lastIdx = min(m_decoder->seqLen(dataIdx) - stepOffset, windowLen);
+		for (int seqIdx=max(1, 2-stepOffset); seqIdx<=lastIdx; ++seqIdx) {
+			// step t reads the target of step t-1
+			float *targetCursor = target + dataIdx * deRecordSize + (stepOffset+seqIdx-2) * m_decoder->m_outputSize;
+			float *inputActs = deInputLayer->m_inputActs[seqIdx] + dataIdx*deInputSize;
+			if (m_decoder->m_taskType == "classification") {
+				for (int classIdx=0; classIdx<m_decoder->m_outputSize; ++classIdx) {
+					if ( abs(targetCursor[classIdx] - 1.f) < 0.00001 ) {
+						memcpy(inputActs, sampleData+deInputSize*classIdx, sizeof(float)*deInputSize);
+						// printf("classification: %f, %d\n", targetCursor[classIdx], classIdx);
+					}					
+				}				
+			} else if (m_decoder->m_taskType == "regression") {
+				memcpy(inputActs, targetCursor, sizeof(float)*deInputSize);
+			}
+		}
+	}
+	// set the internal states of the decoder at t = 0 to the internal states of encoder at the last step
+	if (stepOffset == 0) {
+		#pragma omp parallel for
+		for (int layerIdx=0; layerIdx<m_encoder->m_numLayer; layerIdx++) {
+			LSTMLayer *enLayer = dynamic_cast<LSTMLayer*>(m_encoder->m_vecLayers[layerIdx]);
+			LSTMLayer *deLayer = dynamic_cast<LSTMLayer*>(m_decoder->m_vecLayers[layerIdx]);
+			int batchNeuron = m_nMinibatchSize * deLayer->m_numNeuron;
+			memcpy(deLayer->m_states[0], enLayer->m_states[enWindowLen], sizeof(float) * batchNeuron);
+			memcpy(deLayer->m_outputActs[0], enLayer->m_outputActs[enWindowLen], sizeof(float) * batchNeuron);
+		}
+	}
+}
+
+void RNNTranslator::handOverErrors(int enWindowLen) {
+	// the error at t = 1 of the decoder continues into the last step of the encoder
+	#pragma omp parallel for
+	for (int layerIdx=0; layerIdx<m_encoder->m_numLayer; layerIdx++) {
+		LSTMLayer *enLayer = dynamic_cast<LSTMLayer*>(m_encoder->m_vecLayers[layerIdx]);
+		LSTMLayer *deLayer = dynamic_cast<LSTMLayer*>(m_decoder->m_vecLayers[layerIdx]);
+		int batchNeuron = m_nMinibatchSize * deLayer->m_numNeuron;
+		elem_accum(enLayer->m_cellStateErrs[enWindowLen+1], deLayer->m_cellStateErrs[1], batchNeuron);
+		elem_accum(enLayer->m_inGateDelta[enWindowLen+1], deLayer->m_inGateDelta[1], batchNeuron);
+		elem_accum(enLayer->m_forgetGateDelta[enWindowLen+1], deLayer->m_forgetGateDelta[1], batchNeuron);
+		elem_accum(enLayer->m_outGateDelta[enWindowLen+1], deLayer->m_outGateDelta[1], batchNeuron);
+		elem_accum(enLayer->m_preGateStateDelta[enWindowLen+1], deLayer->m_preGateStateDelta[1], batchNeuron);
+		memcpy(enLayer->m_forgetGateActs[enWindowLen+1], deLayer->m_forgetGateActs[1], sizeof(float) * batchNeuron);
+	}
 }
 
 RNNTranslator::~RNNTranslator() {
@@ -63,127 +180,159 @@ float RNNTranslator::computeGrad (float *grad, float *params, float *data, float
 	
 	memset(grad, 0x00, sizeof(float)*m_nParamSize);
 	bindWeights(params, grad);
+	m_encoder->m_gradSqNorm = 0.f;
+	m_decoder->m_gradSqNorm = 0.f;
 
-	float *sampleData = data;
-	float *sampleTarget = target;
+	/*** feed forward and feed backward, all sequences of the minibatch at once ***/
+	// sequence dataIdx of the minibatch is row dataIdx of every layer buffer
+	// steps of the longest sequences only, records in data / target keep the max length
+	int encoderSeqLen = m_encoder->batchSeqLen();
+	int decoderSeqLen = m_decoder->batchSeqLen();
 
-	/*** feed forward and feed backward ***/
-	for (int dataIdx=0; dataIdx<m_nMinibatchSize; ++dataIdx) {
-		// TODO
-		int encoderSeqLen = m_encoder->m_maxSeqLen;
-		int decoderSeqLen = m_decoder->m_maxSeqLen;
-
-		/* reset internal states of LSTM layers */
-		m_encoder->resetStates(encoderSeqLen);
-		m_decoder->resetStates(decoderSeqLen);
-		
-		/****************************************************************
-		*                      Feed Forward Phase                       *
-		****************************************************************/
-		// *** encoder ***
-		float *dataCursor = sampleData;		
-		RecurrentLayer *enInputLayer  = m_encoder->m_vecLayers[0];
-		RecurrentLayer *enOutputLayer = m_encoder->m_vecLayers[m_encoder->m_numLayer-1];
-		// bind input sequence to m_inputActs of the input layer of the encoder
-		if (m_reverseEncoder) {
-			for (int seqIdx=encoderSeqLen; seqIdx>=1; --seqIdx) {
-				memcpy(enInputLayer->m_inputActs[seqIdx], dataCursor, sizeof(float)*m_encoder->m_inputSize);
-				dataCursor += m_encoder->m_inputSize;
-			}
-		} else {			
-			for (int seqIdx=1; seqIdx<=encoderSeqLen; ++seqIdx) {
-				memcpy(enInputLayer->m_inputActs[seqIdx], dataCursor, sizeof(float)*m_encoder->m_inputSize);
-				dataCursor += m_encoder->m_inputSize;
-			}
-		}
-		m_encoder->feedForward(encoderSeqLen);
-
-		// *** decoder ***
-		float *targetCursor = sampleTarget;
-		RecurrentLayer *deInputLayer  = m_decoder->m_vecLayers[0];
-		RecurrentLayer *deOutputLayer = m_decoder->m_vecLayers[m_decoder->m_numLayer-1];
-		// bind input sequence to m_inputActs of the input layer of the decoder
-		dot(deInputLayer->m_inputActs[1], m_encodingW, m_decoder->m_inputSize, m_encoder->m_outputSize, 
-			enOutputLayer->m_outputActs[encoderSeqLen], m_encoder->m_outputSize, 1);
-		for (int seqIdx=2; seqIdx<=decoderSeqLen; ++seqIdx) {
-			if (m_decoder->m_taskType == "classification") {
-				for (int classIdx=0; classIdx<m_decoder->m_outputSize; ++classIdx) {
-					if ( abs(targetCursor[classIdx] - 1.f) < 0.00001 ) {
-						memcpy(deInputLayer->m_inputActs[seqIdx], sampleData+m_decoder->m_inputSize*classIdx, sizeof(float)*m_decoder->m_inputSize);
-						// printf("classification: %f, %d\n", targetCursor[classIdx], classIdx);
-					}					
-				}				
-			} else if (m_decoder->m_taskType == "regression") {
-				memcpy(deInputLayer->m_inputActs[seqIdx], targetCursor, sizeof(float)*m_decoder->m_inputSize);
-			}
-			targetCursor += m_decoder->m_outputSize;
+	/****************************************************************
+	*                    Encoder Feed Forward                       *
+	****************************************************************/
+	// truncated BPTT backpropagates the last k2 steps of the encoder only, checkpointing
+	// backpropagates all of them window by window; the steps before the last window
+	// run forward in windows of up to m_bufferLen steps
+	RecurrentLayer *enOutputLayer = m_encoder->m_vecLayers[m_encoder->m_numLayer-1];
+	int enCkptLen = m_encoder->m_ckptLen;
+	int enWindowLen = encoderSeqLen;
+	if (m_encoder->m_tbpttK1 > 0) {
+		enWindowLen = min(m_encoder->m_tbpttK2, encoderSeqLen);
+	} else if (enCkptLen > 0) {
+		enWindowLen = (encoderSeqLen - 1) % enCkptLen + 1;
+	}
+	int enStart = 0;
+	int prevLen = 0;
+	while (true) {
+		int windowLen = encoderSeqLen - enStart;
+		bool lastWindow = (windowLen <= enWindowLen);
+		if (!lastWindow) {
+			windowLen = min(m_encoder->m_bufferLen, windowLen - enWindowLen);
 		}
-		// set the internal states of the decoder at t = 0 to the internal states of encoder at the last step
-		#pragma omp parallel for
-		for (int layerIdx=0; layerIdx<m_encoder->m_numLayer; layerIdx++) {
-			LSTMLayer *enLayer = dynamic_cast<LSTMLayer*>(m_encoder->m_vecLayers[layerIdx]);
-			LSTMLayer *deLayer = dynamic_cast<LSTMLayer*>(m_decoder->m_vecLayers[layerIdx]);
-			memcpy(deLayer->m_states[0], enLayer->m_states[encoderSeqLen], sizeof(float) * deLayer->m_numNeuron);
-			memcpy(deLayer->m_outputActs[0], enLayer->m_outputActs[encoderSeqLen], sizeof(float) * deLayer->m_numNeuron);
+		// checkpoint w is the start of window w, truncated BPTT only carries the states over
+		int slot = (enCkptLen > 0) ? enStart / enCkptLen : 0;
+		if (enStart > 0) {
+			m_encoder->saveStates(slot, prevLen);
 		}
-		
-		// decoder feedforward
-		m_decoder->feedForward(decoderSeqLen);		
-
-		// ******** compute error phase ******** //
-		error += m_decoder->computeError(sampleTarget, decoderSeqLen);
-		
-		/****************************************************************
-		*                      Feed Backword Phase                      *
-		****************************************************************/
-		// *** decoder ***		
-		targetCursor = sampleTarget; // reset the target cursor to sample target
-		// bind target sequence to m_outputErrs of the output layer of the decoder
-		for (int seqIdx=1; seqIdx<=decoderSeqLen; ++seqIdx) {
-			memcpy(deOutputLayer->m_outputErrs[seqIdx], targetCursor, sizeof(float)*m_decoder->m_outputSize);
-			targetCursor += m_decoder->m_outputSize;
+		m_encoder->startWindow(enStart > 0 ? slot : -1, windowLen);
+		bindEncoderInputs(data, enStart, windowLen, encoderSeqLen);
+		m_encoder->feedForward(windowLen);
+		if (lastWindow) {
+			break;
 		}
-		m_decoder->feedBackward(decoderSeqLen);
+		enStart += windowLen;
+		prevLen = windowLen;
+	}
 
-		// *** encoder ***
-		// set the spatial error signal of encoder
-		trans_dot(enOutputLayer->m_outputErrs[encoderSeqLen], m_encodingW, m_decoder->m_inputSize, m_encoder->m_outputSize, 
-			deInputLayer->m_inputErrs[0], m_decoder->m_inputSize, 1);
-		#pragma omp parallel for
-		for (int layerIdx=0; layerIdx<m_encoder->m_numLayer; layerIdx++) {
-			LSTMLayer *enLayer = dynamic_cast<LSTMLayer*>(m_encoder->m_vecLayers[layerIdx]);
-			LSTMLayer *deLayer = dynamic_cast<LSTMLayer*>(m_decoder->m_vecLayers[layerIdx]);
-			memcpy(enLayer->m_cellStateErrs[encoderSeqLen+1], deLayer->m_cellStateErrs[1], sizeof(float) * deLayer->m_numNeuron);
-			memcpy(enLayer->m_inGateDelta[encoderSeqLen+1], deLayer->m_inGateDelta[1], sizeof(float) * deLayer->m_numNeuron);
-			memcpy(enLayer->m_forgetGateDelta[encoderSeqLen+1], deLayer->m_forgetGateDelta[1], sizeof(float) * deLayer->m_numNeuron);
-			memcpy(enLayer->m_outGateDelta[encoderSeqLen+1], deLayer->m_outGateDelta[1], sizeof(float) * deLayer->m_numNeuron);
-			memcpy(enLayer->m_preGateStateDelta[encoderSeqLen+1], deLayer->m_preGateStateDelta[1], sizeof(float) * deLayer->m_numNeuron);
-			memcpy(enLayer->m_forgetGateActs[encoderSeqLen+1], deLayer->m_forgetGateActs[1], sizeof(float) * deLayer->m_numNeuron);
+	/****************************************************************
+	*                Decoder Feed Forward / Backward                *
+	****************************************************************/
+	awaitSegment(m_encodingSegIdx);
+	int deCkptLen = m_decoder->m_ckptLen;
+	if (deCkptLen > 0) {
+		// forward through all windows keeping h and c at their starts, then backward from the last
+		// window, the ones before it run forward again from their checkpoint as in RNN_LSTM::computeGrad
+		int numWindows = (decoderSeqLen + deCkptLen - 1) / deCkptLen;
+		for (int window=0; window<numWindows; ++window) {
+			int windowLen = min(deCkptLen, decoderSeqLen - window * deCkptLen);
+			if (window > 0) {
+				m_decoder->saveStates(window, deCkptLen);
+			}
+			m_decoder->startWindow(window > 0 ? window : -1, windowLen);
+			bindDecoderInputs(data, target, window * deCkptLen, windowLen, enWindowLen);
+			m_decoder->feedForward(windowLen);
+		}
+		for (int window=numWindows-1; window>=0; --window) {
+			int windowStart = window * deCkptLen;
+			int windowLen = min(deCkptLen, decoderSeqLen - windowStart);
+			if (window < numWindows-1) {
+				m_decoder->saveHandover();
+				m_decoder->startWindow(window > 0 ? window : -1, windowLen);
+				bindDecoderInputs(data, target, windowStart, windowLen, enWindowLen);
+				m_decoder->feedForward(windowLen);
+				m_decoder->loadHandover(windowLen+1);
+			}
+			error += m_decoder->computeError(target, windowLen, windowStart);
+			m_decoder->bindTargets(target, windowLen, windowStart);
+			m_decoder->m_finalPass = (window == 0);
+			m_decoder->feedBackward(windowLen);
 		}
-		// encoder feed backward
-		m_encoder->feedBackward(encoderSeqLen);
+		handOverErrors(enWindowLen);
+	} else {
+		// windows of the last k2 steps every k1 steps as in RNN_LSTM::computeGrad,
+		// those starting at t = 0 hand their error over to the encoder
+		int k1 = (m_decoder->m_tbpttK1 > 0) ? m_decoder->m_tbpttK1 : decoderSeqLen;
+		int k2 = (m_decoder->m_tbpttK1 > 0) ? m_decoder->m_tbpttK2 : decoderSeqLen;
+		int prevStart = 0;
+		int prevEnd = 0;
+		while (prevEnd < decoderSeqLen) {
+			int windowEnd = min(prevEnd + k1, decoderSeqLen);
+			int windowLen = min(k2, windowEnd);
+			int windowStart = windowEnd - windowLen;
+			if (windowStart > 0) {
+				m_decoder->saveStates(0, windowStart - prevStart);
+			}
+			m_decoder->startWindow(windowStart > 0 ? 0 : -1, windowLen);
+			bindDecoderInputs(data, target, windowStart, windowLen, enWindowLen);
 
-		// compute m_gradEncodingW
-		outer(m_gradEncodingW, deInputLayer->m_inputErrs[0], m_decoder->m_inputSize, 
-			enOutputLayer->m_outputActs[encoderSeqLen], m_encoder->m_outputSize);
+			// decoder feedforward
+			m_decoder->feedForward(windowLen);		
 
-		// move cursor to new position
-		sampleData += encoderSeqLen * m_encoder->m_inputSize;
-		sampleTarget += decoderSeqLen * m_decoder->m_outputSize;
+			// ******** compute error phase ******** //
+			error += m_decoder->computeError(target, windowLen, windowStart, prevEnd);
+
+			// bind target sequences to m_outputErrs of the output layer of the decoder, segments are published after the last window
+			m_decoder->bindTargets(target, windowLen, windowStart, prevEnd);
+			m_decoder->m_finalPass = (windowEnd == decoderSeqLen);
+			m_decoder->feedBackward(windowLen);
+
+			if (windowStart == 0) {
+				handOverErrors(enWindowLen);
+			}
+			prevStart = windowStart;
+			prevEnd = windowEnd;
+		}
 	}
 
-	// normalization by number of input sequences and clip gradients to [-1, 1]
-	float normFactor = 1.f / (float) m_nMinibatchSize;
-	for (int dim=0; dim<m_nParamSize; ++dim) {
-		grad[dim] *= normFactor;
-		if (grad[dim] < -1.f) {
-			grad[dim] = -1.f;
-		} else if (grad[dim] > 1.f) {
-			grad[dim] = 1.f;
+	/****************************************************************
+	*                    Encoder Feed Backward                      *
+	****************************************************************/
+	// set the spatial error signal of encoder
+	int deInputSize = m_decoder->m_inputSize;
+	RecurrentLayer *deInputLayer  = m_decoder->m_vecLayers[0];
+	dot(enOutputLayer->m_outputErrs[enWindowLen], deInputLayer->m_inputErrs[0], m_nMinibatchSize, deInputSize, 
+		m_encodingW, deInputSize, m_encoder->m_outputSize);
+	// encoder feed backward, segments are published as they complete
+	m_encoder->m_finalPass = (enCkptLen == 0 || enStart == 0);
+	m_encoder->feedBackward(enWindowLen);
+	if (enCkptLen > 0) {
+		// the windows before the last run forward again from their checkpoint
+		for (int window=enStart/enCkptLen-1; window>=0; --window) {
+			m_encoder->saveHandover();
+			m_encoder->startWindow(window > 0 ? window : -1, enCkptLen);
+			bindEncoderInputs(data, window * enCkptLen, enCkptLen, encoderSeqLen);
+			m_encoder->feedForward(enCkptLen);
+			m_encoder->loadHandover(enCkptLen+1);
+			m_encoder->m_finalPass = (window == 0);
+			m_encoder->feedBackward(enCkptLen);
 		}
 	}
+
+	// compute m_gradEncodingW, summed over the minibatch
+	trans_dot(m_gradEncodingW, deInputLayer->m_inputErrs[0], m_nMinibatchSize, deInputSize, 
+		enOutputLayer->m_outputActs[enWindowLen], m_nMinibatchSize, m_encoder->m_outputSize);
+	// normalization by number of input sequences, the master's solver clips by the summed |grad|^2
+	float encodingSqNorm = elem_scale_sqnorm(m_gradEncodingW, 1.f / (float) m_nMinibatchSize, m_segSize[m_encodingSegIdx]);
+	m_gradSqNorm = m_encoder->m_gradSqNorm + m_decoder->m_gradSqNorm + encodingSqNorm;
+	publishSegment(m_encodingSegIdx);
+
+	float normFactor = 1.f / (float) m_nMinibatchSize;
 	error *= normFactor;
-	printf("Error: %f\n", error);
+	if (m_printCost) {
+		printf("Error: %f\n", error);
+	}
 
 	return error;
 }
\ No newline at end of file
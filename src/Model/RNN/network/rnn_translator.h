@@ -21,12 +21,20 @@ public:
 	RNN_LSTM *m_encoder;
 	RNN_LSTM *m_decoder;
 
+	int m_encodingSegIdx;
+
 	/* method */
 	float computeGrad (float *grad, float *params, float *data, float *label);
 	void initParams (float *params);
+	void setSegmentHandler (segmentHandler *handler);
+	void setSeqLengths (int *inputLen, int *outputLen);
+	float defaultClipNorm () {return m_decoder->defaultClipNorm();};
 
 private:
 	void bindWeights(float *params, float *grad);
+	void bindEncoderInputs(float *data, int stepOffset, int windowLen, int encoderSeqLen);
+	void bindDecoderInputs(float *data, float *target, int stepOffset, int windowLen, int enWindowLen);
+	void handOverErrors(int enWindowLen);
 };
 
 #endif
\ No newline at end of file
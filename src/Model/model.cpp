@@ -3,6 +3,73 @@
 
 #include <time.h>
 #include <cfloat>
+#include <algorithm>
+/****************************************************************
+* Method definition for the gradient segments of modelBase
+****************************************************************/
+
+int modelBase::numSegments () {
+	// models that never publish are shipped as a single segment
+	if (m_segOffset.empty()) {
+		addSegment(0, m_nParamSize);
+	}
+	return (int) m_segOffset.size();
+}
+
+int modelBase::forwardSegment (int order) {
+	// without an explicit order the layout order is the forward order
+	if (m_segForward.empty()) {
+		return order;
+	}
+	return m_segForward[order];
+}
+
+int modelBase::addSegment (long offset, long size) {
+	m_segOffset.push_back(offset);
+	m_segSize.push_back(size);
+	return (int) m_segOffset.size() - 1;
+}
+
+void modelBase::awaitSegment (int segIdx) {
+	if (m_segHandler != NULL) {
+		m_segHandler->paramNeeded(m_segIdxBase + segIdx);
+	}
+}
+
+void modelBase::publishSegment (int segIdx) {
+	if (m_segHandler != NULL) {
+		m_segHandler->gradReady(m_segIdxBase + segIdx);
+	}
+}
+
+void modelBase::sparseAdd (int idx, float val) {
+	if (m_sparseAcc.empty()) {
+		m_sparseAcc.assign(m_nParamSize, 0.f);
+		m_sparseTouched.assign(m_nParamSize, 0);
+	}
+	if (!m_sparseTouched[idx]) {
+		m_sparseTouched[idx] = 1;
+		m_sparseList.push_back(idx);
+	}
+	m_sparseAcc[idx] += val;
+}
+
+int modelBase::sparseEmit (int *index, float *value, float scale) {
+	std::sort(m_sparseList.begin(), m_sparseList.end());
+	m_gradSqNorm = 0.f;
+	int nnz = (int) m_sparseList.size();
+	for (int k=0; k<nnz; ++k) {
+		int idx = m_sparseList[k];
+		index[k] = idx;
+		value[k] = m_sparseAcc[idx] * scale;
+		m_gradSqNorm += value[k] * value[k];
+		m_sparseAcc[idx] = 0.f;
+		m_sparseTouched[idx] = 0;
+	}
+	m_sparseList.clear();
+	return nnz;
+}
+
 /****************************************************************
 * Method definition for Linear Regression
 ****************************************************************/
@@ -11,6 +78,7 @@ linearReg::linearReg (ConfReader *confReader, int minibatchSize) {
 	m_inputSize = confReader->getInt("input size");
 	m_nMinibatchSize = minibatchSize;
 	m_nParamSize = m_inputSize + 1;
+	m_printCost = confReader->getInt("print minibatch cost") != 0;
 }
 
 linearReg::~linearReg () {
@@ -21,19 +89,20 @@ float linearReg::computeGrad (float *grad, float *params, float *data, float *la
 	// Init variables
 	float cost = 0.f;
 	float diff, predict;
-	int dataOffset;
+	long dataOffset;
 	memset(grad, 0x00, sizeof(float) * m_nParamSize);
+	awaitSegment(0);
 
 	// Accumulate cost and grad
 	for (int sample=0; sample<m_nMinibatchSize; sample++) {
 		dataOffset = sample * m_nParamSize;
 		predict = 0.f;
-		for (int dim=0; dim<m_nParamSize; dim++) {
+		for (long dim=0; dim<m_nParamSize; dim++) {
 			predict += params[dim] * data[dataOffset + dim];
 		}
 
 		diff = predict - label[sample];
-		for (int dim=0; dim<m_nParamSize; dim++) {
+		for (long dim=0; dim<m_nParamSize; dim++) {
 			grad[dim] += data[dataOffset + dim] * diff;
 		}
 		cost += 0.5 * diff * diff;
@@ -42,17 +111,55 @@ float linearReg::computeGrad (float *grad, float *params, float *data, float *la
 	// Average minibatch_cost and grad
 	float f_minibatchSize = static_cast<float>(m_nMinibatchSize);
 	cost /= f_minibatchSize;
-	for (int dim=0; dim<m_nParamSize; dim++) {
+	m_gradSqNorm = 0.f;
+	for (long dim=0; dim<m_nParamSize; dim++) {
 		grad[dim] /= f_minibatchSize;
+		m_gradSqNorm += grad[dim] * grad[dim];
+	}
+	if (m_printCost) {
+		printf("Linear Regression Error: %f\n", cost);
+	}
+
+	return cost;
+}
+
+float linearReg::computeSparseGrad (int *nnz, int *index, float *value, float *params, float *data, float *label) {
+	// same as computeGrad, only the nonzero features are touched
+	float cost = 0.f;
+	float diff, predict;
+	long dataOffset;
+	awaitSegment(0);
+
+	for (int sample=0; sample<m_nMinibatchSize; sample++) {
+		dataOffset = sample * m_nParamSize;
+		predict = 0.f;
+		for (long dim=0; dim<m_nParamSize; dim++) {
+			if (data[dataOffset + dim] != 0.f) {
+				predict += params[dim] * data[dataOffset + dim];
+			}
+		}
+
+		diff = predict - label[sample];
+		for (long dim=0; dim<m_nParamSize; dim++) {
+			if (data[dataOffset + dim] != 0.f) {
+				sparseAdd(dim, data[dataOffset + dim] * diff);
+			}
+		}
+		cost += 0.5 * diff * diff;
+	}
+
+	float f_minibatchSize = static_cast<float>(m_nMinibatchSize);
+	cost /= f_minibatchSize;
+	*nnz = sparseEmit(index, value, 1.f / f_minibatchSize);
+	if (m_printCost) {
+		printf("Linear Regression Error: %f\n", cost);
 	}
-	printf("Linear Regression Error: %f\n", cost);
 
 	return cost;
 }
 
 void linearReg::initParams (float *params) {
-	srand (time(NULL));
-	for (int i=0; i<m_nParamSize; i++) {
+	for (long i=0; i<m_nParamSize; i++) {
         params[i] = 0;//SYM_UNIFORM_RAND;
     }
 }
@@ -68,7 +175,8 @@ softmaxReg::softmaxReg (ConfReader *confReader, int minibatchSize) {
 	m_prob = new float [m_classNum];
 	m_oneOnlabel = new float[m_classNum];
 	m_nParamSize = m_classNum * (m_inputSize + 1);
-	printf("%d,%d,%d\n", m_inputSize, m_classNum, m_nParamSize);
+	m_printCost = confReader->getInt("print minibatch cost") != 0;
+	printf("%d,%d,%ld\n", m_inputSize, m_classNum, m_nParamSize);
 }
 
 softmaxReg::~softmaxReg () {
@@ -77,8 +185,7 @@ softmaxReg::~softmaxReg () {
 }
 
 void softmaxReg::initParams (float *params) {
-	srand (time(NULL));
-	for (int i=0; i<m_nParamSize; i++) {
+	for (long i=0; i<m_nParamSize; i++) {
         params[i] = 0.000001 * SYM_UNIFORM_RAND;
     }
 }
@@ -87,10 +194,11 @@ float softmaxReg::computeGrad (float *grad, float *params, float *data, float *l
 	// Init variables
 	float crossEntropy = 0.f;
 	float correctCount = 0.f;
-	int dataOffset;
+	long dataOffset;
 	int labelInt;
 	float maxProb;
 	memset(grad, 0x00, sizeof(float) * m_nParamSize);
+	awaitSegment(0);
 	memset(m_prob, 0x00, sizeof(float) * m_classNum);
 
 	// compute prob, grad and error
@@ -184,13 +292,98 @@ float softmaxReg::computeGrad (float *grad, float *params, float *data, float *l
 	// Average minibatch_cost and grad
 	float f_minibatchSize = static_cast<float>(m_nMinibatchSize);
 	crossEntropy /= f_minibatchSize;
-	for (int dim=0; dim<m_nParamSize; dim++) {
+	m_gradSqNorm = 0.f;
+	for (long dim=0; dim<m_nParamSize; dim++) {
 		grad[dim] /= f_minibatchSize;
+		m_gradSqNorm += grad[dim] * grad[dim];
 	}
 
-	printf("Cross Entropy Error: %f\n", crossEntropy);
-	printf("Correct rate: %d/%d=%f\n", int(correctCount), m_nMinibatchSize, correctCount / float(m_nMinibatchSize));
+	if (m_printCost) {
+		printf("Cross Entropy Error: %f\n", crossEntropy);
+		printf("Correct rate: %d/%d=%f\n", int(correctCount), m_nMinibatchSize, correctCount / float(m_nMinibatchSize));
+	}
 
 	return crossEntropy;
 }
 
+float softmaxReg::computeSparseGrad (int *nnz, int *index, float *value, float *params, float *data, float *label) {
+	// same as computeGrad, the weights of zero features are neither read nor emitted
+	float crossEntropy = 0.f;
+	float correctCount = 0.f;
+	long dataOffset;
+	int labelInt;
+	float maxProb;
+	awaitSegment(0);
+	memset(m_prob, 0x00, sizeof(float) * m_classNum);
+
+	for (int sample=0; sample<m_nMinibatchSize; sample++) {
+		memset(m_oneOnlabel, 0x00, sizeof(float)*m_classNum);
+		labelInt = (int)label[sample];
+		if (labelInt < 0) {
+			labelInt = 0;
+			printf("Warning: labelInt is negative.\n");
+		}
+		m_oneOnlabel[labelInt] = 1.f;
+
+		//**** compute prob = <W, x> + b ****//
+		dataOffset = sample * m_inputSize;
+		maxProb = -FLT_MAX;
+		for (int classIdx=0; classIdx<m_classNum; ++classIdx) {
+			for (int dim=0; dim<m_inputSize; ++dim) {
+				if (data[dataOffset+dim] != 0.f) {
+					m_prob[classIdx] += params[classIdx*m_inputSize+dim] * data[dataOffset+dim];
+				}
+			}
+			m_prob[classIdx] += params[m_classNum*m_inputSize+classIdx];
+			if (m_prob[classIdx] > maxProb) {
+			 	maxProb = m_prob[classIdx];
+			}
+		}
+
+		//**** compute prob = exp(<W, x> + b) / sum(exp(<W, x> + b))) ****//
+		float sumProb = 0.f;
+		for (int classIdx=0; classIdx<m_classNum; ++classIdx) {
+			m_prob[classIdx] = fexp(m_prob[classIdx]-maxProb);
+			sumProb += m_prob[classIdx];
+		}
+		for (int classIdx=0; classIdx<m_classNum; ++classIdx) {
+			m_prob[classIdx] = fdivide(&(m_prob[classIdx]), &sumProb);
+		}
+
+		//**** compute grad and error based on normalized prob ****//
+		for (int classIdx=0; classIdx<m_classNum; ++classIdx) {
+			float diff = m_prob[classIdx] - m_oneOnlabel[classIdx];
+			for (int dim=0; dim<m_inputSize; ++dim) {
+				if (data[dataOffset+dim] != 0.f) {
+					sparseAdd(classIdx*m_inputSize+dim, data[dataOffset + dim] * diff);
+				}
+			}
+			// bias terms are always active
+			sparseAdd(m_classNum*m_inputSize+classIdx, diff);
+			crossEntropy -= fmutiplelog(m_oneOnlabel[classIdx] , m_prob[classIdx]);
+		}
+
+		float maxP = -100.f;
+		int maxIndex = -1;
+		for (int i=0; i<m_classNum; i++) {
+			if (m_prob[i] > maxP) {
+				maxP = m_prob[i];
+				maxIndex = i;
+			}
+		}
+		if (maxIndex == labelInt) {
+			correctCount ++;
+		}
+	}
+
+	float f_minibatchSize = static_cast<float>(m_nMinibatchSize);
+	crossEntropy /= f_minibatchSize;
+	*nnz = sparseEmit(index, value, 1.f / f_minibatchSize);
+
+	if (m_printCost) {
+		printf("Cross Entropy Error: %f\n", crossEntropy);
+		printf("Correct rate: %d/%d=%f\n", int(correctCount), m_nMinibatchSize, correctCount / float(m_nMinibatchSize));
+	}
+
+	return crossEntropy;
+}
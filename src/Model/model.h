@@ -5,6 +5,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <math.h>
+#include <vector>
 
 #include "confreader.h"
 
@@ -12,21 +13,90 @@
 
 using namespace std;
 
+/****************************************************************
+* Segments are contiguous slices of the params / grad buffers in
+* parameter layout order (one per layer / connection).
+* Before the forward pass touches the params of a segment the
+* model asks the handler for them, so they can still be in flight
+* when computeGrad starts. A grad segment is published as soon as
+* its values are final, i.e. during the backward pass of the last
+* sample, so it can be shipped while earlier layers are computed.
+****************************************************************/
+class segmentHandler
+{
+public:
+	segmentHandler(){};
+	virtual ~segmentHandler(){};
+
+	/* method */
+	void virtual paramNeeded (int segIdx) {};
+	void virtual gradReady (int segIdx) {};
+};
+
 class modelBase
 {
 public:
-	modelBase(){};
+	modelBase(){m_segIdxBase = 0; m_segHandler = NULL; m_gradSqNorm = 0.f; m_printCost = false;};
 	virtual ~modelBase(){};
 
 	/* data */
-	int m_nParamSize;
+	long m_nParamSize;
 	int m_nMinibatchSize;
+	float m_gradSqNorm;	// |grad|^2 of the last computeGrad / computeSparseGrad, summed by its averaging pass
+
+	std::vector<long> m_segOffset;
+	std::vector<long> m_segSize;
+	std::vector<int> m_segForward;	// segments in the order the forward pass needs them
+	int m_segIdxBase;	// index of the first segment inside an enclosing model
+	bool m_printCost;	// "print minibatch cost": print from computeGrad, off on the hot path
+	segmentHandler *m_segHandler;
 
 	/* method */
 	float virtual computeGrad (float *grad, float *params, float *data, float *label) {return 0.f;};
 	void virtual initParams (float *params) {};
+
+	// grad as *nnz (index, value) pairs with ascending indices, cost as returned by computeGrad
+	bool virtual hasSparseGrad () {return false;};
+	// global grad norm the solver clips to when "clip gradient norm" is < 0, 0: no clipping
+	float virtual defaultClipNorm () {return 0.f;};
+	float virtual computeSparseGrad (int *nnz, int *index, float *value, float *params, float *data, float *label) {return 0.f;};
+
+	// lengths of the sequences of the next minibatch (sequence models), NULL: all of the max length
+	void virtual setSeqLengths (int *inputLen, int *outputLen) {};
+
+	int numSegments ();
+	int forwardSegment (int order);
+	void virtual setSegmentHandler (segmentHandler *handler) {m_segHandler = handler;};
+
+protected:
+	/* data */
+	// accumulator behind computeSparseGrad: only touched entries are listed and reset
+	std::vector<float> m_sparseAcc;
+	std::vector<char> m_sparseTouched;
+	std::vector<int> m_sparseList;
+
+	/* method */
+	int addSegment (long offset, long size);
+	void awaitSegment (int segIdx);
+	void publishSegment (int segIdx);
+
+	void sparseAdd (int idx, float val);
+	int sparseEmit (int *index, float *value, float scale);
 };
 
+/****************************************************************
+* Grad messages, slave to master. Every grad comes with GRAD_INFO
+* floats: |grad|^2 (for clipping) and the minibatch cost (for the
+* master's stats line). A dense grad carries them after the params.
+* Sparse: int nnz, GRAD_INFO floats, nnz ascending int indices,
+* nnz float values
+****************************************************************/
+#define GRAD_INFO 2
+inline long sparseMsgBytes (int nnz) {return sizeof(int) + GRAD_INFO * sizeof(float) + (long) nnz * (sizeof(int) + sizeof(float));}
+inline float *sparseMsgInfo (char *msg) {return (float *) (msg + sizeof(int));}
+inline int *sparseMsgIndex (char *msg) {return (int *) (msg + sizeof(int) + GRAD_INFO * sizeof(float));}
+inline float *sparseMsgValue (char *msg, int nnz) {return (float *) (msg + sizeof(int) + GRAD_INFO * sizeof(float) + (long) nnz * sizeof(int));}
+
 class linearReg: public modelBase
 {
 public:
@@ -39,6 +109,9 @@ public:
 	/* method */
 	float computeGrad (float *grad, float *params, float *data, float *label);
 	void initParams (float *params);
+
+	bool hasSparseGrad () {return true;};
+	float computeSparseGrad (int *nnz, int *index, float *value, float *params, float *data, float *label);
 };
 
 class softmaxReg: public modelBase
@@ -56,6 +129,9 @@ public:
 	/* method */
 	float computeGrad (float *grad, float *params, float *data, float *label);
 	void initParams (float *params);
+
+	bool hasSparseGrad () {return true;};
+	float computeSparseGrad (int *nnz, int *index, float *value, float *params, float *data, float *label);
 };
 
 #endif
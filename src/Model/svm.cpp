@@ -8,6 +8,7 @@ modelSVM::modelSVM(ConfReader *confReader, int minibatchSize)
     m_nParamSize = confReader->getInt("parameter size");    
     svm_lambda = confReader->getFloat("svm lambda");
     m_nMinibatchSize = minibatchSize;
+    m_printCost = confReader->getInt("print minibatch cost") != 0;
 }
 
 modelSVM::~modelSVM()
@@ -19,9 +20,10 @@ float modelSVM::computeGrad (float *grad, float *params, float *data, float *lab
 {
     float cost = 0.f;
     float predict, f_label;
-    int offset;
+    long offset;
     float correct_counter = 0.f;
     memset(grad, 0x00, sizeof(float) * m_nParamSize); 
+    awaitSegment(0);
     float target; //y_t * w^T * x_t
     
     // Accumulate cost and grad
@@ -29,7 +31,7 @@ float modelSVM::computeGrad (float *grad, float *params, float *data, float *lab
     {
 	offset = i * m_nParamSize;	
 	predict = 0.f; //w^T * x^t
-	for (int j=0; j < m_nParamSize; j++)
+	for (long j=0; j < m_nParamSize; j++)
 	{
 	    predict += data[offset+j] * params[j];
 	}
@@ -40,43 +42,80 @@ float modelSVM::computeGrad (float *grad, float *params, float *data, float *lab
 	//std::cout << "target" << target << std::endl;
 	if (target > 1)
 	{
-	    for (int j=0; j < m_nParamSize; j++) grad[j] += svm_lambda * params[j];
+	    for (long j=0; j < m_nParamSize; j++) grad[j] += svm_lambda * params[j];
 	}
 	else
 	{
-	    for (int j=0; j < m_nParamSize; j++) 
+	    for (long j=0; j < m_nParamSize; j++) 
 	    {
 		grad[j] += svm_lambda * params[j] - f_label * data[offset+j];
 	    }
 	}
 	//printf("Iteration %d", i);
-	//for (int j=0; j < m_nParamSize; j++) printf("%f,",grad[j]);
+	//for (long j=0; j < m_nParamSize; j++) printf("%f,",grad[j]);
 	//printf("\n");
 	
 	//accumulative cost
 	//obj = lambda * w^2 + max(0, 1-target)
 	cost += std::max(0.f, 1.f-target);
     }
-    for (int j=0; j < m_nParamSize; j++)
+    for (long j=0; j < m_nParamSize; j++)
     {
 	cost += svm_lambda * params[j] * params[j];
     }
 
     //average grad (maybe not used)
     float f_minibatchSize = static_cast<float>(m_nMinibatchSize);
-    for (int j=0; j < m_nParamSize; j++) 
+    m_gradSqNorm = 0.f;
+    for (long j=0; j < m_nParamSize; j++) 
     {
     	grad[j] /= f_minibatchSize;
+    	m_gradSqNorm += grad[j] * grad[j];
     }
     //printf("Correct Number: %d \n", static_cast<int> (correct_counter));
     //std::cout << "Correct rate: " << correct_counter/f_minibatchSize << std::endl;
-    std::cout << correct_counter/f_minibatchSize << std::endl;
+    if (m_printCost) std::cout << correct_counter/f_minibatchSize << std::endl;
+    return cost;
+}
+
+float modelSVM::computeSparseGrad (int *nnz, int *index, float *value, float *params, float *data, float *label)
+{
+    // hinge term on the nonzero features only, offered for lambda 0 (see hasSparseGrad)
+    float cost = 0.f;
+    float predict, f_label;
+    long offset;
+    float correct_counter = 0.f;
+    awaitSegment(0);
+    float target;
+
+    for (int i=0; i < m_nMinibatchSize; i++)
+    {
+	offset = i * m_nParamSize;
+	predict = 0.f;
+	for (long j=0; j < m_nParamSize; j++)
+	{
+	    if (data[offset+j] != 0.f) predict += data[offset+j] * params[j];
+	}
+	f_label = static_cast<float>(label[i]);
+	target = f_label * predict;
+	if (target > 0) correct_counter++;
+	if (target > 1) continue;
+	for (long j=0; j < m_nParamSize; j++)
+	{
+	    if (data[offset+j] != 0.f) sparseAdd(j, -f_label * data[offset+j]);
+	}
+	cost += 1.f-target;
+    }
+
+    float f_minibatchSize = static_cast<float>(m_nMinibatchSize);
+    *nnz = sparseEmit(index, value, 1.f / f_minibatchSize);
+    if (m_printCost) std::cout << correct_counter/f_minibatchSize << std::endl;
     return cost;
 }
 
 void modelSVM::initParams (float *params)
 {
-    for (int i=0; i<m_nParamSize; i++)
+    for (long i=0; i<m_nParamSize; i++)
     {
 	params[i] = static_cast<float>(rand())/RAND_MAX; 
     }
@@ -17,5 +17,9 @@ class modelSVM :public modelBase
 	// label need to be +- 1
 	void initParams (float *params);
 
+	// the L2 term touches every param, only the pure hinge loss has sparse grads
+	bool hasSparseGrad () {return svm_lambda == 0;};
+	float computeSparseGrad (int *nnz, int *index, float *value, float *params, float *data, float *label);
+
 };
 #endif
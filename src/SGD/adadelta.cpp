@@ -2,37 +2,65 @@
 #include <string.h>
 #include "sgd.h"
 
-adadelta::adadelta (ConfReader *confReader, int paramSize) {
+adadelta::adadelta (ConfReader *confReader, long paramSize) {
 	m_nParamSize = paramSize;	
 	m_decayFactor = confReader->getFloat("adadelta decay factor");
 	m_stableConst = confReader->getFloat("adadelta stable const");
-	m_useMomentum  = confReader->getInt("use momentum");
+	initMomentum(confReader);
+	m_stepCount = 0;
 
 	m_ESquareGrad  = new float [m_nParamSize];
 	m_ESquareDelta = new float [m_nParamSize];
+	m_lastTouch = NULL;
 
 	memset(m_ESquareGrad, 0x00, sizeof(float) * m_nParamSize);
 	memset(m_ESquareDelta, 0x00, sizeof(float) * m_nParamSize);
 }
 
 adadelta::~adadelta () {
-	if (!m_ESquareGrad) {
+	if (m_ESquareGrad != NULL) {
 		delete [] m_ESquareGrad;
 	}
-	if (!m_ESquareDelta) {
+	if (m_ESquareDelta != NULL) {
 		delete [] m_ESquareDelta;
 	}
+	if (m_lastTouch != NULL) {
+		delete [] m_lastTouch;
+	}
 }
 
 void adadelta::updateParams (float *params, float *grad, int rank) {
-	float delta;
-	for (int i=0; i<m_nParamSize; i++) {
-		// accumulate mean squared grad
-		m_ESquareGrad[i] = m_decayFactor * m_ESquareGrad[i] + (1 - m_decayFactor) * grad[i] * grad[i];
-		// compute delta
-		delta = sqrt(m_ESquareDelta[i] + m_stableConst) / sqrt(m_ESquareGrad[i] + m_stableConst) * grad[i];
-		params[i] -= delta;
-		// accumulate mean squared delta
-		m_ESquareDelta[i] = m_decayFactor * m_ESquareDelta[i] + (1 - m_decayFactor) * delta * delta;
+	m_stepCount += 1;
+	if (m_lastTouch != NULL) {
+		// back from sparse updates: decay the entries they skipped once, dense updates touch every entry
+		for (long i=0; i<m_nParamSize; i++) {
+			float catchUp = powf(m_decayFactor, m_stepCount - 1 - m_lastTouch[i]);
+			m_ESquareGrad[i] *= catchUp;
+			m_ESquareDelta[i] *= catchUp;
+		}
+		delete [] m_lastTouch;
+		m_lastTouch = NULL;
+	}
+	// accumulate mean squared grad, apply delta, accumulate mean squared delta
+	float scale = clipScale(grad);
+	kernel_adadelta_table[m_useMomentum][scale < 1.f](params, grad, scale, m_ESquareGrad, m_ESquareDelta, m_decayFactor, m_stableConst, m_nParamSize, momentum(rank));
+}
+
+void adadelta::updateSparse (float *params, int nnz, int *index, float *value, int rank) {
+	// momentum moves every param, so it needs the dense path
+	if (m_useMomentum) {
+		sgdBase::updateSparse(params, nnz, index, value, rank);
+		return;
+	}
+	if (m_lastTouch == NULL) {
+		m_lastTouch = new int [m_nParamSize];
+		for (long i=0; i<m_nParamSize; i++) {
+			m_lastTouch[i] = m_stepCount;
+		}
 	}
+	m_stepCount += 1;
+	momentum(rank);
+	clipSparse(nnz, value);
+	kernel_sparse_adadelta(params, index, value, m_ESquareGrad, m_ESquareDelta, m_lastTouch, m_stepCount,
+		m_decayFactor, m_stableConst, nnz);
 }
\ No newline at end of file
@@ -1,20 +1,20 @@
 #include <string.h>
 #include "sgd.h"
 
-adagrad::adagrad (ConfReader *confReader, int paramSize) {
+adagrad::adagrad (ConfReader *confReader, long paramSize) {
 	m_nParamSize = paramSize;
 	m_learningRate = confReader->getFloat("learning rate");
-	m_useMomentum  = confReader->getInt("use momentum");
+	initMomentum(confReader);
 	m_stepCount = 0;
 
 	m_histSquareGrad = new float [m_nParamSize];
-	for (int i=0; i<m_nParamSize; i++) {
+	for (long i=0; i<m_nParamSize; i++) {
 		m_histSquareGrad[i] = 1.f;
 	}
 }
 
 adagrad::~adagrad () {
-	if (!m_histSquareGrad) {
+	if (m_histSquareGrad != NULL) {
 		delete [] m_histSquareGrad;
 	}
 }
@@ -24,13 +24,11 @@ void adagrad::updateParams (float *params, float *grad, int rank) {
 	
 	// printf("step[%d]: rank %d\n", m_stepCount, rank);
 
-	for (int i=0; i<m_nParamSize; i++) {
-		m_histSquareGrad[i] += grad[i] * grad[i];
-		params[i] -= m_learningRate * grad[i] / sqrt(m_histSquareGrad[i]);
-	}
+	float scale = clipScale(grad);
+	kernel_adagrad_table[m_useMomentum][scale < 1.f](params, grad, scale, m_histSquareGrad, m_learningRate, m_nParamSize, momentum(rank));
 	
 	// float sum = 0.f;
-	// for (int i=0; i<m_nParamSize; i++) {
+	// for (long i=0; i<m_nParamSize; i++) {
 	// 	m_histSquareGrad[i] += grad[i] * grad[i];
 	// 	sum += sqrt(m_histSquareGrad[i]);
 	// }
@@ -38,7 +36,19 @@ void adagrad::updateParams (float *params, float *grad, int rank) {
 	// float rate = m_learningRate * sum / sqrt(sqrt(m_stepCount));
 	// printf("step[%d]: sum %f, rate %f, m_learningRate %f\n", m_stepCount, sum, rate, m_learningRate);
 	
-	// for (int i=0; i<m_nParamSize; i++) {
+	// for (long i=0; i<m_nParamSize; i++) {
 	// 	params[i] -= rate * grad[i] / sqrt(m_histSquareGrad[i]);
 	// }
+}
+
+void adagrad::updateSparse (float *params, int nnz, int *index, float *value, int rank) {
+	// momentum moves every param, so it needs the dense path
+	if (m_useMomentum) {
+		sgdBase::updateSparse(params, nnz, index, value, rank);
+		return;
+	}
+	m_stepCount += 1;
+	momentum(rank);
+	clipSparse(nnz, value);
+	kernel_sparse_adagrad(params, index, value, m_histSquareGrad, m_learningRate, nnz);
 }
\ No newline at end of file
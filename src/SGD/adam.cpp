@@ -0,0 +1,59 @@
+#include <math.h>
+#include <string.h>
+#include "sgd.h"
+
+/****************************************************************
+* adam
+****************************************************************/
+
+adam::adam (ConfReader *confReader, long paramSize) {
+	m_stepCount = 0;
+	m_nParamSize = paramSize;
+	m_learningRate = confReader->getFloat("learning rate");
+	m_beta1 = confReader->getFloat("adam beta1");
+	m_beta2 = confReader->getFloat("adam beta2");
+	m_epsilon = confReader->getFloat("adam epsilon");
+	m_weightDecay = 0.f;
+	initMomentum(confReader);
+
+	m_beta1Power = 1.f;
+	m_beta2Power = 1.f;
+
+	m_firstMoment  = new float [m_nParamSize];
+	m_secondMoment = new float [m_nParamSize];
+
+	memset(m_firstMoment, 0x00, sizeof(float) * m_nParamSize);
+	memset(m_secondMoment, 0x00, sizeof(float) * m_nParamSize);
+}
+
+adam::~adam () {
+	if (m_firstMoment != NULL) {
+		delete [] m_firstMoment;
+	}
+	if (m_secondMoment != NULL) {
+		delete [] m_secondMoment;
+	}
+}
+
+void adam::updateParams (float *params, float *grad, int rank) {
+	m_stepCount += 1;
+	m_beta1Power *= m_beta1;
+	m_beta2Power *= m_beta2;
+	float correct1 = 1.f / (1.f - m_beta1Power);
+	float correct2 = 1.f / (1.f - m_beta2Power);
+	float scale = clipScale(grad);
+	kernel_adam_table[m_useMomentum][m_weightDecay != 0.f][scale < 1.f](params, grad, scale, m_firstMoment, m_secondMoment, m_beta1, m_beta2, correct1, correct2,
+		m_epsilon, m_learningRate, m_weightDecay, m_nParamSize, momentum(rank));
+}
+
+/****************************************************************
+* adamW
+****************************************************************/
+
+adamW::adamW (ConfReader *confReader, long paramSize): adam(confReader, paramSize) {
+	m_weightDecay = confReader->getFloat("weight decay");
+}
+
+adamW::~adamW () {
+	// moments are released by adam
+}
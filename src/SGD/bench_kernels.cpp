@@ -0,0 +1,260 @@
+/****************************************************************
+* Microbenchmark of the fused solver kernels against the loops
+* they replaced. Usage: bench_kernels [paramSize] [nSlave] [reps]
+* Reports ns/param and effective GB/s (bytes of every array read
+* and written once per update) plus the largest (1 + abs) relative
+* difference of the params after one update.
+****************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <sys/time.h>
+#include <map>
+#include <vector>
+
+#include "sgd_kernel.h"
+
+static double wallTime () {
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec + tv.tv_usec * 1e-6;
+}
+
+static void fillRand (float *buffer, int dim, float lo, float hi) {
+	for (int i=0; i<dim; ++i) {
+		buffer[i] = lo + (hi - lo) * ((float) rand() / RAND_MAX);
+	}
+}
+
+static float maxRelDiff (float *a, float *b, int dim) {
+	float maxDiff = 0.f;
+	for (int i=0; i<dim; ++i) {
+		float diff = fabs(a[i] - b[i]) / (fabs(b[i]) + 1.f);
+		if (diff > maxDiff) {
+			maxDiff = diff;
+		}
+	}
+	return maxDiff;
+}
+
+/****************************************************************
+* Reference loops (the solver code before the fused kernels)
+****************************************************************/
+
+static void ref_adagrad (float *params, float *grad, float *hist, float rate, int dim) {
+	for (int i=0; i<dim; i++) {
+		hist[i] += grad[i] * grad[i];
+		params[i] -= rate * grad[i] / sqrt(hist[i]);
+	}
+}
+
+static void ref_delayed_adagrad (float *params, float *grad, float *hist, std::map<int, float*> &mapHist, int rank, float rate, int dim) {
+	for (int i=0; i<dim; i++) {
+		hist[i] += grad[i] * grad[i];
+		mapHist[rank][i] += grad[i] * grad[i];
+		params[i] -= rate * grad[i] / sqrt(mapHist[rank][i]);
+	}
+	memcpy(mapHist[rank], hist, sizeof(float) * dim);
+}
+
+static void ref_rmsprop (float *params, float *grad, float *meanSquare, float decay, int dim) {
+	for (int i=0; i<dim; i++) {
+		meanSquare[i] = decay * meanSquare[i] + (1 - decay) * grad[i] * grad[i];
+		params[i] -= grad[i] / sqrt(meanSquare[i]);
+	}
+}
+
+static void ref_adadelta (float *params, float *grad, float *Eg, float *Ed, float decay, float c, int dim) {
+	float delta;
+	for (int i=0; i<dim; i++) {
+		Eg[i] = decay * Eg[i] + (1 - decay) * grad[i] * grad[i];
+		delta = sqrt(Ed[i] + c) / sqrt(Eg[i] + c) * grad[i];
+		params[i] -= delta;
+		Ed[i] = decay * Ed[i] + (1 - decay) * delta * delta;
+	}
+}
+
+static void ref_kernel_adadelta (float *params, float *grad, float *Eg, float *Ed, std::map<int, float*> &mapEg,
+	std::map<int, float*> &mapEd, std::map<int, float> &factor, int nSlave, int rank, float decay, float c, int dim) {
+	float delta;
+	for (int slaveId=1; slaveId<=nSlave; slaveId++) {
+		factor[slaveId] *= decay;
+	}
+	for (int i=0; i<dim; i++) {
+		float gradSqr_i = grad[i] * grad[i];
+		Eg[i] = decay * Eg[i] + (1 - decay) * gradSqr_i;
+		for (int slaveId=1; slaveId<=nSlave; slaveId++) {
+			mapEg[slaveId][i] += factor[slaveId] * gradSqr_i;
+			mapEg[slaveId][i] *= 0.8;
+		}
+		delta = sqrt(mapEd[rank][i] + c) / sqrt(mapEg[rank][i] + c) * grad[i];
+		params[i] -= delta;
+		float deltaSqr_i = delta * delta;
+		Ed[i] = decay * Ed[i] + (1 - decay) * deltaSqr_i;
+		for (int slaveId=1; slaveId<=nSlave; slaveId++) {
+			mapEd[slaveId][i] += factor[slaveId] * deltaSqr_i;
+			mapEd[slaveId][i] *= 0.8;
+		}
+	}
+	memcpy(mapEg[rank], Eg, sizeof(float)*dim);
+	memcpy(mapEd[rank], Ed, sizeof(float)*dim);
+	factor[rank] = (1 - decay);
+}
+
+static void ref_adam (float *params, float *grad, float *m, float *v, float beta1, float beta2, int step,
+	float eps, float rate, float weightDecay, int dim) {
+	for (int i=0; i<dim; i++) {
+		m[i] = beta1 * m[i] + (1 - beta1) * grad[i];
+		v[i] = beta2 * v[i] + (1 - beta2) * grad[i] * grad[i];
+		float mHat = m[i] / (1 - pow(beta1, step));
+		float vHat = v[i] / (1 - pow(beta2, step));
+		params[i] -= rate * (mHat / (sqrt(vHat) + eps) + weightDecay * params[i]);
+	}
+}
+
+/****************************************************************
+* Driver
+****************************************************************/
+
+struct benchState {
+	int dim;
+	int nSlave;
+	float *params;
+	float *grad;
+	float *stateA;
+	float *stateB;
+	float *histA;
+	float *histB;
+	std::vector<float *> slaveA;
+	std::vector<float *> slaveB;
+	std::map<int, float*> mapA;
+	std::map<int, float*> mapB;
+	std::map<int, float> factor;
+};
+
+static void resetState (benchState &s) {
+	srand(1);
+	fillRand(s.params, s.dim, -1.f, 1.f);
+	fillRand(s.grad, s.dim, -0.1f, 0.1f);
+	fillRand(s.stateA, s.dim, 0.1f, 1.f);
+	fillRand(s.stateB, s.dim, 0.1f, 1.f);
+	memset(s.histA, 0x00, sizeof(float) * s.dim);
+	memset(s.histB, 0x00, sizeof(float) * s.dim);
+	for (int slaveId=1; slaveId<=s.nSlave; ++slaveId) {
+		fillRand(s.slaveA[slaveId], s.dim, 0.1f, 1.f);
+		fillRand(s.slaveB[slaveId], s.dim, 0.1f, 1.f);
+		s.mapA[slaveId] = s.slaveA[slaveId];
+		s.mapB[slaveId] = s.slaveB[slaveId];
+		s.factor[slaveId] = 0.05f;
+	}
+}
+
+// which = 0: reference loop, 1: fused kernel
+static void runOnce (benchState &s, int solver, int which) {
+	int rank = 1;
+	switch (solver) {
+		case 0:
+			if (which == 0) ref_adagrad(s.params, s.grad, s.stateA, 0.01f, s.dim);
+			else kernel_adagrad(s.params, s.grad, s.stateA, 0.01f, s.dim, NULL);
+			break;
+		case 1:
+			if (which == 0) ref_delayed_adagrad(s.params, s.grad, s.stateA, s.mapA, rank, 0.01f, s.dim);
+			else kernel_delayed_adagrad(s.params, s.grad, s.stateA, s.slaveA[rank], 0.01f, s.dim, NULL);
+			break;
+		case 2:
+			if (which == 0) ref_rmsprop(s.params, s.grad, s.stateA, 0.9f, s.dim);
+			else kernel_rmsprop(s.params, s.grad, s.stateA, 0.9f, s.dim, NULL);
+			break;
+		case 3:
+			if (which == 0) ref_adadelta(s.params, s.grad, s.stateA, s.stateB, 0.9f, 1e-6f, s.dim);
+			else kernel_adadelta(s.params, s.grad, s.stateA, s.stateB, 0.9f, 1e-6f, s.dim, NULL);
+			break;
+		case 4:
+			if (which == 0) {
+				ref_kernel_adadelta(s.params, s.grad, s.stateA, s.stateB, s.mapA, s.mapB, s.factor, s.nSlave, rank, 0.9f, 1e-6f, s.dim);
+			} else {
+				// the sender's snapshots one update after a reset with f = 0.05, empty history
+				float weight = 0.05f / (1 - 0.9f) * 0.8f;
+				kernel_kernel_adadelta(s.params, s.grad, s.stateA, s.stateB, s.histA, s.histB, s.slaveA[rank], s.slaveB[rank],
+					0.8f, weight * 0.9f, 1.f, weight, 0.9f, 0.8f, 1e-6f, s.dim, NULL);
+			}
+			break;
+		case 5:
+			// bias corrections of the 10th step
+			if (which == 0) ref_adam(s.params, s.grad, s.stateA, s.stateB, 0.9f, 0.999f, 10, 1e-8f, 0.001f, 0.01f, s.dim);
+			else kernel_adam(s.params, s.grad, s.stateA, s.stateB, 0.9f, 0.999f, 1.f / (1.f - powf(0.9f, 10)),
+				1.f / (1.f - powf(0.999f, 10)), 1e-8f, 0.001f, 0.01f, s.dim, NULL);
+			break;
+	}
+}
+
+int main (int argc, char **argv) {
+	int dim = (argc > 1) ? atoi(argv[1]) : (1 << 22);
+	int nSlave = (argc > 2) ? atoi(argv[2]) : 4;
+	int reps = (argc > 3) ? atoi(argv[3]) : 10;
+
+	const char *names[] = {"adagrad", "delayedAdagrad", "rmsprop", "adadelta", "kernelAdadelta", "adamW"};
+	// floats read + written per param and update
+	double loopWords[] = {5, 6, 5, 7, 7 + 4.0 * nSlave, 7};
+	double kernelWords[] = {5, 6, 5, 7, 15, 7};
+
+	benchState s;
+	s.dim = dim;
+	s.nSlave = nSlave;
+	s.params = new float[dim];
+	s.grad = new float[dim];
+	s.stateA = new float[dim];
+	s.stateB = new float[dim];
+	s.histA = new float[dim];
+	s.histB = new float[dim];
+	s.slaveA.assign(nSlave+1, (float *) NULL);
+	s.slaveB.assign(nSlave+1, (float *) NULL);
+	for (int slaveId=1; slaveId<=nSlave; ++slaveId) {
+		s.slaveA[slaveId] = new float[dim];
+		s.slaveB[slaveId] = new float[dim];
+	}
+	float *refParams = new float[dim];
+
+	printf("kernels: %s, params: %d, slaves: %d, reps: %d\n", SGD_KERNEL_ISA, dim, nSlave, reps);
+	printf("%-16s %12s %12s %10s %10s %8s %12s\n", "solver", "loop ns/p", "kernel ns/p", "loop GB/s", "kern GB/s", "speedup", "max rel diff");
+	for (int solver=0; solver<6; ++solver) {
+		double seconds[2];
+		for (int which=0; which<2; ++which) {
+			resetState(s);
+			runOnce(s, solver, which);
+			if (which == 0) {
+				memcpy(refParams, s.params, sizeof(float) * dim);
+			}
+			double start = wallTime();
+			for (int rep=0; rep<reps; ++rep) {
+				runOnce(s, solver, which);
+			}
+			seconds[which] = (wallTime() - start) / reps;
+		}
+		// first update from the same state, reference vs kernel
+		resetState(s);
+		runOnce(s, solver, 1);
+		float diff = maxRelDiff(s.params, refParams, dim);
+
+		double loopBytes = loopWords[solver] * sizeof(float) * dim;
+		double kernelBytes = kernelWords[solver] * sizeof(float) * dim;
+		printf("%-16s %12.3f %12.3f %10.2f %10.2f %7.2fx %12.2e\n", names[solver],
+			seconds[0] * 1e9 / dim, seconds[1] * 1e9 / dim,
+			loopBytes / seconds[0] * 1e-9, kernelBytes / seconds[1] * 1e-9, seconds[0] / seconds[1], diff);
+	}
+
+	for (int slaveId=1; slaveId<=nSlave; ++slaveId) {
+		delete [] s.slaveA[slaveId];
+		delete [] s.slaveB[slaveId];
+	}
+	delete [] s.params;
+	delete [] s.grad;
+	delete [] s.stateA;
+	delete [] s.stateB;
+	delete [] s.histA;
+	delete [] s.histB;
+	delete [] refParams;
+	return 0;
+}
@@ -0,0 +1,184 @@
+/****************************************************************
+* Throughput of every sgdBase solver on its own, no MPI: each
+* updateParams call gets a synthetic grad from ranks 1..nSlave in
+* turn, for 10K to 100M params and 1 to 64 slaves.
+* Usage: bench_solvers [maxParams] [maxSlaves] [memoryMB] [momentum] [adadelta decay]
+* Reports ns/param, effective GB/s (every array the update reads or
+* writes, counted once) and the scaling of ns/param against the
+* smallest size (same slaves) and against one slave (same size).
+* Configurations whose state would not fit in memoryMB are skipped.
+* kernelAdadelta restarts its history more often for an adadelta
+* decay below its slave decay 0.8 and keeps it in double then, e.g.
+* 0.3 shows how that scales with slaves (GB/s counts floats only).
+* For the scalar path rebuild with ARCHFLAGS= (make clean first).
+****************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <sys/time.h>
+#include <vector>
+
+#include "sgd.h"
+
+static double wallTime () {
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec + tv.tv_usec * 1e-6;
+}
+
+// |g| in [0.01, 0.1], no zero grads (rmsprop has no epsilon)
+static void fillGrad (float *buffer, long dim) {
+	for (long i=0; i<dim; ++i) {
+		float g = 0.01f + 0.09f * ((float) rand() / RAND_MAX);
+		buffer[i] = (rand() & 1) ? g : -g;
+	}
+}
+
+/****************************************************************
+* Solvers: constructor, floats per param of state (params and grad
+* included, fixed plus per slave) and floats moved per update
+****************************************************************/
+
+struct benchSolver {
+	const char *name;
+	int fixedWords;
+	int slaveWords;
+	int updateWords;
+};
+
+// same numbering as "solver type"
+static const benchSolver benchSolvers[] = {
+	{"sgd",             2, 0, 3},
+	{"adagrad",         3, 0, 5},
+	{"adadelta",        4, 0, 7},
+	{"rmsprop",         3, 0, 5},
+	{"kernelAdadelta",  6, 2, 15},
+	{"delayedAdagrad",  3, 1, 7},
+	{"futureAdagrad",   3, 1, 7},
+	{"delayedAdadelta", 4, 2, 10},
+	{"adam",            4, 0, 7},
+	{"adamW",           4, 0, 7},
+	{"lamb",            4, 0, 10},
+};
+
+static sgdBase * newSolver (int type, ConfReader *confReader, long paramSize, int nSlave,
+	std::vector<long> &layerOffset, std::vector<long> &layerSize) {
+	switch (type) {
+		case 0: return new sgdBasic(confReader, paramSize);
+		case 1: return new adagrad(confReader, paramSize);
+		case 2: return new adadelta(confReader, paramSize);
+		case 3: return new rmsprop(confReader, paramSize);
+		case 4: return new kernelAdadelta(confReader, paramSize, nSlave);
+		case 5: return new delayedAdagrad(confReader, paramSize, nSlave);
+		case 6: return new futureAdagrad(confReader, paramSize, nSlave);
+		case 7: return new DelayedAdadelta(confReader, paramSize, nSlave);
+		case 8: return new adam(confReader, paramSize);
+		case 9: return new adamW(confReader, paramSize);
+		case 10: return new lamb(confReader, paramSize, layerOffset, layerSize);
+	}
+	return NULL;
+}
+
+static ConfReader * writeConf (int useMomentum, float adadeltaDecay) {
+	const char *confPath = "bench_solvers.conf";
+	FILE *conf = fopen(confPath, "w");
+	fprintf(conf, "[Master]\nlearning rate = 0.001\n");
+	fprintf(conf, "adadelta decay factor = %f\nadadelta stable const = 0.0001\nrmsprop decay factor = 0.5\n", adadeltaDecay);
+	fprintf(conf, "use momentum = %d\nmomentum factor = 0.9\nmomentum staleness adjust = 1\n", useMomentum);
+	fprintf(conf, "clip gradient norm = 0\n");
+	fprintf(conf, "history versions = 0\nhistory fp16 = 0\n");
+	fprintf(conf, "adam beta1 = 0.9\nadam beta2 = 0.999\nadam epsilon = 0.00000001\nweight decay = 0.01\n");
+	fclose(conf);
+	return new ConfReader(confPath, "Master");
+}
+
+// seconds per update, at least 3 updates and 0.2s after one warm-up round over the slaves
+static double timeSolver (sgdBase *solver, float *params, float *grad, int nSlave) {
+	for (int rank=1; rank<=nSlave; ++rank) {
+		solver->updateParams(params, grad, rank);
+	}
+	int reps = 0;
+	double start = wallTime();
+	double elapsed = 0.0;
+	while (reps < 3 || elapsed < 0.2) {
+		solver->updateParams(params, grad, 1 + reps % nSlave);
+		reps += 1;
+		elapsed = wallTime() - start;
+	}
+	return elapsed / reps;
+}
+
+int main (int argc, char **argv) {
+	long maxParams = (argc > 1) ? atol(argv[1]) : 100000000L;
+	int maxSlaves = (argc > 2) ? atoi(argv[2]) : 64;
+	double memoryMB = (argc > 3) ? atof(argv[3]) : 4096.0;
+	int useMomentum = (argc > 4) ? atoi(argv[4]) : 0;
+	float adadeltaDecay = (argc > 5) ? atof(argv[5]) : 0.8f;
+
+	std::vector<long> sizes;
+	for (long size=10000; size<=maxParams; size*=10) {
+		sizes.push_back(size);
+	}
+	std::vector<int> slaves;
+	for (int nSlave=1; nSlave<=maxSlaves; nSlave*=4) {
+		slaves.push_back(nSlave);
+	}
+	int nSolver = sizeof(benchSolvers) / sizeof(benchSolvers[0]);
+
+	ConfReader *confReader = writeConf(useMomentum, adadeltaDecay);
+	long maxSize = sizes.back();
+	float *params = new float[maxSize];
+	float *grad = new float[maxSize];
+	srand(1);
+	fillGrad(grad, maxSize);
+
+	printf("kernels: %s, momentum: %d, adadelta decay: %.2f, memory budget: %.0f MB\n", SGD_KERNEL_ISA, useMomentum,
+		adadeltaDecay, memoryMB);
+	printf("%-16s %10s %6s %10s %8s %8s %8s\n", "solver", "params", "slaves", "ns/param", "GB/s", "x size", "x slaves");
+	for (int type=0; type<nSolver; ++type) {
+		const benchSolver &info = benchSolvers[type];
+		// ns/param by [size][slaves], 0 when skipped
+		std::vector<std::vector<double> > nsParam(sizes.size(), std::vector<double>(slaves.size(), 0.0));
+		for (int s=0; s<(int) sizes.size(); ++s) {
+			int dim = (int) sizes[s];
+			// lamb sees 8 equal layers
+			std::vector<long> layerOffset, layerSize;
+			for (int layer=0; layer<8; ++layer) {
+				layerOffset.push_back((long) dim * layer / 8);
+				layerSize.push_back((long) dim * (layer+1) / 8 - layerOffset.back());
+			}
+			for (int k=0; k<(int) slaves.size(); ++k) {
+				int nSlave = slaves[k];
+				int words = info.fixedWords + info.slaveWords * nSlave + (useMomentum ? 1 : 0);
+				double stateMB = (double) words * sizeof(float) * dim / (1 << 20);
+				if (stateMB > memoryMB) {
+					printf("%-16s %10d %6d   skipped (%.0f MB)\n", info.name, dim, nSlave, stateMB);
+					continue;
+				}
+				for (int i=0; i<dim; ++i) {
+					params[i] = 0.1f;
+				}
+				sgdBase *solver = newSolver(type, confReader, dim, nSlave, layerOffset, layerSize);
+				double seconds = timeSolver(solver, params, grad, nSlave);
+				delete solver;
+
+				nsParam[s][k] = seconds * 1e9 / dim;
+				int moved = info.updateWords + (useMomentum ? 2 : 0);
+				double gbs = (double) moved * sizeof(float) * dim / seconds * 1e-9;
+				printf("%-16s %10d %6d %10.3f %8.2f", info.name, dim, nSlave, nsParam[s][k], gbs);
+				if (nsParam[0][k] > 0.0) printf(" %8.2f", nsParam[s][k] / nsParam[0][k]);
+				else printf(" %8s", "-");
+				if (nsParam[s][0] > 0.0) printf(" %8.2f\n", nsParam[s][k] / nsParam[s][0]);
+				else printf(" %8s\n", "-");
+			}
+		}
+	}
+
+	delete [] params;
+	delete [] grad;
+	delete confReader;
+	remove("bench_solvers.conf");
+	return 0;
+}
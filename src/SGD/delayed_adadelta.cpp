@@ -1,67 +1,43 @@
+#include <string.h>
 #include "sgd.h"
 
 #include <math.h>
 
-DelayedAdadelta::DelayedAdadelta (ConfReader *confReader, int paramSize) {
+DelayedAdadelta::DelayedAdadelta (ConfReader *confReader, long paramSize, int nSlave) {
 	m_nParamSize = paramSize;	
 	m_decayFactor = confReader->getFloat("adadelta decay factor");
 	m_stableConst = confReader->getFloat("adadelta stable const");
-	m_useMomentum  = confReader->getInt("use momentum");
-	int nProc;
-    MPI_Comm_size(MPI_COMM_WORLD, &nProc);
-    m_numSlave = nProc - 1;
+	initMomentum(confReader);
+	m_numSlave = nSlave;
+	m_stepCount = 0;
 	m_ESquareGrad  = new float [m_nParamSize];
 	m_ESquareDelta = new float [m_nParamSize];
 
 	memset(m_ESquareGrad, 0x00, sizeof(float) * m_nParamSize);
 	memset(m_ESquareDelta, 0x00, sizeof(float) * m_nParamSize);
 
-	//initialize grad map
-    for (int i=1; i<=m_numSlave; i++) {
-    	float *histSquareGrad = new float [m_nParamSize];
-    	for (int j=0; j<m_nParamSize; j++) {
-			histSquareGrad[j] = 0.1f;
-		}
-    	m_mapHistSquareGrad[i] = histSquareGrad;
-    }
-    //Initialize delta map
-    for (int i=1; i<=m_numSlave; i++) {
-    	float *histSquareDelta = new float [m_nParamSize];
-    	for (int j=0; j<m_nParamSize; j++) {
-			histSquareDelta[j] = 0.1f;
-		}
-    	m_mapHistSquareDelta[i] = histSquareDelta;
-    }    	
+	//initialize grad snapshots
+	m_history = new historyStore(confReader, m_nParamSize, m_numSlave, 1, 0.1f);
 }
 
 DelayedAdadelta::~DelayedAdadelta () {
-	if (!m_ESquareGrad) {
+	if (m_ESquareGrad != NULL) {
 		delete [] m_ESquareGrad;
 	}
-	if (!m_ESquareDelta) {
+	if (m_ESquareDelta != NULL) {
 		delete [] m_ESquareDelta;
 	}
-	for (int i=1; i<=m_numSlave; ++i) {    	
-    	delete [] m_mapHistSquareGrad[i];
-    }
-    for (int i=1; i<=m_numSlave; ++i) {    	
-    	delete [] m_mapHistSquareDelta[i];
-    }
+	delete m_history;
 }
 
 void DelayedAdadelta::updateParams (float *params, float *grad, int rank) {
-	float delta;
 	//printf("Start updateParams\n");
-	for (int i=0; i<m_nParamSize; i++) {
-		// accumulate mean squared grad
-		m_ESquareGrad[i] = m_decayFactor * m_ESquareGrad[i] + (1 - m_decayFactor) * grad[i] * grad[i];
-		// compute delta
-		delta = sqrt(m_mapHistSquareGrad[rank][i] + m_stableConst) / sqrt(m_mapHistSquareGrad[rank][i] + m_stableConst) * grad[i];
-		params[i] -= delta;
-		// accumulate mean squared delta
-		m_ESquareDelta[i] = m_decayFactor * m_ESquareDelta[i] + (1 - m_decayFactor) * delta * delta;
-	}
-	memcpy(m_mapHistSquareGrad[rank], m_ESquareGrad, sizeof(float) * m_nParamSize);
-	memcpy(m_mapHistSquareDelta[rank], m_ESquareDelta, sizeof(float) * m_nParamSize);
+	// the slave's snapshot is refreshed inside the kernel
+	m_stepCount += 1;
+	float *slaveGrad = m_history->open(rank, 0);
+	float scale = clipScale(grad);
+	kernel_delayed_adadelta_table[m_useMomentum][scale < 1.f](params, grad, scale, m_ESquareGrad, m_ESquareDelta, slaveGrad,
+		m_decayFactor, m_stableConst, m_nParamSize, momentum(rank));
+	m_history->close(rank, m_stepCount, 1.f);
 	//printf("Finish updateParams\n");
 }
\ No newline at end of file
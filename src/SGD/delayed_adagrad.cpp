@@ -2,43 +2,33 @@
 #include <string.h>
 #include "sgd.h"
 
-delayedAdagrad::delayedAdagrad (ConfReader *confReader, int paramSize) {
+delayedAdagrad::delayedAdagrad (ConfReader *confReader, long paramSize, int nSlave) {
 	m_nParamSize = paramSize;
 	m_learningRate = confReader->getFloat("learning rate");
-	m_useMomentum  = confReader->getInt("use momentum");
+	initMomentum(confReader);
 
 	m_histSquareGrad = new float [m_nParamSize];
-	for (int i=0; i<m_nParamSize; i++) {
+	for (long i=0; i<m_nParamSize; i++) {
 		m_histSquareGrad[i] = 0.1f;
 	}
 
-	int nProc;
-    MPI_Comm_size(MPI_COMM_WORLD, &nProc);
-    m_nSlave = nProc - 1;
-
-    for (int i=1; i<=m_nSlave; ++i) {
-    	float *histSquareGrad = new float [m_nParamSize];
-    	for (int j=0; j<m_nParamSize; j++) {
-			histSquareGrad[j] = 0.1f;
-		}
-    	m_mapHistSquareGrad[i] = histSquareGrad;
-    }
+	m_nSlave = nSlave;
+	m_stepCount = 0;
+	m_history = new historyStore(confReader, m_nParamSize, m_nSlave, 1, 0.1f);
 }
 
 delayedAdagrad::~delayedAdagrad () {
-	if (!m_histSquareGrad) {
+	if (m_histSquareGrad != NULL) {
 		delete [] m_histSquareGrad;
 	}
-	for (int i=1; i<=m_nSlave; ++i) {    	
-    	delete [] m_mapHistSquareGrad[i];
-    }
+	delete m_history;
 }
 
 void delayedAdagrad::updateParams (float *params, float *grad, int rank) {
-	for (int i=0; i<m_nParamSize; i++) {
-		m_histSquareGrad[i] += grad[i] * grad[i];
-		m_mapHistSquareGrad[rank][i] += grad[i] * grad[i];
-		params[i] -= m_learningRate * grad[i] / sqrt(m_mapHistSquareGrad[rank][i]);
-	}
-	memcpy(m_mapHistSquareGrad[rank], m_histSquareGrad, sizeof(float) * m_nParamSize);
+	// the slave's snapshot is refreshed inside the kernel
+	m_stepCount += 1;
+	float *slaveHist = m_history->open(rank, 0);
+	float scale = clipScale(grad);
+	kernel_delayed_adagrad_table[m_useMomentum][scale < 1.f](params, grad, scale, m_histSquareGrad, slaveHist, m_learningRate, m_nParamSize, momentum(rank));
+	m_history->close(rank, m_stepCount, 1.f);
 }
\ No newline at end of file
@@ -2,42 +2,33 @@
 #include <string.h>
 #include "sgd.h"
 
-futureAdagrad::futureAdagrad (ConfReader *confReader, int paramSize) {
+futureAdagrad::futureAdagrad (ConfReader *confReader, long paramSize, int nSlave) {
 	m_nParamSize = paramSize;
 	m_learningRate = confReader->getFloat("learning rate");
-	m_useMomentum  = confReader->getInt("use momentum");
+	initMomentum(confReader);
 
 	m_histSquareGrad = new float [m_nParamSize];
-	for (int i=0; i<m_nParamSize; i++) {
+	for (long i=0; i<m_nParamSize; i++) {
 		m_histSquareGrad[i] = 0.1f;
 	}
 
-	int nProc;
-    MPI_Comm_size(MPI_COMM_WORLD, &nProc);
-    m_nSlave = nProc - 1;
-
-    for (int rank=1; rank<=m_nSlave; ++rank) {
-    	float *histSquareGrad = new float [m_nParamSize];
-    	memset(histSquareGrad, 0x00, sizeof(float) * m_nParamSize);
-    	m_mapHistSquareGrad[rank] = histSquareGrad;
-    }
+	m_nSlave = nSlave;
+	m_stepCount = 0;
+	m_history = new historyStore(confReader, m_nParamSize, m_nSlave, 1, 0.f);
 }
 
 futureAdagrad::~futureAdagrad () {
-	if (!m_histSquareGrad) {
+	if (m_histSquareGrad != NULL) {
 		delete [] m_histSquareGrad;
 	}
-	for (int i=1; i<=m_nSlave; ++i) {    	
-    	delete [] m_mapHistSquareGrad[i];
-    }
+	delete m_history;
 }
 
 void futureAdagrad::updateParams (float *params, float *grad, int rank) {
-	for (int i=0; i<m_nParamSize; i++) {
-		m_histSquareGrad[i] += grad[i] * grad[i];
-		m_mapHistSquareGrad[rank][i] = m_histSquareGrad[i] - m_mapHistSquareGrad[rank][i];
-		params[i] -= m_learningRate * grad[i] / sqrt(m_mapHistSquareGrad[rank][i] + 0.1f);
-	}
-	printInfo(m_mapHistSquareGrad[rank]);
-	memcpy(m_mapHistSquareGrad[rank], m_histSquareGrad, sizeof(float) * m_nParamSize);
+	// the slave's snapshot is refreshed inside the kernel
+	m_stepCount += 1;
+	float *slaveHist = m_history->open(rank, 0);
+	float scale = clipScale(grad);
+	kernel_future_adagrad_table[m_useMomentum][scale < 1.f](params, grad, scale, m_histSquareGrad, slaveHist, m_learningRate, 0.1f, m_nParamSize, momentum(rank));
+	m_history->close(rank, m_stepCount, 1.f);
 }
\ No newline at end of file
@@ -0,0 +1,179 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "history_store.h"
+#include "sgd_kernel.h"
+
+historyStore::historyStore (ConfReader *confReader, long paramSize, int nSlave, int nArray, float initValue) {
+	m_nParamSize = paramSize;
+	m_nSlave = nSlave;
+	m_nArray = nArray;
+	m_capacity = confReader->getInt("history versions");
+	m_half = confReader->getInt("history fp16") != 0;
+	if (m_capacity <= 0 || m_capacity > m_nSlave) {
+		m_capacity = m_nSlave;
+	}
+	m_openVersion = -1;
+
+	for (int array=0; array<m_nArray; ++array) {
+		m_scratch.push_back(new float [m_nParamSize]);
+	}
+
+	// every slave starts from the same initial snapshot
+	historyVersion initial;
+	initial.refs = m_nSlave;
+	initial.stamp = 0;
+	initial.weight = 1.f;
+	for (int array=0; array<m_nArray; ++array) {
+		initial.data.push_back(allocArray());
+	}
+	m_versions.push_back(initial);
+	for (long i=0; i<m_nParamSize; ++i) {
+		m_scratch[0][i] = initValue;
+	}
+	for (int array=0; array<m_nArray; ++array) {
+		save(0, array, m_scratch[0]);
+	}
+	m_rankVersion.assign(m_nSlave+1, 0);
+}
+
+historyStore::~historyStore () {
+	for (int idx=0; idx<(int) m_versions.size(); ++idx) {
+		for (int array=0; array<m_nArray; ++array) {
+			free(m_versions[idx].data[array]);
+		}
+	}
+	for (int array=0; array<m_nArray; ++array) {
+		delete [] m_scratch[array];
+	}
+}
+
+void *historyStore::allocArray () {
+	size_t elemSize = m_half ? sizeof(unsigned short) : sizeof(float);
+	void *buffer = malloc(elemSize * m_nParamSize);
+	if (buffer == NULL) {
+		printf("Error: history store out of memory.\n");
+		exit(-1);
+	}
+	return buffer;
+}
+
+void historyStore::load (int idx, int array, float *buffer) {
+	void *data = m_versions[idx].data[array];
+	if (m_half) {
+		kernel_from_half(buffer, (unsigned short *) data, m_nParamSize);
+	} else {
+		memcpy(buffer, data, sizeof(float) * m_nParamSize);
+	}
+}
+
+void historyStore::save (int idx, int array, float *buffer) {
+	void *data = m_versions[idx].data[array];
+	if (m_half) {
+		kernel_to_half((unsigned short *) data, buffer, m_nParamSize);
+	} else {
+		memcpy(data, buffer, sizeof(float) * m_nParamSize);
+	}
+}
+
+float *historyStore::open (int rank, int array) {
+	int idx = m_rankVersion[rank];
+	// a float snapshot nobody else holds is rewritten in place, no copies at all
+	if (!m_half && m_versions[idx].refs == 1) {
+		m_openVersion = idx;
+		return (float *) m_versions[idx].data[array];
+	}
+	m_openVersion = -1;
+	load(idx, array, m_scratch[array]);
+	return m_scratch[array];
+}
+
+void historyStore::close (int rank, int stamp, float weight) {
+	int idx = m_rankVersion[rank];
+	if (m_openVersion != idx) {
+		m_versions[idx].refs -= 1;
+		idx = takeSlot();
+		m_versions[idx].refs += 1;
+		for (int array=0; array<m_nArray; ++array) {
+			save(idx, array, m_scratch[array]);
+		}
+		m_rankVersion[rank] = idx;
+	}
+	m_versions[idx].stamp = stamp;
+	m_versions[idx].weight = weight;
+	m_openVersion = -1;
+}
+
+float *historyStore::openVersion (int idx, int array) {
+	if (!m_half) {
+		return (float *) m_versions[idx].data[array];
+	}
+	load(idx, array, m_scratch[array]);
+	return m_scratch[array];
+}
+
+void historyStore::closeVersion (int idx) {
+	if (!m_half) {
+		return;
+	}
+	for (int array=0; array<m_nArray; ++array) {
+		save(idx, array, m_scratch[array]);
+	}
+}
+
+int historyStore::liveVersions () {
+	int count = 0;
+	for (int idx=0; idx<(int) m_versions.size(); ++idx) {
+		count += (m_versions[idx].refs > 0);
+	}
+	return count;
+}
+
+int historyStore::takeSlot () {
+	if (liveVersions() >= m_capacity) {
+		// ring full: the oldest snapshot's slaves move to the next oldest
+		int oldest = -1;
+		int next = -1;
+		for (int idx=0; idx<(int) m_versions.size(); ++idx) {
+			if (m_versions[idx].refs == 0) {
+				continue;
+			}
+			if (oldest < 0 || m_versions[idx].stamp < m_versions[oldest].stamp) {
+				next = oldest;
+				oldest = idx;
+			} else if (next < 0 || m_versions[idx].stamp < m_versions[next].stamp) {
+				next = idx;
+			}
+		}
+		if (next < 0) {
+			// a single slot: its slaves move on to the snapshot about to be written
+			return oldest;
+		}
+		for (int rank=1; rank<=m_nSlave; ++rank) {
+			if (m_rankVersion[rank] == oldest) {
+				m_rankVersion[rank] = next;
+			}
+		}
+		m_versions[next].refs += m_versions[oldest].refs;
+		m_versions[oldest].refs = 0;
+	}
+	for (int idx=0; idx<(int) m_versions.size(); ++idx) {
+		if (m_versions[idx].refs == 0) {
+			return idx;
+		}
+	}
+	historyVersion slot;
+	slot.refs = 0;
+	slot.stamp = 0;
+	slot.weight = 1.f;
+	for (int array=0; array<m_nArray; ++array) {
+		slot.data.push_back(allocArray());
+	}
+	m_versions.push_back(slot);
+	return (int) m_versions.size() - 1;
+}
+
+long historyStore::bytes () {
+	long elemSize = m_half ? sizeof(unsigned short) : sizeof(float);
+	return (long) m_versions.size() * m_nArray * m_nParamSize * elemSize;
+}
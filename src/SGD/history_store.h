@@ -0,0 +1,68 @@
+#ifndef __HISTORY_STORE_H__
+#define __HISTORY_STORE_H__
+
+#include <vector>
+#include "confreader.h"
+
+/****************************************************************
+* Per-slave snapshots of solver accumulators, shared as versions.
+* A slave only holds the index of the version it last saw; slaves
+* that saw the same state share one copy, and at most "history
+* versions" copies are alive (0: one per slave, exact). When the
+* ring is full the oldest version is merged into the next one, i.e.
+* its slaves are treated as a little less stale. With "history
+* fp16" the copies are stored as half floats (finite up to 65504,
+* subnormal below 6e-5), which halves the memory again.
+****************************************************************/
+
+struct historyVersion {
+	int refs;		// slaves whose snapshot this is
+	int stamp;		// update that took the snapshot
+	float weight;	// free for the solver
+	std::vector<void *> data;	// one float or half array per accumulator
+};
+
+class historyStore
+{
+public:
+	historyStore(ConfReader *confReader, long paramSize, int nSlave, int nArray, float initValue);
+	~historyStore();
+
+	/* method */
+	// the rank's snapshot of one accumulator as floats; the caller may overwrite it with the new snapshot
+	float *open (int rank, int array);
+	// the opened arrays become the rank's snapshot, taken at update stamp
+	void close (int rank, int stamp, float weight);
+
+	historyVersion *versionOf (int rank) {return &m_versions[m_rankVersion[rank]];};
+
+	// every live version, e.g. to rescale all snapshots at once
+	int numVersions () {return (int) m_versions.size();};
+	historyVersion *version (int idx) {return &m_versions[idx];};
+	float *openVersion (int idx, int array);
+	void closeVersion (int idx);
+
+	long bytes ();
+
+private:
+	/* data */
+	long m_nParamSize;
+	int m_nSlave;
+	int m_nArray;
+	int m_capacity;
+	bool m_half;
+
+	std::vector<historyVersion> m_versions;	// refs == 0: free slot, memory kept for reuse
+	std::vector<int> m_rankVersion;			// indexed by rank 1..nSlave
+	std::vector<float *> m_scratch;			// decoded or copied arrays handed out by open
+	int m_openVersion;						// version handed out in place, -1: scratch
+
+	/* method */
+	void *allocArray ();
+	void load (int idx, int array, float *buffer);
+	void save (int idx, int array, float *buffer);
+	int takeSlot ();
+	int liveVersions ();
+};
+
+#endif
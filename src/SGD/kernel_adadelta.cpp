@@ -1,79 +1,167 @@
 #include <math.h>
 #include <string.h>
+#include <algorithm>
 #include "sgd.h"
 
-kernelAdadelta::kernelAdadelta (ConfReader *confReader, int paramSize) {
+/****************************************************************
+* Every slave s keeps a snapshot of the averages that decays by c
+* per update and takes f_s * g^2 from every grad, f_s decaying by
+* d. Instead of touching all snapshots on every update, the grad
+* terms go into one global history H = (c/d) * H + (1-d) * g^2 and
+* slave s with its last reset at t0 reads
+*     S_s(t) = c^(t-t0) * K_s + r_s * c * d^(t-t0) * H(t)
+* with K_s = S_s(t0) - r_s * c * H(t0) and r_s = f_s(t0) / (1-d).
+* Only the sender's K is read and rewritten. H is restarted every
+* m_epochLength updates after folding it into the snapshots, which
+* bounds its growth (c > d) and the cancellation in K.
+* When c > d, H grows by c/d per update and the grad terms of a
+* snapshot fade by (d/c)^(t-t0) against its own decay. H is then
+* kept in double and K as a float pair, so H may grow 2^24 times
+* before a restart, and a snapshot whose terms fell below float
+* precision that way is no longer folded (r_s = 0). Both take
+* about log(2^24) / log(c/d) updates, so a restart folds only the
+* slaves that sent in the last epoch or two however short the
+* epoch has to be. K, t0 and r_s live in a historyStore version
+* (data, stamp, weight).
+****************************************************************/
+
+kernelAdadelta::kernelAdadelta (ConfReader *confReader, long paramSize, int nSlave) {
 	m_nParamSize = paramSize;
 	m_decayFactor = confReader->getFloat("adadelta decay factor");
 	m_stableConst = confReader->getFloat("adadelta stable const");
-	m_useMomentum  = confReader->getInt("use momentum");
+	m_slaveDecay = 0.8f;
+	initMomentum(confReader);
 
 	m_ESquareGrad  = new float [m_nParamSize];
 	m_ESquareDelta = new float [m_nParamSize];
-
 	memset(m_ESquareGrad, 0x00, sizeof(float) * m_nParamSize);
 	memset(m_ESquareDelta, 0x00, sizeof(float) * m_nParamSize);
 
-	int nProc;
-    MPI_Comm_size(MPI_COMM_WORLD, &nProc);
-    m_nSlave = nProc - 1;
+	m_nSlave = nSlave;
+	m_stepCount = 0;
+	m_epochStart = 0;
+	m_epochLength = std::max(32, 4 * m_nSlave);
+	m_retireWeight = 0.f;
+	// half float snapshots could not hold the pairs, they keep H within 16x of the averages
+	bool half = confReader->getInt("history fp16") != 0;
+	m_wide = (m_slaveDecay > m_decayFactor) && !half;
+	if (m_slaveDecay > m_decayFactor) {
+		double growth = log((double) m_slaveDecay / m_decayFactor);
+		double headroom = m_wide ? 16777216.0 : 16.0;
+		double precision = half ? 2048.0 : 16777216.0;
+		int growthLimit = (int) (log(headroom) / growth);
+		m_epochLength = std::max(1, std::min(m_epochLength, growthLimit));
+		// r_s = d^k k updates after a reset, the terms it adds then weigh (d/c)^k of the snapshot
+		m_retireWeight = (float) pow((double) m_decayFactor, ceil(log(precision) / growth));
+	}
+
+	m_histSquareGrad = m_histSquareDelta = NULL;
+	m_wideSquareGrad = m_wideSquareDelta = NULL;
+	if (m_wide) {
+		m_wideSquareGrad  = new double [m_nParamSize];
+		m_wideSquareDelta = new double [m_nParamSize];
+		memset(m_wideSquareGrad, 0x00, sizeof(double) * m_nParamSize);
+		memset(m_wideSquareDelta, 0x00, sizeof(double) * m_nParamSize);
+	} else {
+		m_histSquareGrad  = new float [m_nParamSize];
+		m_histSquareDelta = new float [m_nParamSize];
+		memset(m_histSquareGrad, 0x00, sizeof(float) * m_nParamSize);
+		memset(m_histSquareDelta, 0x00, sizeof(float) * m_nParamSize);
+	}
 
-    for (int i=1; i<=m_nSlave; ++i) {
-    	float *ESquareGrad = new float [m_nParamSize];
-    	float *ESquareDelta = new float [m_nParamSize];
-    	m_mapESquareGrad[i] = ESquareGrad;
-    	m_mapESquareDelta[i] = ESquareDelta;
-    	m_factor[i] = 1 - m_decayFactor;
-    }
+	m_history = new historyStore(confReader, m_nParamSize, m_nSlave, m_wide ? 4 : 2, 0.f);
 }
 
 kernelAdadelta::~kernelAdadelta () {
-	if (!m_ESquareGrad) {
+	if (m_ESquareGrad != NULL) {
 		delete [] m_ESquareGrad;
 	}
-	if (!m_ESquareDelta) {
+	if (m_ESquareDelta != NULL) {
 		delete [] m_ESquareDelta;
 	}
-	for (int i=1; i<=m_nSlave; ++i) {
-		if (!m_mapESquareGrad[i]) {
-    		delete [] m_mapESquareGrad[i];
-    	}
-    	if (!m_mapESquareDelta[i]) {
-    		delete [] m_mapESquareDelta[i];
-    	}
-    }    
+	if (m_histSquareGrad != NULL) {
+		delete [] m_histSquareGrad;
+	}
+	if (m_histSquareDelta != NULL) {
+		delete [] m_histSquareDelta;
+	}
+	if (m_wideSquareGrad != NULL) {
+		delete [] m_wideSquareGrad;
+	}
+	if (m_wideSquareDelta != NULL) {
+		delete [] m_wideSquareDelta;
+	}
+	delete m_history;
 }
 
 void kernelAdadelta::updateParams (float *params, float *grad, int rank) {
-	float delta;		
+	m_stepCount += 1;
+	historyVersion *snapshot = m_history->versionOf(rank);
+	int age = m_stepCount - snapshot->stamp;
+	float c = m_slaveDecay;
+	float d = m_decayFactor;
+	float weight = snapshot->weight * c;
 
-	for (int slaveId=1; slaveId<=m_nSlave; slaveId++) {
-		m_factor[slaveId] *= m_decayFactor;
+	// the grad snapshot is read after this update, the delta snapshot before it
+	float *rankGrad = m_history->open(rank, 0);
+	float *rankDelta = m_history->open(rank, 1);
+	float scale = clipScale(grad);
+	if (m_wide) {
+		// H and K nearly cancel, the factors need double as well
+		double weightWide = (double) snapshot->weight * c;
+		kernel_wide_adadelta_table[m_useMomentum][scale < 1.f](params, grad, scale, m_ESquareGrad, m_ESquareDelta,
+			m_wideSquareGrad, m_wideSquareDelta, rankGrad, m_history->open(rank, 2), rankDelta, m_history->open(rank, 3),
+			pow((double) c, age), weightWide * pow((double) d, age), pow((double) c, age - 1), weightWide * pow((double) d, age - 1),
+			d, c, m_stableConst, m_nParamSize, momentum(rank));
+	} else {
+		kernel_kernel_adadelta_table[m_useMomentum][scale < 1.f](params, grad, scale, m_ESquareGrad, m_ESquareDelta, m_histSquareGrad, m_histSquareDelta,
+			rankGrad, rankDelta, powf(c, age), weight * powf(d, age), powf(c, age - 1), weight * powf(d, age - 1),
+			d, c, m_stableConst, m_nParamSize, momentum(rank));
 	}
+	m_history->close(rank, m_stepCount, 1.f);
 
-	for (int i=0; i<m_nParamSize; i++) {
-		float gradSqr_i = grad[i] * grad[i];
-		// accumulate mean squared grad
-		m_ESquareGrad[i] = m_decayFactor * m_ESquareGrad[i] + (1 - m_decayFactor) * gradSqr_i;
-		for (int slaveId=1; slaveId<=m_nSlave; slaveId++) {		
-			m_mapESquareGrad[slaveId][i] += m_factor[slaveId] * gradSqr_i;
-			m_mapESquareGrad[slaveId][i] *= 0.8;
-		}
-
-		// compute delta
-		delta = sqrt(m_mapESquareDelta[rank][i] + m_stableConst) / sqrt(m_mapESquareGrad[rank][i] + m_stableConst) * grad[i];
-		params[i] -= delta;
+	if (m_stepCount - m_epochStart >= m_epochLength) {
+		restartHistory();
+	}
+}
 
-		// accumulate mean squared delta
-		float deltaSqr_i = delta * delta;
-		m_ESquareDelta[i] = m_decayFactor * m_ESquareDelta[i] + (1 - m_decayFactor) * deltaSqr_i;
-		for (int slaveId=1; slaveId<=m_nSlave; slaveId++) {		
-			m_mapESquareDelta[slaveId][i] += m_factor[slaveId] * deltaSqr_i;
-			m_mapESquareDelta[slaveId][i] *= 0.8;
+void kernelAdadelta::restartHistory () {
+	// fold H into every snapshot so that each one reads K_s alone from now on,
+	// slaves sharing a version share t0 and r_s as well
+	float c = m_slaveDecay;
+	float d = m_decayFactor;
+	for (int idx=0; idx<m_history->numVersions(); ++idx) {
+		historyVersion *snapshot = m_history->version(idx);
+		if (snapshot->refs == 0 || snapshot->weight == 0.f) {
+			continue;
+		}
+		if (snapshot->weight <= m_retireWeight) {
+			// every grad term it took since t0 is below its precision, it reads K_s alone
+			snapshot->weight = 0.f;
+			continue;
 		}
+		int age = m_stepCount - snapshot->stamp;
+		if (m_wide) {
+			double snapDecay = pow((double) c, age);
+			double histWeight = (double) snapshot->weight * c * pow((double) d, age);
+			kernel_axpby_pair(m_history->openVersion(idx, 0), m_history->openVersion(idx, 2), snapDecay, m_wideSquareGrad, histWeight, m_nParamSize);
+			kernel_axpby_pair(m_history->openVersion(idx, 1), m_history->openVersion(idx, 3), snapDecay, m_wideSquareDelta, histWeight, m_nParamSize);
+		} else {
+			float snapDecay = powf(c, age);
+			float histWeight = snapshot->weight * c * powf(d, age);
+			kernel_axpby(m_history->openVersion(idx, 0), snapDecay, m_histSquareGrad, histWeight, m_nParamSize);
+			kernel_axpby(m_history->openVersion(idx, 1), snapDecay, m_histSquareDelta, histWeight, m_nParamSize);
+		}
+		m_history->closeVersion(idx);
+		snapshot->weight *= powf(d, age);
+		snapshot->stamp = m_stepCount;
 	}
-
-	memcpy(m_mapESquareGrad[rank], m_ESquareGrad, sizeof(float)*m_nParamSize);
-	memcpy(m_mapESquareDelta[rank], m_ESquareDelta, sizeof(float)*m_nParamSize);
-	m_factor[rank] = (1 - m_decayFactor);
-}
\ No newline at end of file
+	if (m_wide) {
+		memset(m_wideSquareGrad, 0x00, sizeof(double) * m_nParamSize);
+		memset(m_wideSquareDelta, 0x00, sizeof(double) * m_nParamSize);
+	} else {
+		memset(m_histSquareGrad, 0x00, sizeof(float) * m_nParamSize);
+		memset(m_histSquareDelta, 0x00, sizeof(float) * m_nParamSize);
+	}
+	m_epochStart = m_stepCount;
+}
@@ -0,0 +1,51 @@
+#include <math.h>
+#include <string.h>
+#include "sgd.h"
+
+lamb::lamb (ConfReader *confReader, long paramSize, std::vector<long> &layerOffset, std::vector<long> &layerSize)
+	: adam(confReader, paramSize) {
+	m_weightDecay = confReader->getFloat("weight decay");
+	// layers are the model's weight blocks (its segments), together they cover every param
+	m_layerOffset = layerOffset;
+	m_layerSize = layerSize;
+}
+
+lamb::~lamb () {
+	// moments are released by adam
+}
+
+void lamb::updateParams (float *params, float *grad, int rank) {
+	m_stepCount += 1;
+	m_beta1Power *= m_beta1;
+	m_beta2Power *= m_beta2;
+	float correct1 = 1.f / (1.f - m_beta1Power);
+	float correct2 = 1.f / (1.f - m_beta2Power);
+	kernelMomentum *stepMomentum = momentum(rank);
+	// one global norm over all layers
+	float scale = clipScale(grad);
+
+	for (int layer = 0; layer < (int) m_layerOffset.size(); ++layer) {
+		long offset = m_layerOffset[layer];
+		long size = m_layerSize[layer];
+
+		// pass 1 updates the moments and measures the layer, pass 2 steps it
+		float paramNormSqr, stepNormSqr;
+		kernel_lamb_norms_table[m_weightDecay != 0.f][scale < 1.f](params + offset, grad + offset, scale, m_firstMoment + offset, m_secondMoment + offset,
+			m_beta1, m_beta2, correct1, correct2, m_epsilon, m_weightDecay, size, &paramNormSqr, &stepNormSqr);
+
+		float trust = 1.f;
+		if (paramNormSqr > 0.f && stepNormSqr > 0.f) {
+			trust = sqrtf(paramNormSqr) / sqrtf(stepNormSqr);
+		}
+
+		kernelMomentum layerMomentum;
+		kernelMomentum *layerMomentumPtr = NULL;
+		if (stepMomentum != NULL) {
+			layerMomentum = *stepMomentum;
+			layerMomentum.velocity = stepMomentum->velocity + offset;
+			layerMomentumPtr = &layerMomentum;
+		}
+		kernel_lamb_apply_table[m_useMomentum][m_weightDecay != 0.f](params + offset, m_firstMoment + offset, m_secondMoment + offset, correct1, correct2,
+			m_epsilon, m_learningRate * trust, m_weightDecay, size, layerMomentumPtr);
+	}
+}
@@ -2,28 +2,56 @@
 #include <string.h>
 #include "sgd.h"
 
-rmsprop::rmsprop (ConfReader *confReader, int paramSize) {
+rmsprop::rmsprop (ConfReader *confReader, long paramSize) {
 	m_nParamSize = paramSize;
 	m_decayFactor = confReader->getFloat("rmsprop decay factor");
-	m_useMomentum  = confReader->getInt("use momentum");
+	initMomentum(confReader);
+	m_stepCount = 0;
 
 	m_meanSquareGrad  = new float [m_nParamSize];
+	m_lastTouch = NULL;
 
 	memset(m_meanSquareGrad, 0x00, sizeof(float) * m_nParamSize);
 }
 
 rmsprop::~rmsprop () {
-	if (!m_meanSquareGrad) {
+	if (m_meanSquareGrad != NULL) {
 		delete [] m_meanSquareGrad;
 	}
+	if (m_lastTouch != NULL) {
+		delete [] m_lastTouch;
+	}
 }
 
 void rmsprop::updateParams (float *params, float *grad, int rank) {
-	float delta;
-	for (int i=0; i<m_nParamSize; i++) {
-		// accumulate mean squared grad
-		m_meanSquareGrad[i] = m_decayFactor * m_meanSquareGrad[i] + (1 - m_decayFactor) * grad[i] * grad[i];
-		// compute delta
-		params[i] -= grad[i] / sqrt(m_meanSquareGrad[i]);
+	m_stepCount += 1;
+	if (m_lastTouch != NULL) {
+		// back from sparse updates: decay the entries they skipped once, dense updates touch every entry
+		for (long i=0; i<m_nParamSize; i++) {
+			m_meanSquareGrad[i] *= powf(m_decayFactor, m_stepCount - 1 - m_lastTouch[i]);
+		}
+		delete [] m_lastTouch;
+		m_lastTouch = NULL;
+	}
+	// accumulate mean squared grad and apply delta
+	float scale = clipScale(grad);
+	kernel_rmsprop_table[m_useMomentum][scale < 1.f](params, grad, scale, m_meanSquareGrad, m_decayFactor, m_nParamSize, momentum(rank));
+}
+
+void rmsprop::updateSparse (float *params, int nnz, int *index, float *value, int rank) {
+	// momentum moves every param, so it needs the dense path
+	if (m_useMomentum) {
+		sgdBase::updateSparse(params, nnz, index, value, rank);
+		return;
+	}
+	if (m_lastTouch == NULL) {
+		m_lastTouch = new int [m_nParamSize];
+		for (long i=0; i<m_nParamSize; i++) {
+			m_lastTouch[i] = m_stepCount;
+		}
 	}
+	m_stepCount += 1;
+	momentum(rank);
+	clipSparse(nnz, value);
+	kernel_sparse_rmsprop(params, index, value, m_meanSquareGrad, m_lastTouch, m_stepCount, m_decayFactor, nnz);
 }
\ No newline at end of file
@@ -1,10 +1,103 @@
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
 #include "sgd.h"
 
-sgdBasic::sgdBasic (ConfReader *confReader, int paramSize) {
+/****************************************************************
+* sgdBase: momentum and clipping shared by all solvers
+****************************************************************/
+
+void sgdBase::initMomentum (ConfReader *confReader) {
+	m_useMomentum = confReader->getInt("use momentum");
+	m_momentumFactor = confReader->getFloat("momentum factor");
+	m_staleAdjust = confReader->getInt("momentum staleness adjust");
+	m_nUpdate = 0;
+	m_meanStaleness = 0.f;
+	m_clipNorm = confReader->getFloat("clip gradient norm");
+
+	// picks the kernel instances of every solver (see sgd_kernel.h)
+	if (m_useMomentum < KERNEL_PLAIN || m_useMomentum >= KERNEL_NPOLICY) {
+		printf("Error use momentum: %d.\n", m_useMomentum);
+		exit(-1);
+	}
+
+	if (m_useMomentum) {
+		m_velocity = new float [m_nParamSize];
+		memset(m_velocity, 0x00, sizeof(float) * m_nParamSize);
+	}
+}
+
+kernelMomentum *sgdBase::momentum (int rank) {
+	// staleness of this grad: updates applied since the rank got its params
+	if (rank >= (int) m_lastStep.size()) {
+		m_lastStep.resize(rank+1, 0);
+	}
+	int staleness = m_nUpdate - m_lastStep[rank];
+	m_meanStaleness = 0.9f * m_meanStaleness + 0.1f * staleness;
+	m_nUpdate += 1;
+	m_lastStep[rank] = m_nUpdate;
+
+	if (!m_useMomentum) {
+		return NULL;
+	}
+	float factor = m_momentumFactor;
+	if (m_staleAdjust) {
+		// asynchronous updates already behave like momentum 1 - 1/(1 + staleness)
+		float implicit = m_meanStaleness / (1.f + m_meanStaleness);
+		factor = std::max(0.f, factor - implicit);
+	}
+	m_kernelMomentum.velocity = m_velocity;
+	m_kernelMomentum.factor = factor;
+	m_kernelMomentum.nesterov = (m_useMomentum == 2);
+	return &m_kernelMomentum;
+}
+
+float sgdBase::clipScale (float *grad) {
+	float sqNorm = m_gradSqNorm;
+	m_gradSqNorm = -1.f;
+	if (m_clipNorm <= 0.f) {
+		return 1.f;
+	}
+	float norm = sqrtf(sqNorm >= 0.f ? sqNorm : kernel_sqnorm(grad, m_nParamSize));
+	return (norm > m_clipNorm) ? m_clipNorm / norm : 1.f;
+}
+
+void sgdBase::clipSparse (int nnz, float *value) {
+	float sqNorm = m_gradSqNorm;
+	m_gradSqNorm = -1.f;
+	if (m_clipNorm <= 0.f) {
+		return;
+	}
+	float norm = sqrtf(sqNorm >= 0.f ? sqNorm : kernel_sqnorm(value, nnz));
+	if (norm > m_clipNorm) {
+		kernel_scale(value, m_clipNorm / norm, nnz);
+	}
+}
+
+void sgdBase::updateSparse (float *params, int nnz, int *index, float *value, int rank) {
+	// solvers without a sparse kernel see the scattered dense grad
+	if (m_sparseGrad == NULL) {
+		m_sparseGrad = new float [m_nParamSize];
+		memset(m_sparseGrad, 0x00, sizeof(float) * m_nParamSize);
+	}
+	for (int k=0; k<nnz; ++k) {
+		m_sparseGrad[index[k]] = value[k];
+	}
+	updateParams(params, m_sparseGrad, rank);
+	for (int k=0; k<nnz; ++k) {
+		m_sparseGrad[index[k]] = 0.f;
+	}
+}
+
+/****************************************************************
+* sgdBasic
+****************************************************************/
+
+sgdBasic::sgdBasic (ConfReader *confReader, long paramSize) {
 	m_stepCount  = 0;
 	m_nParamSize = paramSize;	
 	m_learningRate = confReader->getFloat("learning rate");
-	m_useMomentum  = confReader->getInt("use momentum");
+	initMomentum(confReader);
 }
 
 sgdBasic::~sgdBasic () {
@@ -14,7 +107,18 @@ sgdBasic::~sgdBasic () {
 void sgdBasic::updateParams (float *params, float *grad, int rank) {
 	m_stepCount += 1;
 
-	for (int i=0; i<m_nParamSize; i++) {
-		params[i] -= m_learningRate / sqrt(m_stepCount) * grad[i];
+	float scale = clipScale(grad);
+	kernel_sgd_table[m_useMomentum][scale < 1.f](params, grad, scale, m_learningRate / sqrt(m_stepCount), m_nParamSize, momentum(rank));
+}
+
+void sgdBasic::updateSparse (float *params, int nnz, int *index, float *value, int rank) {
+	// momentum moves every param, so it needs the dense path
+	if (m_useMomentum) {
+		sgdBase::updateSparse(params, nnz, index, value, rank);
+		return;
 	}
+	m_stepCount += 1;
+	momentum(rank);
+	clipSparse(nnz, value);
+	kernel_sparse_sgd(params, index, value, m_learningRate / sqrt(m_stepCount), nnz);
 }
\ No newline at end of file
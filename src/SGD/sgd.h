@@ -3,33 +3,68 @@
 
 #include <stdio.h>
 #include <map>
-#include <mpi.h>
+#include <vector>
 #include <math.h>
 #include "confreader.h"
+#include "sgd_kernel.h"
+#include "history_store.h"
 
 class sgdBase
 {
 public:
-    sgdBase() {};
-    virtual ~sgdBase() {};
+    sgdBase() {m_velocity = NULL; m_sparseGrad = NULL; m_gradSqNorm = -1.f;};
+    virtual ~sgdBase() {
+        if (m_velocity != NULL) {
+            delete [] m_velocity;
+        }
+        if (m_sparseGrad != NULL) {
+            delete [] m_sparseGrad;
+        }
+    };
 
     /* data */
 
     /* method */
     void virtual updateParams (float *params, float *grad, int rank) {};
+    // grad as nnz (index, value) pairs, ascending indices; by default scattered into a dense grad
+    void virtual updateSparse (float *params, int nnz, int *index, float *value, int rank);
+    // |g|^2 of the next update as summed by the sender, spares the clipping its own pass
+    void setGradSqNorm (float sqNorm) {m_gradSqNorm = sqNorm;};
+    float clipNorm () {return m_clipNorm;};
+    void setClipNorm (float clipNorm) {m_clipNorm = clipNorm;};
 
 protected:
     /* data */
-    int m_useMomentum;
-    int m_nParamSize;
+    int m_useMomentum;          // 0: off, 1: heavy ball, 2: Nesterov
+    long m_nParamSize;
     float m_learningRate;
     int m_stepCount;
 
+    float m_momentumFactor;
+    int m_staleAdjust;          // subtract the momentum implied by asynchrony
+    float *m_velocity;
+    kernelMomentum m_kernelMomentum;
+
+    int m_nUpdate;
+    float m_meanStaleness;
+    std::vector<int> m_lastStep;    // m_nUpdate when each rank got its params
+
+    float *m_sparseGrad;            // zero except while updateSparse falls back to updateParams
+
+    float m_clipNorm;               // global L2 norm the grad is rescaled to, <= 0: no clipping
+    float m_gradSqNorm;             // set for the next update only, < 0: unknown
+
     /* method */
-    //TODO void truncate (float);
+    void initMomentum (ConfReader *confReader);
+    kernelMomentum *momentum (int rank);
+    // 1 or clipNorm / |g|, the kernels' clip instance (scale < 1) applies it in the update pass;
+    // |g| is measured here only when the caller did not set it
+    float clipScale (float *grad);
+    // sparse grads are short, their values are rescaled in place
+    void clipSparse (int nnz, float *value);
     void printInfo (float *buffer) {
         float sum = 0.f;
-        for (int i=0; i<m_nParamSize; ++i) {
+        for (long i=0; i<m_nParamSize; ++i) {
             sum += buffer[i];
         }
         printf("sum: %f\n", sum);
@@ -42,13 +77,14 @@ protected:
 class sgdBasic: public sgdBase
 {
 public:
-    sgdBasic(ConfReader *confReader, int paramSize);
+    sgdBasic(ConfReader *confReader, long paramSize);
     ~sgdBasic();
 
     /* data */
 
     /* method */
     void updateParams (float *params, float *grad, int rank);
+    void updateSparse (float *params, int nnz, int *index, float *value, int rank);
 };
 
 /****************************************************************
@@ -57,13 +93,14 @@ public:
 class adagrad: public sgdBase
 {
 public:
-    adagrad(ConfReader *confReader, int paramSize);
+    adagrad(ConfReader *confReader, long paramSize);
     ~adagrad();
 
     /* data */
 
     /* method */
     void updateParams (float *params, float *grad, int rank);
+    void updateSparse (float *params, int nnz, int *index, float *value, int rank);
 
 private:
     /* data */
@@ -76,7 +113,7 @@ private:
 class delayedAdagrad: public sgdBase
 {
 public:
-    delayedAdagrad(ConfReader *confReader, int paramSize);
+    delayedAdagrad(ConfReader *confReader, long paramSize, int nSlave);
     ~delayedAdagrad();
 
     /* data */
@@ -88,7 +125,7 @@ public:
 private:
     /* data */
     float *m_histSquareGrad;
-    std::map<int, float*> m_mapHistSquareGrad;    
+    historyStore *m_history;    // each slave's snapshot of m_histSquareGrad
 };
 
 /****************************************************************
@@ -97,7 +134,7 @@ private:
 class futureAdagrad: public sgdBase
 {
 public:
-    futureAdagrad(ConfReader *confReader, int paramSize);
+    futureAdagrad(ConfReader *confReader, long paramSize, int nSlave);
     ~futureAdagrad();
 
     /* data */
@@ -109,7 +146,7 @@ public:
 private:
     /* data */
     float *m_histSquareGrad;
-    std::map<int, float*> m_mapHistSquareGrad;    
+    historyStore *m_history;    // each slave's snapshot of m_histSquareGrad
 };
 
 /****************************************************************
@@ -118,13 +155,14 @@ private:
 class adadelta: public sgdBase
 {
 public:
-    adadelta(ConfReader *confReader, int paramSize);
+    adadelta(ConfReader *confReader, long paramSize);
     ~adadelta();
 
     /* data */
 
     /* method */
     void updateParams (float *params, float *grad, int rank);
+    void updateSparse (float *params, int nnz, int *index, float *value, int rank);
 
 private:
     /* data */
@@ -133,6 +171,7 @@ private:
 
     float *m_ESquareGrad;
     float *m_ESquareDelta;    
+    int *m_lastTouch;           // last update of each entry while sparse updates run, NULL after a dense one
 };
 
 /****************************************************************
@@ -141,7 +180,7 @@ private:
 class kernelAdadelta: public sgdBase
 {
 public:
-    kernelAdadelta(ConfReader *confReader, int paramSize);
+    kernelAdadelta(ConfReader *confReader, long paramSize, int nSlave);
     ~kernelAdadelta();
 
     /* data */
@@ -155,13 +194,26 @@ private:
 
     float m_decayFactor;
     float m_stableConst;
+    float m_slaveDecay;
 
     float *m_ESquareGrad;
     float *m_ESquareDelta;
+    float *m_histSquareGrad;        // global history the snapshots decay through
+    float *m_histSquareDelta;
+    double *m_wideSquareGrad;       // the same in double when it grows (m_wide), NULL otherwise
+    double *m_wideSquareDelta;
+    bool m_wide;
+    int m_epochStart;               // update that last restarted the history
+    int m_epochLength;
+    float m_retireWeight;           // r_s at or below which a snapshot is no longer folded
+
+    // K_s of grad and delta (plus their low halves when m_wide), see kernel_adadelta.cpp;
+    // a version's stamp is the slave's last reset or fold, its weight the grad weight then
+    // in units of (1-d)
+    historyStore *m_history;
 
-    std::map<int, float> m_factor;
-    std::map<int, float*> m_mapESquareGrad;
-    std::map<int, float*> m_mapESquareDelta;
+    /* method */
+    void restartHistory ();
 };
 
 /****************************************************************
@@ -170,19 +222,21 @@ private:
 class rmsprop: public sgdBase
 {
 public:
-    rmsprop(ConfReader *confReader, int paramSize);
+    rmsprop(ConfReader *confReader, long paramSize);
     ~rmsprop();
 
     /* data */
 
     /* method */
     void updateParams (float *params, float *grad, int rank);
+    void updateSparse (float *params, int nnz, int *index, float *value, int rank);
 
 private:
     /* data */
     float m_decayFactor;
 
     float *m_meanSquareGrad;    
+    int *m_lastTouch;           // last update of each entry while sparse updates run, NULL after a dense one
 };
 
 /****************************************************************
@@ -191,7 +245,7 @@ private:
 class DelayedAdadelta: public sgdBase
 {
 public:
-    DelayedAdadelta(ConfReader *confReader, int paramSize);
+    DelayedAdadelta(ConfReader *confReader, long paramSize, int nSlave);
     ~DelayedAdadelta();
 
     /* data */
@@ -208,7 +262,62 @@ private:
     float *m_ESquareGrad;
     float *m_ESquareDelta;
 
-    std::map<int, float*> m_mapHistSquareGrad;
-    std::map<int, float*> m_mapHistSquareDelta;
+    historyStore *m_history;    // each slave's snapshot of the grad average
+};
+
+/****************************************************************
+* ADAM
+****************************************************************/
+class adam: public sgdBase
+{
+public:
+    adam(ConfReader *confReader, long paramSize);
+    ~adam();
+
+    /* data */
+
+    /* method */
+    void updateParams (float *params, float *grad, int rank);
+
+protected:
+    /* data */
+    float m_beta1;
+    float m_beta2;
+    float m_epsilon;
+    float m_weightDecay;        // decoupled, 0 for plain adam
+
+    float m_beta1Power;         // beta^t for the bias corrections
+    float m_beta2Power;
+
+    float *m_firstMoment;
+    float *m_secondMoment;
+};
+
+/****************************************************************
+* ADAMW: adam with decoupled weight decay
+****************************************************************/
+class adamW: public adam
+{
+public:
+    adamW(ConfReader *confReader, long paramSize);
+    ~adamW();
+};
+
+/****************************************************************
+* LAMB: adamW step rescaled per layer by |w| / |step|
+****************************************************************/
+class lamb: public adam
+{
+public:
+    lamb(ConfReader *confReader, long paramSize, std::vector<long> &layerOffset, std::vector<long> &layerSize);
+    ~lamb();
+
+    /* method */
+    void updateParams (float *params, float *grad, int rank);
+
+private:
+    /* data */
+    std::vector<long> m_layerOffset;
+    std::vector<long> m_layerSize;
 };
 #endif
\ No newline at end of file
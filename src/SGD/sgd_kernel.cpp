@@ -0,0 +1,897 @@
+#include <math.h>
+#include <string.h>
+#include <immintrin.h>
+
+#include "sgd_kernel.h"
+
+/****************************************************************
+* Vector primitives, one set per instruction set
+****************************************************************/
+
+#if defined(__AVX512F__)
+
+#define KERNEL_SIMD 1
+#define KERNEL_WIDTH 16
+typedef __m512 vfloat;
+
+static inline vfloat v_load (float *p) {return _mm512_loadu_ps(p);}
+static inline void v_store (float *p, vfloat a) {_mm512_storeu_ps(p, a);}
+static inline vfloat v_set (float a) {return _mm512_set1_ps(a);}
+static inline vfloat v_add (vfloat a, vfloat b) {return _mm512_add_ps(a, b);}
+static inline vfloat v_sub (vfloat a, vfloat b) {return _mm512_sub_ps(a, b);}
+static inline vfloat v_mul (vfloat a, vfloat b) {return _mm512_mul_ps(a, b);}
+static inline vfloat v_fmadd (vfloat a, vfloat b, vfloat c) {return _mm512_fmadd_ps(a, b, c);}	// a * b + c
+static inline vfloat v_fnmadd (vfloat a, vfloat b, vfloat c) {return _mm512_fnmadd_ps(a, b, c);}	// c - a * b
+static inline vfloat v_div (vfloat a, vfloat b) {return _mm512_div_ps(a, b);}
+static inline vfloat v_sqrt (vfloat a) {return _mm512_sqrt_ps(a);}
+static inline vfloat v_rsqrt_est (vfloat a) {return _mm512_rsqrt14_ps(a);}
+static inline vfloat v_unless_zero (vfloat a, vfloat b) {return _mm512_maskz_mov_ps(_mm512_cmp_ps_mask(b, _mm512_setzero_ps(), _CMP_NEQ_UQ), a);}	// b != 0 ? a : 0
+static inline float v_sum (vfloat a) {return _mm512_reduce_add_ps(a);}
+
+// doubles, half a float vector wide
+typedef __m512d vdouble;
+static inline vdouble vd_load (double *p) {return _mm512_loadu_pd(p);}
+static inline void vd_store (double *p, vdouble a) {_mm512_storeu_pd(p, a);}
+static inline vdouble vd_set (double a) {return _mm512_set1_pd(a);}
+static inline vdouble vd_add (vdouble a, vdouble b) {return _mm512_add_pd(a, b);}
+static inline vdouble vd_sub (vdouble a, vdouble b) {return _mm512_sub_pd(a, b);}
+static inline vdouble vd_mul (vdouble a, vdouble b) {return _mm512_mul_pd(a, b);}
+static inline vdouble vd_fmadd (vdouble a, vdouble b, vdouble c) {return _mm512_fmadd_pd(a, b, c);}
+static inline vdouble vd_low (vfloat a) {return _mm512_cvtps_pd(_mm512_castps512_ps256(a));}
+static inline vdouble vd_high (vfloat a) {return _mm512_cvtps_pd(_mm256_castpd_ps(_mm512_extractf64x4_pd(_mm512_castps_pd(a), 1)));}
+static inline vfloat v_narrow (vdouble low, vdouble high) {
+	__m512d joined = _mm512_castps_pd(_mm512_castps256_ps512(_mm512_cvtpd_ps(low)));
+	return _mm512_castpd_ps(_mm512_insertf64x4(joined, _mm256_castps_pd(_mm512_cvtpd_ps(high)), 1));
+}
+
+#elif defined(__AVX__)
+
+#define KERNEL_SIMD 1
+#define KERNEL_WIDTH 8
+typedef __m256 vfloat;
+
+static inline vfloat v_load (float *p) {return _mm256_loadu_ps(p);}
+static inline void v_store (float *p, vfloat a) {_mm256_storeu_ps(p, a);}
+static inline vfloat v_set (float a) {return _mm256_set1_ps(a);}
+static inline vfloat v_add (vfloat a, vfloat b) {return _mm256_add_ps(a, b);}
+static inline vfloat v_sub (vfloat a, vfloat b) {return _mm256_sub_ps(a, b);}
+static inline vfloat v_mul (vfloat a, vfloat b) {return _mm256_mul_ps(a, b);}
+#ifdef __FMA__
+static inline vfloat v_fmadd (vfloat a, vfloat b, vfloat c) {return _mm256_fmadd_ps(a, b, c);}
+static inline vfloat v_fnmadd (vfloat a, vfloat b, vfloat c) {return _mm256_fnmadd_ps(a, b, c);}
+#else
+static inline vfloat v_fmadd (vfloat a, vfloat b, vfloat c) {return _mm256_add_ps(_mm256_mul_ps(a, b), c);}
+static inline vfloat v_fnmadd (vfloat a, vfloat b, vfloat c) {return _mm256_sub_ps(c, _mm256_mul_ps(a, b));}
+#endif
+static inline vfloat v_div (vfloat a, vfloat b) {return _mm256_div_ps(a, b);}
+static inline vfloat v_sqrt (vfloat a) {return _mm256_sqrt_ps(a);}
+static inline vfloat v_rsqrt_est (vfloat a) {return _mm256_rsqrt_ps(a);}
+static inline vfloat v_unless_zero (vfloat a, vfloat b) {return _mm256_and_ps(a, _mm256_cmp_ps(b, _mm256_setzero_ps(), _CMP_NEQ_UQ));}	// b != 0 ? a : 0
+static inline float v_sum (vfloat a) {
+	__m128 s = _mm_add_ps(_mm256_castps256_ps128(a), _mm256_extractf128_ps(a, 1));
+	s = _mm_add_ps(s, _mm_movehl_ps(s, s));
+	s = _mm_add_ss(s, _mm_shuffle_ps(s, s, 1));
+	return _mm_cvtss_f32(s);
+}
+
+typedef __m256d vdouble;
+static inline vdouble vd_load (double *p) {return _mm256_loadu_pd(p);}
+static inline void vd_store (double *p, vdouble a) {_mm256_storeu_pd(p, a);}
+static inline vdouble vd_set (double a) {return _mm256_set1_pd(a);}
+static inline vdouble vd_add (vdouble a, vdouble b) {return _mm256_add_pd(a, b);}
+static inline vdouble vd_sub (vdouble a, vdouble b) {return _mm256_sub_pd(a, b);}
+static inline vdouble vd_mul (vdouble a, vdouble b) {return _mm256_mul_pd(a, b);}
+#ifdef __FMA__
+static inline vdouble vd_fmadd (vdouble a, vdouble b, vdouble c) {return _mm256_fmadd_pd(a, b, c);}
+#else
+static inline vdouble vd_fmadd (vdouble a, vdouble b, vdouble c) {return _mm256_add_pd(_mm256_mul_pd(a, b), c);}
+#endif
+static inline vdouble vd_low (vfloat a) {return _mm256_cvtps_pd(_mm256_castps256_ps128(a));}
+static inline vdouble vd_high (vfloat a) {return _mm256_cvtps_pd(_mm256_extractf128_ps(a, 1));}
+static inline vfloat v_narrow (vdouble low, vdouble high) {
+	return _mm256_insertf128_ps(_mm256_castps128_ps256(_mm256_cvtpd_ps(low)), _mm256_cvtpd_ps(high), 1);
+}
+
+#endif
+
+#ifdef KERNEL_SIMD
+// estimate refined by one Newton-Raphson step: y' = y * (1.5 - 0.5 * x * y * y)
+static inline vfloat v_rsqrt (vfloat x) {
+	vfloat y = v_rsqrt_est(x);
+	vfloat hxy = v_mul(v_mul(v_set(0.5f), x), y);
+	return v_mul(y, v_fnmadd(hxy, y, v_set(1.5f)));
+}
+
+// the amount to subtract from params[i..], velocity updated in the same pass
+template <class M>
+static inline vfloat v_momentum (vfloat step, kernelMomentum *momentum, long i) {
+	if (M::policy == KERNEL_PLAIN) {
+		return step;
+	}
+	vfloat mu = v_set(momentum->factor);
+	vfloat v = v_fmadd(mu, v_load(momentum->velocity + i), step);
+	v_store(momentum->velocity + i, v);
+	return (M::policy == KERNEL_NESTEROV) ? v_fmadd(mu, v, step) : v;
+}
+
+// a float pair hi + lo, one half of the vector at a time
+static inline vdouble vd_pair_low (vfloat hi, vfloat lo) {return vd_add(vd_low(hi), vd_low(lo));}
+static inline vdouble vd_pair_high (vfloat hi, vfloat lo) {return vd_add(vd_high(hi), vd_high(lo));}
+static inline void v_store_pair (float *hi, float *lo, vdouble low, vdouble high) {
+	vfloat h = v_narrow(low, high);
+	v_store(hi, h);
+	v_store(lo, v_narrow(vd_sub(low, vd_low(h)), vd_sub(high, vd_high(h))));
+}
+
+// the grad rescaled to the clipping norm, untouched without clipping
+template <class C>
+static inline vfloat v_clip (vfloat g, vfloat gradScale) {
+	return C::on ? v_mul(g, gradScale) : g;
+}
+
+// step + rate * wd * p, nothing without decay
+template <class D>
+static inline vfloat v_decay (vfloat step, vfloat rateDecay, vfloat p) {
+	return D::on ? v_fmadd(rateDecay, p, step) : step;
+}
+#endif
+
+static inline float s_rsqrt (float x) {
+	return 1.f / sqrtf(x);
+}
+
+template <class M>
+static inline float s_momentum (float step, kernelMomentum *momentum, long i) {
+	if (M::policy == KERNEL_PLAIN) {
+		return step;
+	}
+	float v = momentum->factor * momentum->velocity[i] + step;
+	momentum->velocity[i] = v;
+	return (M::policy == KERNEL_NESTEROV) ? momentum->factor * v + step : v;
+}
+
+template <class C>
+static inline float s_clip (float g, float gradScale) {
+	return C::on ? g * gradScale : g;
+}
+
+template <class D>
+static inline float s_decay (float step, float rateDecay, float p) {
+	return D::on ? step + rateDecay * p : step;
+}
+
+// x stored as the float pair hi + lo, about 48 bits of it
+static inline void s_split (double x, float *hi, float *lo) {
+	float h = (float) x;
+	*hi = h;
+	*lo = (float) (x - h);
+}
+
+/****************************************************************
+* Kernels: the vector loop runs over whole vectors, the scalar
+* loop finishes the residual (or everything without SIMD).
+* Accumulators always see the raw step, momentum only changes
+* how far the params move. Each body is a template on its
+* policies (momentum, weight decay) and instantiated for every
+* combination in the tables below, so no loop tests a feature.
+****************************************************************/
+
+struct momentumOff {static const int policy = KERNEL_PLAIN;};
+struct momentumHeavyBall {static const int policy = KERNEL_HEAVY_BALL;};
+struct momentumNesterov {static const int policy = KERNEL_NESTEROV;};
+
+struct decayOff {static const bool on = false;};
+struct decayOn {static const bool on = true;};
+
+struct clipOff {static const bool on = false;};
+struct clipOn {static const bool on = true;};
+
+template <class M, class C>
+static void kernel_sgd_t (float *params, float *grad, float gradScale, float rate, long dim, kernelMomentum *momentum) {
+	long i = 0;
+	#ifdef KERNEL_SIMD
+		vfloat vec_gradScale = v_set(gradScale);
+		vfloat vec_rate = v_set(rate);
+		for (; i+KERNEL_WIDTH<=dim; i+=KERNEL_WIDTH) {
+			v_store(params + i, v_sub(v_load(params + i), v_momentum<M>(v_mul(vec_rate, v_clip<C>(v_load(grad + i), vec_gradScale)), momentum, i)));
+		}
+	#endif
+	for (; i<dim; ++i) {
+		float g = s_clip<C>(grad[i], gradScale);
+		params[i] -= s_momentum<M>(rate * g, momentum, i);
+	}
+}
+
+template <class M, class C>
+static void kernel_adagrad_t (float *params, float *grad, float gradScale, float *hist, float rate, long dim, kernelMomentum *momentum) {
+	long i = 0;
+	#ifdef KERNEL_SIMD
+		vfloat vec_gradScale = v_set(gradScale);
+		vfloat vec_rate = v_set(rate);
+		for (; i+KERNEL_WIDTH<=dim; i+=KERNEL_WIDTH) {
+			vfloat g = v_clip<C>(v_load(grad + i), vec_gradScale);
+			vfloat h = v_fmadd(g, g, v_load(hist + i));
+			v_store(hist + i, h);
+			vfloat step = v_mul(v_mul(vec_rate, g), v_rsqrt(h));
+			v_store(params + i, v_sub(v_load(params + i), v_momentum<M>(step, momentum, i)));
+		}
+	#endif
+	for (; i<dim; ++i) {
+		float g = s_clip<C>(grad[i], gradScale);
+		hist[i] += g * g;
+		params[i] -= s_momentum<M>(rate * g * s_rsqrt(hist[i]), momentum, i);
+	}
+}
+
+template <class M, class C>
+static void kernel_delayed_adagrad_t (float *params, float *grad, float gradScale, float *hist, float *slaveHist, float rate, long dim, kernelMomentum *momentum) {
+	long i = 0;
+	#ifdef KERNEL_SIMD
+		vfloat vec_gradScale = v_set(gradScale);
+		vfloat vec_rate = v_set(rate);
+		for (; i+KERNEL_WIDTH<=dim; i+=KERNEL_WIDTH) {
+			vfloat g = v_clip<C>(v_load(grad + i), vec_gradScale);
+			vfloat h = v_fmadd(g, g, v_load(hist + i));
+			vfloat hs = v_fmadd(g, g, v_load(slaveHist + i));
+			v_store(hist + i, h);
+			v_store(slaveHist + i, h);
+			vfloat step = v_mul(v_mul(vec_rate, g), v_rsqrt(hs));
+			v_store(params + i, v_sub(v_load(params + i), v_momentum<M>(step, momentum, i)));
+		}
+	#endif
+	for (; i<dim; ++i) {
+		float g = s_clip<C>(grad[i], gradScale);
+		float gradSqr = g * g;
+		hist[i] += gradSqr;
+		params[i] -= s_momentum<M>(rate * g * s_rsqrt(slaveHist[i] + gradSqr), momentum, i);
+		slaveHist[i] = hist[i];
+	}
+}
+
+template <class M, class C>
+static void kernel_future_adagrad_t (float *params, float *grad, float gradScale, float *hist, float *slaveHist, float rate, float stableConst, long dim, kernelMomentum *momentum) {
+	long i = 0;
+	#ifdef KERNEL_SIMD
+		vfloat vec_gradScale = v_set(gradScale);
+		vfloat vec_rate = v_set(rate);
+		vfloat vec_const = v_set(stableConst);
+		for (; i+KERNEL_WIDTH<=dim; i+=KERNEL_WIDTH) {
+			vfloat g = v_clip<C>(v_load(grad + i), vec_gradScale);
+			vfloat h = v_fmadd(g, g, v_load(hist + i));
+			vfloat future = v_sub(h, v_load(slaveHist + i));
+			v_store(hist + i, h);
+			v_store(slaveHist + i, h);
+			vfloat step = v_mul(v_mul(vec_rate, g), v_rsqrt(v_add(future, vec_const)));
+			v_store(params + i, v_sub(v_load(params + i), v_momentum<M>(step, momentum, i)));
+		}
+	#endif
+	for (; i<dim; ++i) {
+		float g = s_clip<C>(grad[i], gradScale);
+		hist[i] += g * g;
+		float future = hist[i] - slaveHist[i];
+		params[i] -= s_momentum<M>(rate * g * s_rsqrt(future + stableConst), momentum, i);
+		slaveHist[i] = hist[i];
+	}
+}
+
+template <class M, class C>
+static void kernel_rmsprop_t (float *params, float *grad, float gradScale, float *meanSquare, float decay, long dim, kernelMomentum *momentum) {
+	long i = 0;
+	#ifdef KERNEL_SIMD
+		vfloat vec_gradScale = v_set(gradScale);
+		vfloat vec_decay = v_set(decay);
+		vfloat vec_keep = v_set(1.f - decay);
+		for (; i+KERNEL_WIDTH<=dim; i+=KERNEL_WIDTH) {
+			vfloat g = v_clip<C>(v_load(grad + i), vec_gradScale);
+			vfloat m = v_fmadd(vec_decay, v_load(meanSquare + i), v_mul(vec_keep, v_mul(g, g)));
+			v_store(meanSquare + i, m);
+			// a zero grad does not step (m may still be 0), as on the sparse path
+			v_store(params + i, v_sub(v_load(params + i), v_momentum<M>(v_unless_zero(v_mul(g, v_rsqrt(m)), g), momentum, i)));
+		}
+	#endif
+	for (; i<dim; ++i) {
+		float g = s_clip<C>(grad[i], gradScale);
+		meanSquare[i] = decay * meanSquare[i] + (1 - decay) * g * g;
+		params[i] -= s_momentum<M>((g != 0.f) ? g * s_rsqrt(meanSquare[i]) : 0.f, momentum, i);
+	}
+}
+
+template <class M, class C>
+static void kernel_adadelta_t (float *params, float *grad, float gradScale, float *ESquareGrad, float *ESquareDelta, float decay, float stableConst, long dim, kernelMomentum *momentum) {
+	long i = 0;
+	#ifdef KERNEL_SIMD
+		vfloat vec_gradScale = v_set(gradScale);
+		vfloat vec_decay = v_set(decay);
+		vfloat vec_keep = v_set(1.f - decay);
+		vfloat vec_const = v_set(stableConst);
+		for (; i+KERNEL_WIDTH<=dim; i+=KERNEL_WIDTH) {
+			vfloat g = v_clip<C>(v_load(grad + i), vec_gradScale);
+			vfloat Eg = v_fmadd(vec_decay, v_load(ESquareGrad + i), v_mul(vec_keep, v_mul(g, g)));
+			vfloat Ed = v_load(ESquareDelta + i);
+			vfloat delta = v_mul(v_sqrt(v_add(Ed, vec_const)), v_mul(v_rsqrt(v_add(Eg, vec_const)), g));
+			v_store(ESquareGrad + i, Eg);
+			v_store(params + i, v_sub(v_load(params + i), v_momentum<M>(delta, momentum, i)));
+			v_store(ESquareDelta + i, v_fmadd(vec_decay, Ed, v_mul(vec_keep, v_mul(delta, delta))));
+		}
+	#endif
+	for (; i<dim; ++i) {
+		float g = s_clip<C>(grad[i], gradScale);
+		ESquareGrad[i] = decay * ESquareGrad[i] + (1 - decay) * g * g;
+		float delta = sqrtf(ESquareDelta[i] + stableConst) * s_rsqrt(ESquareGrad[i] + stableConst) * g;
+		params[i] -= s_momentum<M>(delta, momentum, i);
+		ESquareDelta[i] = decay * ESquareDelta[i] + (1 - decay) * delta * delta;
+	}
+}
+
+template <class M, class C>
+static void kernel_kernel_adadelta_t (float *params, float *grad, float gradScale, float *ESquareGrad, float *ESquareDelta,
+	float *histGrad, float *histDelta, float *rankGrad, float *rankDelta,
+	float gradDecay, float gradHist, float deltaDecay, float deltaHist,
+	float decay, float slaveDecay, float stableConst, long dim, kernelMomentum *momentum) {
+	float histDecay = slaveDecay / decay;
+	long i = 0;
+	#ifdef KERNEL_SIMD
+		vfloat vec_gradScale = v_set(gradScale);
+		vfloat vec_decay = v_set(decay);
+		vfloat vec_keep = v_set(1.f - decay);
+		vfloat vec_histDecay = v_set(histDecay);
+		vfloat vec_slaveDecay = v_set(slaveDecay);
+		vfloat vec_const = v_set(stableConst);
+		vfloat vec_gradDecay = v_set(gradDecay);
+		vfloat vec_gradHist = v_set(gradHist);
+		vfloat vec_deltaDecay = v_set(deltaDecay);
+		vfloat vec_deltaHist = v_set(deltaHist);
+		for (; i+KERNEL_WIDTH<=dim; i+=KERNEL_WIDTH) {
+			vfloat g = v_clip<C>(v_load(grad + i), vec_gradScale);
+			vfloat gradSqr = v_mul(vec_keep, v_mul(g, g));
+			vfloat Eg = v_fmadd(vec_decay, v_load(ESquareGrad + i), gradSqr);
+			vfloat Hg = v_fmadd(vec_histDecay, v_load(histGrad + i), gradSqr);
+
+			// the sender's snapshots, grad one step ahead of delta as in the eager loop
+			vfloat Hd = v_load(histDelta + i);
+			vfloat EgRank = v_fmadd(vec_gradDecay, v_load(rankGrad + i), v_mul(vec_gradHist, Hg));
+			vfloat EdRank = v_fmadd(vec_deltaDecay, v_load(rankDelta + i), v_mul(vec_deltaHist, Hd));
+			vfloat delta = v_mul(v_sqrt(v_add(EdRank, vec_const)), v_mul(v_rsqrt(v_add(EgRank, vec_const)), g));
+			v_store(params + i, v_sub(v_load(params + i), v_momentum<M>(delta, momentum, i)));
+
+			vfloat deltaSqr = v_mul(vec_keep, v_mul(delta, delta));
+			vfloat Ed = v_fmadd(vec_decay, v_load(ESquareDelta + i), deltaSqr);
+			Hd = v_fmadd(vec_histDecay, Hd, deltaSqr);
+			v_store(ESquareGrad + i, Eg);
+			v_store(ESquareDelta + i, Ed);
+			v_store(histGrad + i, Hg);
+			v_store(histDelta + i, Hd);
+			v_store(rankGrad + i, v_fnmadd(vec_slaveDecay, Hg, Eg));
+			v_store(rankDelta + i, v_fnmadd(vec_slaveDecay, Hd, Ed));
+		}
+	#endif
+	for (; i<dim; ++i) {
+		float g = s_clip<C>(grad[i], gradScale);
+		float gradSqr = (1 - decay) * g * g;
+		ESquareGrad[i] = decay * ESquareGrad[i] + gradSqr;
+		histGrad[i] = histDecay * histGrad[i] + gradSqr;
+
+		float EgRank = gradDecay * rankGrad[i] + gradHist * histGrad[i];
+		float EdRank = deltaDecay * rankDelta[i] + deltaHist * histDelta[i];
+		float delta = sqrtf(EdRank + stableConst) * s_rsqrt(EgRank + stableConst) * g;
+		params[i] -= s_momentum<M>(delta, momentum, i);
+
+		float deltaSqr = (1 - decay) * delta * delta;
+		ESquareDelta[i] = decay * ESquareDelta[i] + deltaSqr;
+		histDelta[i] = histDecay * histDelta[i] + deltaSqr;
+		rankGrad[i] = ESquareGrad[i] - slaveDecay * histGrad[i];
+		rankDelta[i] = ESquareDelta[i] - slaveDecay * histDelta[i];
+	}
+}
+
+void kernel_axpby (float *y, float a, float *x, float b, long dim) {
+	long i = 0;
+	#ifdef KERNEL_SIMD
+		vfloat vec_a = v_set(a);
+		vfloat vec_b = v_set(b);
+		for (; i+KERNEL_WIDTH<=dim; i+=KERNEL_WIDTH) {
+			v_store(y + i, v_fmadd(vec_a, v_load(y + i), v_mul(vec_b, v_load(x + i))));
+		}
+	#endif
+	for (; i<dim; ++i) {
+		y[i] = a * y[i] + b * x[i];
+	}
+}
+
+template <class M, class C>
+static void kernel_wide_adadelta_t (float *params, float *grad, float gradScale, float *ESquareGrad, float *ESquareDelta,
+	double *histGrad, double *histDelta, float *rankGrad, float *rankGradLow, float *rankDelta, float *rankDeltaLow,
+	double gradDecay, double gradHist, double deltaDecay, double deltaHist,
+	float decay, float slaveDecay, float stableConst, long dim, kernelMomentum *momentum) {
+	// H and K cancel in the snapshots, so they are summed in double (see kernelAdadelta)
+	double histDecay = (double) slaveDecay / decay;
+	long i = 0;
+	#ifdef KERNEL_SIMD
+		const long half = KERNEL_WIDTH / 2;
+		vfloat vec_gradScale = v_set(gradScale);
+		vfloat vec_decay = v_set(decay);
+		vfloat vec_keep = v_set(1.f - decay);
+		vfloat vec_const = v_set(stableConst);
+		vdouble vec_histDecay = vd_set(histDecay);
+		vdouble vec_slaveDecay = vd_set(-slaveDecay);
+		vdouble vec_gradDecay = vd_set(gradDecay);
+		vdouble vec_gradHist = vd_set(gradHist);
+		vdouble vec_deltaDecay = vd_set(deltaDecay);
+		vdouble vec_deltaHist = vd_set(deltaHist);
+		for (; i+KERNEL_WIDTH<=dim; i+=KERNEL_WIDTH) {
+			vfloat g = v_clip<C>(v_load(grad + i), vec_gradScale);
+			vfloat gradSqr = v_mul(vec_keep, v_mul(g, g));
+			vfloat Eg = v_fmadd(vec_decay, v_load(ESquareGrad + i), gradSqr);
+			vdouble HgLow = vd_fmadd(vec_histDecay, vd_load(histGrad + i), vd_low(gradSqr));
+			vdouble HgHigh = vd_fmadd(vec_histDecay, vd_load(histGrad + i + half), vd_high(gradSqr));
+			vdouble HdLow = vd_load(histDelta + i);
+			vdouble HdHigh = vd_load(histDelta + i + half);
+
+			// the sender's snapshots, grad one step ahead of delta as in the eager loop
+			vfloat Kg = v_load(rankGrad + i);
+			vfloat KgLow = v_load(rankGradLow + i);
+			vfloat Kd = v_load(rankDelta + i);
+			vfloat KdLow = v_load(rankDeltaLow + i);
+			vfloat EgRank = v_narrow(vd_fmadd(vec_gradDecay, vd_pair_low(Kg, KgLow), vd_mul(vec_gradHist, HgLow)),
+				vd_fmadd(vec_gradDecay, vd_pair_high(Kg, KgLow), vd_mul(vec_gradHist, HgHigh)));
+			vfloat EdRank = v_narrow(vd_fmadd(vec_deltaDecay, vd_pair_low(Kd, KdLow), vd_mul(vec_deltaHist, HdLow)),
+				vd_fmadd(vec_deltaDecay, vd_pair_high(Kd, KdLow), vd_mul(vec_deltaHist, HdHigh)));
+			vfloat delta = v_mul(v_sqrt(v_add(EdRank, vec_const)), v_mul(v_rsqrt(v_add(EgRank, vec_const)), g));
+			v_store(params + i, v_sub(v_load(params + i), v_momentum<M>(delta, momentum, i)));
+
+			vfloat deltaSqr = v_mul(vec_keep, v_mul(delta, delta));
+			vfloat Ed = v_fmadd(vec_decay, v_load(ESquareDelta + i), deltaSqr);
+			HdLow = vd_fmadd(vec_histDecay, HdLow, vd_low(deltaSqr));
+			HdHigh = vd_fmadd(vec_histDecay, HdHigh, vd_high(deltaSqr));
+			v_store(ESquareGrad + i, Eg);
+			v_store(ESquareDelta + i, Ed);
+			vd_store(histGrad + i, HgLow);
+			vd_store(histGrad + i + half, HgHigh);
+			vd_store(histDelta + i, HdLow);
+			vd_store(histDelta + i + half, HdHigh);
+			v_store_pair(rankGrad + i, rankGradLow + i, vd_fmadd(vec_slaveDecay, HgLow, vd_low(Eg)),
+				vd_fmadd(vec_slaveDecay, HgHigh, vd_high(Eg)));
+			v_store_pair(rankDelta + i, rankDeltaLow + i, vd_fmadd(vec_slaveDecay, HdLow, vd_low(Ed)),
+				vd_fmadd(vec_slaveDecay, HdHigh, vd_high(Ed)));
+		}
+	#endif
+	for (; i<dim; ++i) {
+		float g = s_clip<C>(grad[i], gradScale);
+		float gradSqr = (1 - decay) * g * g;
+		ESquareGrad[i] = decay * ESquareGrad[i] + gradSqr;
+		double Hg = histDecay * histGrad[i] + gradSqr;
+		double Hd = histDelta[i];
+
+		// the sender's snapshots, grad one step ahead of delta as in the eager loop
+		float EgRank = (float) (gradDecay * ((double) rankGrad[i] + rankGradLow[i]) + gradHist * Hg);
+		float EdRank = (float) (deltaDecay * ((double) rankDelta[i] + rankDeltaLow[i]) + deltaHist * Hd);
+		float delta = sqrtf(EdRank + stableConst) * s_rsqrt(EgRank + stableConst) * g;
+		params[i] -= s_momentum<M>(delta, momentum, i);
+
+		float deltaSqr = (1 - decay) * delta * delta;
+		ESquareDelta[i] = decay * ESquareDelta[i] + deltaSqr;
+		Hd = histDecay * Hd + deltaSqr;
+		histGrad[i] = Hg;
+		histDelta[i] = Hd;
+		s_split(ESquareGrad[i] - slaveDecay * Hg, rankGrad + i, rankGradLow + i);
+		s_split(ESquareDelta[i] - slaveDecay * Hd, rankDelta + i, rankDeltaLow + i);
+	}
+}
+
+void kernel_axpby_pair (float *y, float *yLow, double a, double *x, double b, long dim) {
+	long i = 0;
+	#ifdef KERNEL_SIMD
+		const long half = KERNEL_WIDTH / 2;
+		vdouble vec_a = vd_set(a);
+		vdouble vec_b = vd_set(b);
+		for (; i+KERNEL_WIDTH<=dim; i+=KERNEL_WIDTH) {
+			vfloat hi = v_load(y + i);
+			vfloat lo = v_load(yLow + i);
+			v_store_pair(y + i, yLow + i, vd_fmadd(vec_a, vd_pair_low(hi, lo), vd_mul(vec_b, vd_load(x + i))),
+				vd_fmadd(vec_a, vd_pair_high(hi, lo), vd_mul(vec_b, vd_load(x + i + half))));
+		}
+	#endif
+	for (; i<dim; ++i) {
+		s_split(a * ((double) y[i] + yLow[i]) + b * x[i], y + i, yLow + i);
+	}
+}
+
+template <class M, class C>
+static void kernel_delayed_adadelta_t (float *params, float *grad, float gradScale, float *ESquareGrad, float *ESquareDelta,
+	float *slaveESquareGrad, float decay, float stableConst, long dim, kernelMomentum *momentum) {
+	// NOTE: the original step scaled g by sqrt(Hs + c) / sqrt(Hs + c) with Hs the
+	// slave's grad snapshot, which is 1: delta is g, the snapshot is only refreshed
+	long i = 0;
+	#ifdef KERNEL_SIMD
+		vfloat vec_gradScale = v_set(gradScale);
+		vfloat vec_decay = v_set(decay);
+		vfloat vec_keep = v_set(1.f - decay);
+		for (; i+KERNEL_WIDTH<=dim; i+=KERNEL_WIDTH) {
+			vfloat g = v_clip<C>(v_load(grad + i), vec_gradScale);
+			vfloat Eg = v_fmadd(vec_decay, v_load(ESquareGrad + i), v_mul(vec_keep, v_mul(g, g)));
+			vfloat delta = g;
+			v_store(params + i, v_sub(v_load(params + i), v_momentum<M>(delta, momentum, i)));
+			vfloat Ed = v_fmadd(vec_decay, v_load(ESquareDelta + i), v_mul(vec_keep, v_mul(delta, delta)));
+			v_store(ESquareGrad + i, Eg);
+			v_store(ESquareDelta + i, Ed);
+			v_store(slaveESquareGrad + i, Eg);
+		}
+	#endif
+	for (; i<dim; ++i) {
+		float g = s_clip<C>(grad[i], gradScale);
+		ESquareGrad[i] = decay * ESquareGrad[i] + (1 - decay) * g * g;
+		float delta = g;
+		params[i] -= s_momentum<M>(delta, momentum, i);
+		ESquareDelta[i] = decay * ESquareDelta[i] + (1 - decay) * delta * delta;
+		slaveESquareGrad[i] = ESquareGrad[i];
+	}
+}
+
+template <class M, class D, class C>
+static void kernel_adam_t (float *params, float *grad, float gradScale, float *firstMoment, float *secondMoment, float beta1, float beta2,
+	float correct1, float correct2, float epsilon, float rate, float weightDecay, long dim, kernelMomentum *momentum) {
+	// sqrt(v * c2) = sqrt(v) * sqrt(c2), the bias corrections stay scalars
+	float sqrtCorrect2 = sqrtf(correct2);
+	float rateCorrect1 = rate * correct1;
+	float rateDecay = rate * weightDecay;
+	long i = 0;
+	#ifdef KERNEL_SIMD
+		vfloat vec_gradScale = v_set(gradScale);
+		vfloat vec_beta1 = v_set(beta1);
+		vfloat vec_keep1 = v_set(1.f - beta1);
+		vfloat vec_beta2 = v_set(beta2);
+		vfloat vec_keep2 = v_set(1.f - beta2);
+		vfloat vec_sqrtCorrect2 = v_set(sqrtCorrect2);
+		vfloat vec_eps = v_set(epsilon);
+		vfloat vec_rateCorrect1 = v_set(rateCorrect1);
+		vfloat vec_rateDecay = v_set(rateDecay);
+		for (; i+KERNEL_WIDTH<=dim; i+=KERNEL_WIDTH) {
+			vfloat g = v_clip<C>(v_load(grad + i), vec_gradScale);
+			vfloat m = v_fmadd(vec_beta1, v_load(firstMoment + i), v_mul(vec_keep1, g));
+			vfloat v = v_fmadd(vec_beta2, v_load(secondMoment + i), v_mul(vec_keep2, v_mul(g, g)));
+			v_store(firstMoment + i, m);
+			v_store(secondMoment + i, v);
+			vfloat p = v_load(params + i);
+			vfloat denom = v_fmadd(v_sqrt(v), vec_sqrtCorrect2, vec_eps);
+			vfloat step = v_decay<D>(v_div(v_mul(vec_rateCorrect1, m), denom), vec_rateDecay, p);
+			v_store(params + i, v_sub(p, v_momentum<M>(step, momentum, i)));
+		}
+	#endif
+	for (; i<dim; ++i) {
+		float g = s_clip<C>(grad[i], gradScale);
+		firstMoment[i] = beta1 * firstMoment[i] + (1 - beta1) * g;
+		secondMoment[i] = beta2 * secondMoment[i] + (1 - beta2) * g * g;
+		float step = s_decay<D>(rateCorrect1 * firstMoment[i] / (sqrtf(secondMoment[i]) * sqrtCorrect2 + epsilon), rateDecay, params[i]);
+		params[i] -= s_momentum<M>(step, momentum, i);
+	}
+}
+
+template <class D, class C>
+static void kernel_lamb_norms_t (float *params, float *grad, float gradScale, float *firstMoment, float *secondMoment, float beta1, float beta2,
+	float correct1, float correct2, float epsilon, float weightDecay, long dim, float *paramNormSqr, float *stepNormSqr) {
+	float sqrtCorrect2 = sqrtf(correct2);
+	float paramSum = 0.f;
+	float stepSum = 0.f;
+	long i = 0;
+	#ifdef KERNEL_SIMD
+		vfloat vec_gradScale = v_set(gradScale);
+		vfloat vec_beta1 = v_set(beta1);
+		vfloat vec_keep1 = v_set(1.f - beta1);
+		vfloat vec_beta2 = v_set(beta2);
+		vfloat vec_keep2 = v_set(1.f - beta2);
+		vfloat vec_sqrtCorrect2 = v_set(sqrtCorrect2);
+		vfloat vec_eps = v_set(epsilon);
+		vfloat vec_correct1 = v_set(correct1);
+		vfloat vec_decay = v_set(weightDecay);
+		vfloat vec_paramSum = v_set(0.f);
+		vfloat vec_stepSum = v_set(0.f);
+		for (; i+KERNEL_WIDTH<=dim; i+=KERNEL_WIDTH) {
+			vfloat g = v_clip<C>(v_load(grad + i), vec_gradScale);
+			vfloat m = v_fmadd(vec_beta1, v_load(firstMoment + i), v_mul(vec_keep1, g));
+			vfloat v = v_fmadd(vec_beta2, v_load(secondMoment + i), v_mul(vec_keep2, v_mul(g, g)));
+			v_store(firstMoment + i, m);
+			v_store(secondMoment + i, v);
+			vfloat p = v_load(params + i);
+			vfloat denom = v_fmadd(v_sqrt(v), vec_sqrtCorrect2, vec_eps);
+			vfloat r = v_decay<D>(v_div(v_mul(vec_correct1, m), denom), vec_decay, p);
+			vec_paramSum = v_fmadd(p, p, vec_paramSum);
+			vec_stepSum = v_fmadd(r, r, vec_stepSum);
+		}
+		paramSum = v_sum(vec_paramSum);
+		stepSum = v_sum(vec_stepSum);
+	#endif
+	for (; i<dim; ++i) {
+		float g = s_clip<C>(grad[i], gradScale);
+		firstMoment[i] = beta1 * firstMoment[i] + (1 - beta1) * g;
+		secondMoment[i] = beta2 * secondMoment[i] + (1 - beta2) * g * g;
+		float r = s_decay<D>(correct1 * firstMoment[i] / (sqrtf(secondMoment[i]) * sqrtCorrect2 + epsilon), weightDecay, params[i]);
+		paramSum += params[i] * params[i];
+		stepSum += r * r;
+	}
+	*paramNormSqr = paramSum;
+	*stepNormSqr = stepSum;
+}
+
+template <class M, class D>
+static void kernel_lamb_apply_t (float *params, float *firstMoment, float *secondMoment, float correct1, float correct2,
+	float epsilon, float rate, float weightDecay, long dim, kernelMomentum *momentum) {
+	float sqrtCorrect2 = sqrtf(correct2);
+	float rateCorrect1 = rate * correct1;
+	float rateDecay = rate * weightDecay;
+	long i = 0;
+	#ifdef KERNEL_SIMD
+		vfloat vec_sqrtCorrect2 = v_set(sqrtCorrect2);
+		vfloat vec_eps = v_set(epsilon);
+		vfloat vec_rateCorrect1 = v_set(rateCorrect1);
+		vfloat vec_rateDecay = v_set(rateDecay);
+		for (; i+KERNEL_WIDTH<=dim; i+=KERNEL_WIDTH) {
+			vfloat p = v_load(params + i);
+			vfloat denom = v_fmadd(v_sqrt(v_load(secondMoment + i)), vec_sqrtCorrect2, vec_eps);
+			vfloat step = v_decay<D>(v_div(v_mul(vec_rateCorrect1, v_load(firstMoment + i)), denom), vec_rateDecay, p);
+			v_store(params + i, v_sub(p, v_momentum<M>(step, momentum, i)));
+		}
+	#endif
+	for (; i<dim; ++i) {
+		float step = s_decay<D>(rateCorrect1 * firstMoment[i] / (sqrtf(secondMoment[i]) * sqrtCorrect2 + epsilon), rateDecay, params[i]);
+		params[i] -= s_momentum<M>(step, momentum, i);
+	}
+}
+
+/****************************************************************
+* Dispatch tables: one instance per policy combination, indexed
+* [momentum policy], [weight decay off/on] and [clipping off/on].
+* The kernel_* entry points pick from them per call for callers
+* that only hold a kernelMomentum pointer (benchmarks, tests).
+****************************************************************/
+
+#define KERNEL_CLIP_TABLE(name, ...) {name<__VA_ARGS__, clipOff>, name<__VA_ARGS__, clipOn>}
+#define KERNEL_MOMENTUM_TABLE(name) {KERNEL_CLIP_TABLE(name, momentumOff), \
+	KERNEL_CLIP_TABLE(name, momentumHeavyBall), KERNEL_CLIP_TABLE(name, momentumNesterov)}
+#define KERNEL_DECAY_TABLE(name, M) {KERNEL_CLIP_TABLE(name, M, decayOff), KERNEL_CLIP_TABLE(name, M, decayOn)}
+
+const sgdKernel kernel_sgd_table[KERNEL_NPOLICY][2] = KERNEL_MOMENTUM_TABLE(kernel_sgd_t);
+const adagradKernel kernel_adagrad_table[KERNEL_NPOLICY][2] = KERNEL_MOMENTUM_TABLE(kernel_adagrad_t);
+const delayedAdagradKernel kernel_delayed_adagrad_table[KERNEL_NPOLICY][2] = KERNEL_MOMENTUM_TABLE(kernel_delayed_adagrad_t);
+const futureAdagradKernel kernel_future_adagrad_table[KERNEL_NPOLICY][2] = KERNEL_MOMENTUM_TABLE(kernel_future_adagrad_t);
+const rmspropKernel kernel_rmsprop_table[KERNEL_NPOLICY][2] = KERNEL_MOMENTUM_TABLE(kernel_rmsprop_t);
+const adadeltaKernel kernel_adadelta_table[KERNEL_NPOLICY][2] = KERNEL_MOMENTUM_TABLE(kernel_adadelta_t);
+const kernelAdadeltaKernel kernel_kernel_adadelta_table[KERNEL_NPOLICY][2] = KERNEL_MOMENTUM_TABLE(kernel_kernel_adadelta_t);
+const wideAdadeltaKernel kernel_wide_adadelta_table[KERNEL_NPOLICY][2] = KERNEL_MOMENTUM_TABLE(kernel_wide_adadelta_t);
+const delayedAdadeltaKernel kernel_delayed_adadelta_table[KERNEL_NPOLICY][2] = KERNEL_MOMENTUM_TABLE(kernel_delayed_adadelta_t);
+
+const adamKernel kernel_adam_table[KERNEL_NPOLICY][2][2] = {
+	KERNEL_DECAY_TABLE(kernel_adam_t, momentumOff),
+	KERNEL_DECAY_TABLE(kernel_adam_t, momentumHeavyBall),
+	KERNEL_DECAY_TABLE(kernel_adam_t, momentumNesterov)
+};
+const lambNormsKernel kernel_lamb_norms_table[2][2] = {
+	KERNEL_CLIP_TABLE(kernel_lamb_norms_t, decayOff),
+	KERNEL_CLIP_TABLE(kernel_lamb_norms_t, decayOn)
+};
+const lambApplyKernel kernel_lamb_apply_table[KERNEL_NPOLICY][2] = {
+	{kernel_lamb_apply_t<momentumOff, decayOff>, kernel_lamb_apply_t<momentumOff, decayOn>},
+	{kernel_lamb_apply_t<momentumHeavyBall, decayOff>, kernel_lamb_apply_t<momentumHeavyBall, decayOn>},
+	{kernel_lamb_apply_t<momentumNesterov, decayOff>, kernel_lamb_apply_t<momentumNesterov, decayOn>}
+};
+
+int kernel_policy (kernelMomentum *momentum) {
+	if (momentum == NULL) {
+		return KERNEL_PLAIN;
+	}
+	return momentum->nesterov ? KERNEL_NESTEROV : KERNEL_HEAVY_BALL;
+}
+
+void kernel_sgd (float *params, float *grad, float rate, long dim, kernelMomentum *momentum) {
+	kernel_sgd_table[kernel_policy(momentum)][0](params, grad, 1.f, rate, dim, momentum);
+}
+
+void kernel_adagrad (float *params, float *grad, float *hist, float rate, long dim, kernelMomentum *momentum) {
+	kernel_adagrad_table[kernel_policy(momentum)][0](params, grad, 1.f, hist, rate, dim, momentum);
+}
+
+void kernel_delayed_adagrad (float *params, float *grad, float *hist, float *slaveHist, float rate, long dim, kernelMomentum *momentum) {
+	kernel_delayed_adagrad_table[kernel_policy(momentum)][0](params, grad, 1.f, hist, slaveHist, rate, dim, momentum);
+}
+
+void kernel_future_adagrad (float *params, float *grad, float *hist, float *slaveHist, float rate, float stableConst, long dim, kernelMomentum *momentum) {
+	kernel_future_adagrad_table[kernel_policy(momentum)][0](params, grad, 1.f, hist, slaveHist, rate, stableConst, dim, momentum);
+}
+
+void kernel_rmsprop (float *params, float *grad, float *meanSquare, float decay, long dim, kernelMomentum *momentum) {
+	kernel_rmsprop_table[kernel_policy(momentum)][0](params, grad, 1.f, meanSquare, decay, dim, momentum);
+}
+
+void kernel_adadelta (float *params, float *grad, float *ESquareGrad, float *ESquareDelta, float decay, float stableConst, long dim, kernelMomentum *momentum) {
+	kernel_adadelta_table[kernel_policy(momentum)][0](params, grad, 1.f, ESquareGrad, ESquareDelta, decay, stableConst, dim, momentum);
+}
+
+void kernel_kernel_adadelta (float *params, float *grad, float *ESquareGrad, float *ESquareDelta,
+	float *histGrad, float *histDelta, float *rankGrad, float *rankDelta,
+	float gradDecay, float gradHist, float deltaDecay, float deltaHist,
+	float decay, float slaveDecay, float stableConst, long dim, kernelMomentum *momentum) {
+	kernel_kernel_adadelta_table[kernel_policy(momentum)][0](params, grad, 1.f, ESquareGrad, ESquareDelta, histGrad, histDelta,
+		rankGrad, rankDelta, gradDecay, gradHist, deltaDecay, deltaHist, decay, slaveDecay, stableConst, dim, momentum);
+}
+
+void kernel_delayed_adadelta (float *params, float *grad, float *ESquareGrad, float *ESquareDelta,
+	float *slaveESquareGrad, float decay, float stableConst, long dim, kernelMomentum *momentum) {
+	kernel_delayed_adadelta_table[kernel_policy(momentum)][0](params, grad, 1.f, ESquareGrad, ESquareDelta,
+		slaveESquareGrad, decay, stableConst, dim, momentum);
+}
+
+void kernel_adam (float *params, float *grad, float *firstMoment, float *secondMoment, float beta1, float beta2,
+	float correct1, float correct2, float epsilon, float rate, float weightDecay, long dim, kernelMomentum *momentum) {
+	kernel_adam_table[kernel_policy(momentum)][weightDecay != 0.f][0](params, grad, 1.f, firstMoment, secondMoment,
+		beta1, beta2, correct1, correct2, epsilon, rate, weightDecay, dim, momentum);
+}
+
+void kernel_lamb_norms (float *params, float *grad, float *firstMoment, float *secondMoment, float beta1, float beta2,
+	float correct1, float correct2, float epsilon, float weightDecay, long dim, float *paramNormSqr, float *stepNormSqr) {
+	kernel_lamb_norms_table[weightDecay != 0.f][0](params, grad, 1.f, firstMoment, secondMoment, beta1, beta2,
+		correct1, correct2, epsilon, weightDecay, dim, paramNormSqr, stepNormSqr);
+}
+
+void kernel_lamb_apply (float *params, float *firstMoment, float *secondMoment, float correct1, float correct2,
+	float epsilon, float rate, float weightDecay, long dim, kernelMomentum *momentum) {
+	kernel_lamb_apply_table[kernel_policy(momentum)][weightDecay != 0.f](params, firstMoment, secondMoment,
+		correct1, correct2, epsilon, rate, weightDecay, dim, momentum);
+}
+
+float kernel_sqnorm (float *x, long dim) {
+	long i = 0;
+	float sum = 0.f;
+	#ifdef KERNEL_SIMD
+		vfloat vec_sum = v_set(0.f);
+		for (; i+KERNEL_WIDTH<=dim; i+=KERNEL_WIDTH) {
+			vfloat a = v_load(x + i);
+			vec_sum = v_fmadd(a, a, vec_sum);
+		}
+		sum = v_sum(vec_sum);
+	#endif
+	for (; i<dim; ++i) {
+		sum += x[i] * x[i];
+	}
+	return sum;
+}
+
+void kernel_scale (float *x, float scale, long dim) {
+	long i = 0;
+	#ifdef KERNEL_SIMD
+		vfloat vec_scale = v_set(scale);
+		for (; i+KERNEL_WIDTH<=dim; i+=KERNEL_WIDTH) {
+			v_store(x + i, v_mul(vec_scale, v_load(x + i)));
+		}
+	#endif
+	for (; i<dim; ++i) {
+		x[i] *= scale;
+	}
+}
+
+/****************************************************************
+* Sparse kernels: gathers of a few entries, scalar on purpose
+****************************************************************/
+
+void kernel_sparse_sgd (float *params, int *index, float *value, float rate, int nnz) {
+	for (int k=0; k<nnz; ++k) {
+		params[index[k]] -= rate * value[k];
+	}
+}
+
+void kernel_sparse_adagrad (float *params, int *index, float *value, float *hist, float rate, int nnz) {
+	for (int k=0; k<nnz; ++k) {
+		int i = index[k];
+		hist[i] += value[k] * value[k];
+		params[i] -= rate * value[k] * s_rsqrt(hist[i]);
+	}
+}
+
+void kernel_sparse_rmsprop (float *params, int *index, float *value, float *meanSquare, int *lastStep, int step,
+	float decay, int nnz) {
+	for (int k=0; k<nnz; ++k) {
+		int i = index[k];
+		float catchUp = powf(decay, step - 1 - lastStep[i]);
+		meanSquare[i] = decay * catchUp * meanSquare[i] + (1 - decay) * value[k] * value[k];
+		if (value[k] != 0.f) {
+			params[i] -= value[k] * s_rsqrt(meanSquare[i]);
+		}
+		lastStep[i] = step;
+	}
+}
+
+void kernel_sparse_adadelta (float *params, int *index, float *value, float *ESquareGrad, float *ESquareDelta,
+	int *lastStep, int step, float decay, float stableConst, int nnz) {
+	for (int k=0; k<nnz; ++k) {
+		int i = index[k];
+		// zero grads give zero deltas, so both averages only decayed meanwhile
+		float catchUp = powf(decay, step - 1 - lastStep[i]);
+		ESquareGrad[i] = decay * catchUp * ESquareGrad[i] + (1 - decay) * value[k] * value[k];
+		float delta = sqrtf(catchUp * ESquareDelta[i] + stableConst) * s_rsqrt(ESquareGrad[i] + stableConst) * value[k];
+		params[i] -= delta;
+		ESquareDelta[i] = decay * catchUp * ESquareDelta[i] + (1 - decay) * delta * delta;
+		lastStep[i] = step;
+	}
+}
+
+static inline unsigned short s_to_half (float x) {
+	unsigned int bits;
+	memcpy(&bits, &x, sizeof(bits));
+	unsigned int sign = (bits >> 16) & 0x8000;
+	unsigned int absBits = bits & 0x7fffffff;
+	if (absBits >= 0x7f800000) {
+		// inf stays inf, nan stays a quiet nan
+		return sign | 0x7c00 | ((absBits > 0x7f800000) ? 0x200 : 0);
+	}
+	if (absBits >= 0x477ff000) {
+		return sign | 0x7c00;
+	}
+	if (absBits < 0x38800000) {
+		// subnormal half: shift the implicit one in and round at the new position
+		if (absBits < 0x33000000) {
+			return sign;
+		}
+		unsigned int mant = (absBits & 0x7fffff) | 0x800000;
+		int shift = 126 - (absBits >> 23);
+		unsigned int half = mant >> shift;
+		unsigned int rest = mant & ((1u << shift) - 1);
+		unsigned int halfway = 1u << (shift - 1);
+		if (rest > halfway || (rest == halfway && (half & 1))) {
+			half += 1;
+		}
+		return sign | half;
+	}
+	unsigned int half = (absBits - 0x38000000) >> 13;
+	unsigned int rest = absBits & 0x1fff;
+	if (rest > 0x1000 || (rest == 0x1000 && (half & 1))) {
+		half += 1;
+	}
+	return sign | half;
+}
+
+static inline float s_from_half (unsigned short h) {
+	unsigned int sign = (unsigned int) (h & 0x8000) << 16;
+	unsigned int exponent = (h >> 10) & 0x1f;
+	unsigned int mant = h & 0x3ff;
+	unsigned int bits;
+	if (exponent == 0x1f) {
+		bits = sign | 0x7f800000 | (mant << 13);
+	} else if (exponent != 0) {
+		bits = sign | ((exponent + 112) << 23) | (mant << 13);
+	} else if (mant == 0) {
+		bits = sign;
+	} else {
+		// subnormal half, normalize
+		exponent = 113;
+		while (!(mant & 0x400)) {
+			mant <<= 1;
+			exponent -= 1;
+		}
+		bits = sign | (exponent << 23) | ((mant & 0x3ff) << 13);
+	}
+	float x;
+	memcpy(&x, &bits, sizeof(x));
+	return x;
+}
+
+void kernel_to_half (unsigned short *half, float *x, long dim) {
+	long i = 0;
+	#ifdef __F16C__
+		for (; i+8<=dim; i+=8) {
+			_mm_storeu_si128((__m128i *) (half + i), _mm256_cvtps_ph(_mm256_loadu_ps(x + i), _MM_FROUND_TO_NEAREST_INT));
+		}
+	#endif
+	for (; i<dim; ++i) {
+		half[i] = s_to_half(x[i]);
+	}
+}
+
+void kernel_from_half (float *x, unsigned short *half, long dim) {
+	long i = 0;
+	#ifdef __F16C__
+		for (; i+8<=dim; i+=8) {
+			_mm256_storeu_ps(x + i, _mm256_cvtph_ps(_mm_loadu_si128((__m128i *) (half + i))));
+		}
+	#endif
+	for (; i<dim; ++i) {
+		x[i] = s_from_half(half[i]);
+	}
+}
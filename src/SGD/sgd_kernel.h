@@ -0,0 +1,171 @@
+#ifndef __SGD_KERNEL_H__
+#define __SGD_KERNEL_H__
+
+/****************************************************************
+* Fused element-wise update kernels of the SGD solvers. Each one
+* reads and writes every array exactly once (accumulators, params
+* and the per-slave snapshots that used to be memcpy'd afterwards).
+* The vector path is picked at compile time: AVX-512F, AVX with
+* FMA (AVX2 class cpus), plain AVX, otherwise the scalar loop.
+* 1/sqrt is the hardware estimate refined by one Newton step.
+****************************************************************/
+
+#if defined(__AVX512F__)
+	#define SGD_KERNEL_ISA "avx512"
+#elif defined(__AVX__) && defined(__FMA__)
+	#define SGD_KERNEL_ISA "avx2+fma"
+#elif defined(__AVX__)
+	#define SGD_KERNEL_ISA "avx"
+#else
+	#define SGD_KERNEL_ISA "scalar"
+#endif
+
+// heavy-ball or Nesterov velocity applied to the step of any kernel:
+// v = mu * v + step, then p -= v (heavy ball) or p -= mu * v + step (Nesterov).
+// Pass NULL to step the params directly.
+struct kernelMomentum {
+	float *velocity;
+	float factor;
+	bool nesterov;
+};
+
+// compile-time momentum policies of the kernel instances, same numbering as "use momentum"
+enum kernelPolicy {
+	KERNEL_PLAIN = 0,
+	KERNEL_HEAVY_BALL = 1,
+	KERNEL_NESTEROV = 2,
+	KERNEL_NPOLICY = 3
+};
+
+// policy of a momentum pointer (NULL: plain)
+int kernel_policy (kernelMomentum *momentum);
+
+// p -= rate * g
+void kernel_sgd (float *params, float *grad, float rate, long dim, kernelMomentum *momentum);
+
+// h += g^2, p -= rate * g / sqrt(h)
+void kernel_adagrad (float *params, float *grad, float *hist, float rate, long dim, kernelMomentum *momentum);
+
+// h += g^2, p -= rate * g / sqrt(hs + g^2), hs = h
+void kernel_delayed_adagrad (float *params, float *grad, float *hist, float *slaveHist, float rate, long dim, kernelMomentum *momentum);
+
+// h += g^2, p -= rate * g / sqrt(h - hs + c), hs = h
+void kernel_future_adagrad (float *params, float *grad, float *hist, float *slaveHist, float rate, float stableConst, long dim, kernelMomentum *momentum);
+
+// m = d * m + (1-d) * g^2, p -= g / sqrt(m) where g != 0 (m has no epsilon, a param
+// that never had a grad keeps m = 0)
+void kernel_rmsprop (float *params, float *grad, float *meanSquare, float decay, long dim, kernelMomentum *momentum);
+
+// Eg = d * Eg + (1-d) * g^2, delta = sqrt(Ed + c) / sqrt(Eg + c) * g, p -= delta, Ed = d * Ed + (1-d) * delta^2
+void kernel_adadelta (float *params, float *grad, float *ESquareGrad, float *ESquareDelta, float decay, float stableConst, long dim, kernelMomentum *momentum);
+
+// adadelta whose step uses the lazily decayed snapshots of the sending slave (see kernelAdadelta):
+// Hx = (c/d) * Hx + (1-d) * x for x = g^2 and delta^2, the sender's snapshots read as
+// gradDecay * Kg + gradHist * Hg and deltaDecay * Kd + deltaHist * Hd (before its update),
+// then are reset to K = E - c * H. Touches O(dim) memory whatever the number of slaves.
+void kernel_kernel_adadelta (float *params, float *grad, float *ESquareGrad, float *ESquareDelta,
+	float *histGrad, float *histDelta, float *rankGrad, float *rankDelta,
+	float gradDecay, float gradHist, float deltaDecay, float deltaHist,
+	float decay, float slaveDecay, float stableConst, long dim, kernelMomentum *momentum);
+
+// y = a * y + b * x
+void kernel_axpby (float *y, float a, float *x, float b, long dim);
+
+// y + yLow = a * (y + yLow) + b * x with y + yLow a float pair (about 48 bits)
+void kernel_axpby_pair (float *y, float *yLow, double a, double *x, double b, long dim);
+
+// sparse grads (nnz ascending indices and values): only the listed params are stepped, the
+// accumulators of the decaying solvers first catch up on the step - 1 - lastStep[i] updates
+// that had a zero grad for them (a zero grad only decays them), lastStep[i] = step after;
+// like the dense kernels, rmsprop leaves params with a zero value unchanged
+void kernel_sparse_sgd (float *params, int *index, float *value, float rate, int nnz);
+void kernel_sparse_adagrad (float *params, int *index, float *value, float *hist, float rate, int nnz);
+void kernel_sparse_rmsprop (float *params, int *index, float *value, float *meanSquare, int *lastStep, int step,
+	float decay, int nnz);
+void kernel_sparse_adadelta (float *params, int *index, float *value, float *ESquareGrad, float *ESquareDelta,
+	int *lastStep, int step, float decay, float stableConst, int nnz);
+
+// IEEE half precision storage (F16C when available), round to nearest even
+void kernel_to_half (unsigned short *half, float *x, long dim);
+void kernel_from_half (float *x, unsigned short *half, long dim);
+
+// m = b1 * m + (1-b1) * g, v = b2 * v + (1-b2) * g^2,
+// p -= rate * (m * c1 / (sqrt(v * c2) + eps) + wd * p) with bias corrections c1, c2 (wd = 0: adam)
+void kernel_adam (float *params, float *grad, float *firstMoment, float *secondMoment, float beta1, float beta2,
+	float correct1, float correct2, float epsilon, float rate, float weightDecay, long dim, kernelMomentum *momentum);
+
+// first LAMB pass over one layer: moments as in kernel_adam, returns |p|^2 and |r|^2
+// with r = m * c1 / (sqrt(v * c2) + eps) + wd * p the unscaled step
+void kernel_lamb_norms (float *params, float *grad, float *firstMoment, float *secondMoment, float beta1, float beta2,
+	float correct1, float correct2, float epsilon, float weightDecay, long dim, float *paramNormSqr, float *stepNormSqr);
+
+// second LAMB pass: p -= rate * r, rate already scaled by the layer's trust ratio
+void kernel_lamb_apply (float *params, float *firstMoment, float *secondMoment, float correct1, float correct2,
+	float epsilon, float rate, float weightDecay, long dim, kernelMomentum *momentum);
+
+// adadelta whose step uses the grad snapshot of the sending slave, which is then refreshed
+void kernel_delayed_adadelta (float *params, float *grad, float *ESquareGrad, float *ESquareDelta,
+	float *slaveESquareGrad, float decay, float stableConst, long dim, kernelMomentum *momentum);
+
+/****************************************************************
+* Specialized instances of the kernels above, one per momentum
+* policy, clipping off/on (the grad is read as gradScale * g) and
+* weight decay off/on for the adam family, with no feature test
+* left in the loop. A solver picks its entry once per update, e.g.
+* kernel_adagrad_table[m_useMomentum][clip]; the kernel_* entry
+* points above run the unclipped instances.
+****************************************************************/
+
+typedef void (*sgdKernel) (float *params, float *grad, float gradScale, float rate, long dim, kernelMomentum *momentum);
+typedef void (*adagradKernel) (float *params, float *grad, float gradScale, float *hist, float rate, long dim,
+	kernelMomentum *momentum);
+typedef void (*delayedAdagradKernel) (float *params, float *grad, float gradScale, float *hist, float *slaveHist,
+	float rate, long dim, kernelMomentum *momentum);
+typedef void (*futureAdagradKernel) (float *params, float *grad, float gradScale, float *hist, float *slaveHist,
+	float rate, float stableConst, long dim, kernelMomentum *momentum);
+typedef void (*rmspropKernel) (float *params, float *grad, float gradScale, float *meanSquare, float decay, long dim,
+	kernelMomentum *momentum);
+typedef void (*adadeltaKernel) (float *params, float *grad, float gradScale, float *ESquareGrad, float *ESquareDelta,
+	float decay, float stableConst, long dim, kernelMomentum *momentum);
+typedef void (*kernelAdadeltaKernel) (float *params, float *grad, float gradScale, float *ESquareGrad, float *ESquareDelta,
+	float *histGrad, float *histDelta, float *rankGrad, float *rankDelta,
+	float gradDecay, float gradHist, float deltaDecay, float deltaHist,
+	float decay, float slaveDecay, float stableConst, long dim, kernelMomentum *momentum);
+// the same with H in double and the sender's K as float pairs K + KLow, for when H grows
+typedef void (*wideAdadeltaKernel) (float *params, float *grad, float gradScale, float *ESquareGrad, float *ESquareDelta,
+	double *histGrad, double *histDelta, float *rankGrad, float *rankGradLow, float *rankDelta, float *rankDeltaLow,
+	double gradDecay, double gradHist, double deltaDecay, double deltaHist,
+	float decay, float slaveDecay, float stableConst, long dim, kernelMomentum *momentum);
+typedef void (*delayedAdadeltaKernel) (float *params, float *grad, float gradScale, float *ESquareGrad, float *ESquareDelta,
+	float *slaveESquareGrad, float decay, float stableConst, long dim, kernelMomentum *momentum);
+typedef void (*adamKernel) (float *params, float *grad, float gradScale, float *firstMoment, float *secondMoment,
+	float beta1, float beta2, float correct1, float correct2, float epsilon, float rate, float weightDecay, long dim,
+	kernelMomentum *momentum);
+typedef void (*lambNormsKernel) (float *params, float *grad, float gradScale, float *firstMoment, float *secondMoment,
+	float beta1, float beta2, float correct1, float correct2, float epsilon, float weightDecay, long dim,
+	float *paramNormSqr, float *stepNormSqr);
+typedef void (*lambApplyKernel) (float *params, float *firstMoment, float *secondMoment, float correct1, float correct2,
+	float epsilon, float rate, float weightDecay, long dim, kernelMomentum *momentum);
+
+// [momentum policy][clip]
+extern const sgdKernel kernel_sgd_table[KERNEL_NPOLICY][2];
+extern const adagradKernel kernel_adagrad_table[KERNEL_NPOLICY][2];
+extern const delayedAdagradKernel kernel_delayed_adagrad_table[KERNEL_NPOLICY][2];
+extern const futureAdagradKernel kernel_future_adagrad_table[KERNEL_NPOLICY][2];
+extern const rmspropKernel kernel_rmsprop_table[KERNEL_NPOLICY][2];
+extern const adadeltaKernel kernel_adadelta_table[KERNEL_NPOLICY][2];
+extern const kernelAdadeltaKernel kernel_kernel_adadelta_table[KERNEL_NPOLICY][2];
+extern const wideAdadeltaKernel kernel_wide_adadelta_table[KERNEL_NPOLICY][2];
+extern const delayedAdadeltaKernel kernel_delayed_adadelta_table[KERNEL_NPOLICY][2];
+// [momentum policy][weight decay != 0][clip]
+extern const adamKernel kernel_adam_table[KERNEL_NPOLICY][2][2];
+// [weight decay != 0][clip]
+extern const lambNormsKernel kernel_lamb_norms_table[2][2];
+// [momentum policy][weight decay != 0], the grad is only read by the norms pass
+extern const lambApplyKernel kernel_lamb_apply_table[KERNEL_NPOLICY][2];
+
+// sum(x^2) and x *= scale, for the clipping norm
+float kernel_sqnorm (float *x, long dim);
+void kernel_scale (float *x, float scale, long dim);
+
+#endif
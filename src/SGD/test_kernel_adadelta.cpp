@@ -0,0 +1,120 @@
+/****************************************************************
+* Checks the lazy kernelAdadelta against the eager O(P x nSlave)
+* loop it replaced: same grads, random sender order, several
+* decays and slave counts. Usage: test_kernel_adadelta [updates]
+****************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <map>
+#include <vector>
+
+#include "sgd.h"
+
+// the eager loop, snapshots starting from zero
+struct eagerAdadelta {
+	int dim;
+	int nSlave;
+	float decay;
+	float slaveDecay;
+	float stableConst;
+	std::vector<float> Eg, Ed;
+	std::vector<std::vector<float> > slaveEg, slaveEd;
+	std::vector<float> factor;
+
+	eagerAdadelta (int dim_, int nSlave_, float decay_, float stableConst_) {
+		dim = dim_;
+		nSlave = nSlave_;
+		decay = decay_;
+		slaveDecay = 0.8f;
+		stableConst = stableConst_;
+		Eg.assign(dim, 0.f);
+		Ed.assign(dim, 0.f);
+		slaveEg.assign(nSlave+1, std::vector<float>(dim, 0.f));
+		slaveEd.assign(nSlave+1, std::vector<float>(dim, 0.f));
+		factor.assign(nSlave+1, 1 - decay);
+	}
+
+	void update (float *params, float *grad, int rank) {
+		for (int slaveId=1; slaveId<=nSlave; slaveId++) {
+			factor[slaveId] *= decay;
+		}
+		for (int i=0; i<dim; i++) {
+			float gradSqr = grad[i] * grad[i];
+			Eg[i] = decay * Eg[i] + (1 - decay) * gradSqr;
+			for (int slaveId=1; slaveId<=nSlave; slaveId++) {
+				slaveEg[slaveId][i] = (slaveEg[slaveId][i] + factor[slaveId] * gradSqr) * slaveDecay;
+			}
+			float delta = sqrt(slaveEd[rank][i] + stableConst) / sqrt(slaveEg[rank][i] + stableConst) * grad[i];
+			params[i] -= delta;
+			float deltaSqr = delta * delta;
+			Ed[i] = decay * Ed[i] + (1 - decay) * deltaSqr;
+			for (int slaveId=1; slaveId<=nSlave; slaveId++) {
+				slaveEd[slaveId][i] = (slaveEd[slaveId][i] + factor[slaveId] * deltaSqr) * slaveDecay;
+			}
+		}
+		slaveEg[rank] = Eg;
+		slaveEd[rank] = Ed;
+		factor[rank] = 1 - decay;
+	}
+};
+
+static bool runCase (float decay, int nSlave, int nUpdate) {
+	const char *confPath = "test_kernel_adadelta.conf";
+	FILE *conf = fopen(confPath, "w");
+	fprintf(conf, "[Master]\nadadelta decay factor = %f\nadadelta stable const = 0.0001\n", decay);
+	fprintf(conf, "use momentum = 0\nmomentum factor = 0.9\nmomentum staleness adjust = 0\nclip gradient norm = 0\n");
+	fprintf(conf, "history versions = 0\nhistory fp16 = 0\n");
+	fclose(conf);
+	ConfReader *confReader = new ConfReader(confPath, "Master");
+
+	int dim = 1003;
+	kernelAdadelta lazy(confReader, dim, nSlave);
+	eagerAdadelta eager(dim, nSlave, decay, 0.0001f);
+
+	std::vector<float> lazyParams(dim), eagerParams(dim), grad(dim);
+	srand(7);
+	for (int i=0; i<dim; ++i) {
+		lazyParams[i] = eagerParams[i] = (float) rand() / RAND_MAX - 0.5f;
+	}
+
+	float maxDiff = 0.f;
+	for (int step=0; step<nUpdate; ++step) {
+		// uneven senders, some slaves stay quiet for long stretches
+		int rank = 1 + (rand() % nSlave) * (rand() % 2);
+		for (int i=0; i<dim; ++i) {
+			grad[i] = 0.1f * ((float) rand() / RAND_MAX - 0.5f);
+		}
+		lazy.updateParams(&lazyParams[0], &grad[0], rank);
+		eager.update(&eagerParams[0], &grad[0], rank);
+		for (int i=0; i<dim; ++i) {
+			float diff = fabs(lazyParams[i] - eagerParams[i]) / (fabs(eagerParams[i]) + 1.f);
+			if (diff > maxDiff) {
+				maxDiff = diff;
+			}
+		}
+	}
+	delete confReader;
+	remove(confPath);
+
+	bool pass = maxDiff < 1e-4f;
+	printf("decay %.2f slaves %2d updates %d: max rel diff %.2e %s\n", decay, nSlave, nUpdate, maxDiff, pass ? "ok" : "FAIL");
+	return pass;
+}
+
+int main (int argc, char **argv) {
+	int nUpdate = (argc > 1) ? atoi(argv[1]) : 500;
+	// below the slave decay 0.8 the history restarts early and old snapshots stop being folded
+	float decays[] = {0.8f, 0.9f, 0.6f, 0.3f};
+	int slaves[] = {1, 3, 8, 32, 64};
+	bool pass = true;
+	for (int d=0; d<4; ++d) {
+		for (int s=0; s<5; ++s) {
+			pass = runCase(decays[d], slaves[s], nUpdate) && pass;
+		}
+	}
+	printf("%s\n", pass ? "PASSED" : "FAILED");
+	return pass ? 0 : 1;
+}
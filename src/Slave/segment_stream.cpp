@@ -0,0 +1,77 @@
+#include "segment_stream.h"
+
+long messageChunkBytes (ConfReader *slaveConf) {
+	int chunkBytes = slaveConf->getInt("message chunk size");
+	if (chunkBytes < 0 || (chunkBytes > 0 && chunkBytes < 1024)) {
+		printf("Error message chunk size: %d (0 or at least 1024 bytes).\n", chunkBytes);
+		exit(-1);
+	}
+	return chunkBytes;
+}
+
+segmentStream::segmentStream (commBase *comm, modelBase *model, int root, bool streamParams, bool streamGrad) {
+	m_comm = comm;
+	m_model = model;
+	m_root = root;
+	m_streamParams = streamParams;
+	m_streamGrad = streamGrad;
+	m_grad = NULL;
+
+	int nSegment = m_model->numSegments();
+	m_paramRequests.resize(nSegment);
+	m_sent.assign(nSegment, false);
+	m_model->setSegmentHandler(this);
+}
+
+segmentStream::~segmentStream () {
+	m_comm->waitAll(m_gradRequests);
+	m_model->setSegmentHandler(NULL);
+}
+
+void segmentStream::begin (float *params, float *grad) {
+	m_grad = grad;
+	m_sent.assign(m_sent.size(), false);
+	if (!m_streamParams) {
+		return;
+	}
+	// post in forward order, the master sends in the same order
+	for (int order=0; order<(int) m_paramRequests.size(); ++order) {
+		int segIdx = m_model->forwardSegment(order);
+		m_comm->irecvChunked(params + m_model->m_segOffset[segIdx], m_model->m_segSize[segIdx], COMM_FLOAT,
+			m_root, PARAMSEGTAG + segIdx, m_paramRequests[segIdx]);
+	}
+}
+
+void segmentStream::paramNeeded (int segIdx) {
+	m_comm->waitAll(m_paramRequests[segIdx]);
+}
+
+void segmentStream::gradReady (int segIdx) {
+	if (!m_streamGrad || m_grad == NULL || m_sent[segIdx]) {
+		return;
+	}
+	m_comm->isendChunked(m_grad + m_model->m_segOffset[segIdx], m_model->m_segSize[segIdx], COMM_FLOAT,
+		m_root, GRADSEGTAG + segIdx, m_gradRequests);
+	m_sent[segIdx] = true;
+}
+
+void segmentStream::finish () {
+	// segments the model never asked for still have to land before the next begin
+	for (int segIdx=0; segIdx<(int) m_paramRequests.size(); ++segIdx) {
+		m_comm->waitAll(m_paramRequests[segIdx]);
+	}
+	// begin without a grad: the caller ships it
+	if (m_grad == NULL) {
+		return;
+	}
+	if (!m_streamGrad) {
+		m_comm->sendChunked(m_grad, m_model->m_nParamSize + GRAD_INFO, COMM_FLOAT, m_root, m_comm->rank());
+		return;
+	}
+	for (int segIdx=0; segIdx<(int) m_sent.size(); ++segIdx) {
+		gradReady(segIdx);
+	}
+	// |grad|^2 and the cost are known once every segment is final
+	m_comm->isendChunked(m_grad + m_model->m_nParamSize, GRAD_INFO, COMM_FLOAT, m_root, GRADSEGTAG + (int) m_sent.size(), m_gradRequests);
+	m_comm->waitAll(m_gradRequests);
+}
@@ -0,0 +1,58 @@
+#ifndef __SEGMENT_STREAM_H__
+#define __SEGMENT_STREAM_H__
+
+#include <vector>
+
+#include "comm.h"
+#include "model.h"
+#include "confreader.h"
+
+// segment k of the params (master to slave) or of a grad (slave to
+// master) travels with tag PARAMSEGTAG + k / GRADSEGTAG + k, both clear
+// of WORKTAG and STOPTAG; the GRAD_INFO floats after the last of K grad
+// segments go with GRADSEGTAG + K
+#define PARAMSEGTAG 16
+#define GRADSEGTAG 16
+
+// "message chunk size" of [Slave], read the same way by master and slaves
+long messageChunkBytes (ConfReader *slaveConf);
+
+/****************************************************************
+* Moves params and grad of one minibatch segment by segment.
+* Params: begin() posts a receive per segment, the model waits
+* for a segment only when its forward pass first needs it.
+* Grad: each segment published by the model is sent with a
+* non-blocking send while backpropagation continues on the
+* earlier layers. finish() sends whatever was never published,
+* then the GRAD_INFO floats the grad buffer holds after the params,
+* and waits until both buffers may be reused. A NULL grad in
+* begin() leaves the grad to the caller (e.g. a sparse grad).
+****************************************************************/
+
+class segmentStream: public segmentHandler
+{
+public:
+	segmentStream(commBase *comm, modelBase *model, int root, bool streamParams, bool streamGrad);
+	~segmentStream();
+
+	/* method */
+	void begin (float *params, float *grad);
+	void paramNeeded (int segIdx);
+	void gradReady (int segIdx);
+	void finish ();
+
+private:
+	/* data */
+	commBase *m_comm;
+	modelBase *m_model;
+	int m_root;
+	bool m_streamParams;
+	bool m_streamGrad;
+	float *m_grad;
+
+	std::vector<std::vector<commRequest> > m_paramRequests;	// chunks by segment, empty once landed
+	std::vector<bool> m_sent;
+	std::vector<commRequest> m_gradRequests;
+};
+
+#endif
@@ -1,8 +1,9 @@
-#include <mpi.h>
 #include <stdio.h>
 #include <algorithm>
+#include <vector>
 
 #include "slave.h"
+#include "segment_stream.h"
 #include "model.h"
 #include "svm.h"
 #include "neural_net.h"
@@ -95,11 +96,45 @@ DataFactory* initDataFactory(ConfReader *slaveConf)
     }
     return data;
 }
+//per-slave generator: reproducible for a given seed and safe when
+//slaves run as threads of one process (rand() state is shared)
+struct slaveRand {
+    unsigned int state;
+    long operator() (long n) { return rand_r(&state) % n; }
+};
+
+//shorter sequences first, ties by output length
+struct lengthLess {
+    int *inputLen;
+    int *outputLen;
+    bool operator() (long a, long b) const {
+        if (inputLen[a] != inputLen[b]) return inputLen[a] < inputLen[b];
+        return outputLen[a] < outputLen[b];
+    }
+};
+
+//reorder a shuffled index so that every batchSize block holds sequences of
+//similar length, blocks in random order; the tail that fills no block stays
+void bucketByLength(long *index, long dbSize, int batchSize, lengthLess &order, slaveRand &randGen){
+    long nBatch = dbSize / batchSize;
+    std::stable_sort(index, index+nBatch*batchSize, order);
+    std::vector<long> sorted(index, index+nBatch*batchSize);
+    std::vector<long> batchOrder(nBatch);
+    for (long b=0; b<nBatch; b++){
+        batchOrder[b] = b;
+    }
+    std::random_shuffle(batchOrder.begin(), batchOrder.end(), randGen);
+    for (long b=0; b<nBatch; b++){
+        std::copy(sorted.begin() + batchOrder[b]*batchSize, sorted.begin() + (batchOrder[b]+1)*batchSize,
+            index + b*batchSize);
+    }
+}
+
 //random pick the data 
 //the main function of slaves
 
 
-void slaveDo(){ 
+void slaveDo(commBase *comm){ 
     openblas_set_num_threads(1);
     //step 0:init the data in local memory    
     ConfReader *slaveConf = new ConfReader("config.conf", "Slave");
@@ -107,55 +142,105 @@ void slaveDo(){
     printf("training batchSize: %d\n", batchSize);
 
     DataFactory *dataset = initDataFactory(slaveConf);
-    int dbSize = dataset->getNumberOfData();// define in slave.h or ?
+    long dbSize = dataset->getNumberOfData();// define in slave.h or ?
     
-    int dataSize = dataset->getDataSize();
-    int labelSize = dataset->getLabelSize();
+    long dataSize = dataset->getDataSize();
+    long labelSize = dataset->getLabelSize();
 
-    MPI_Status status;
+    commStatus status;
 	//step 1:: configulation
     //slaveConfinfo sconfig;
     /*if(~slaveLoad(&sconfig))
         return -1;*/	
-    int paramSize;
+    long paramSize;
 
     //step 1.5:receive some pre-parameters 
-    MPI_Bcast(&paramSize,1,MPI_INT,ROOT,MPI_COMM_WORLD);
+    comm->bcast(&paramSize,1,COMM_LONG,ROOT);
+    comm->setChunkBytes(messageChunkBytes(slaveConf));
     float *param = new float[paramSize]; 
-    float *grad  = new float[paramSize];
+    float *grad  = new float[paramSize + GRAD_INFO];  //|grad|^2 and cost travel after the params
     float *data  = new float[batchSize*dataSize];
     float *label = new float[batchSize*labelSize];
-    int   *index = new int[dbSize];
-    int   *pickIndex = new int[batchSize];
+    long  *index = new long[dbSize];
+    long  *pickIndex = new long[batchSize];
+    //per-sequence lengths of the minibatch, the model runs only as many steps as the longest
+    bool seqLengths = dataset->hasSeqLengths();
+    bool bucketed = seqLengths && slaveConf->getInt("bucket by length") != 0;
+    int   *inputLen = new int[batchSize];
+    int   *outputLen = new int[batchSize];
+    lengthLess order;
+    order.inputLen = NULL;
+    order.outputLen = NULL;
 
     ConfReader *modelConf = new ConfReader("config.conf", "Model");
     modelBase *model = initModelSlave(modelConf, batchSize);
-    for (int i=0;i<dbSize;i++){
+    for (long i=0;i<dbSize;i++){
         index[i]=i;
     }    
+    if (bucketed) {
+        order.inputLen = new int[dbSize];
+        order.outputLen = new int[dbSize];
+        dataset->getSeqLengths(order.inputLen, order.outputLen, index, (int) dbSize);
+    }
 
-    int rank;
-    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    int rank = comm->rank();
     int count = 0;
-    int indexI = 0;
-    srand(time(NULL) * rank);
-    std::random_shuffle(index,index+dbSize);
+    long indexI = 0;
+    int seed = slaveConf->getInt("random seed");
+    if (seed == 0) {
+        seed = time(NULL);
+    }
+    slaveRand randGen;
+    randGen.state = seed * rank;
+    std::random_shuffle(index,index+dbSize,randGen);
+    if (bucketed) {
+        bucketByLength(index, dbSize, batchSize, order, randGen);
+    }
+
+    //take the params layer by layer as the forward pass needs them and
+    //ship the grad layer by layer while backprop is still running
+    bool streamParams = slaveConf->getInt("stream parameters") != 0;
+    bool streamGrad = slaveConf->getInt("stream gradients") != 0;
+    //models that know their nonzeros send (index, value) pairs in one message
+    bool sparseGrad = slaveConf->getInt("sparse gradients") != 0 && model->hasSparseGrad();
+    char *sparseMsg = NULL;
+    float *sparseValue = NULL;
+    if (sparseGrad) {
+        streamGrad = false;
+        sparseMsg = new char[sparseMsgBytes(paramSize)];
+        sparseValue = new float[paramSize];
+    }
+    segmentStream *stream = NULL;
+    if (streamParams || streamGrad) {
+        stream = new segmentStream(comm, model, ROOT, streamParams, streamGrad);
+    }
     printf("Slave[%d] go into loop\n", rank);
 	//main loop
     while(1){
 		/*step 2:receive from master*/
-		MPI_Recv(param,paramSize,MPI_FLOAT,ROOT,MPI_ANY_TAG,MPI_COMM_WORLD,&status);
+        if (streamParams) {
+            //only look at the first chunk, the rest lands during step 5
+            comm->probe(ROOT,COMM_ANY_TAG,COMM_FLOAT,&status);
+            if (status.tag == STOPTAG) {
+                comm->recv(param,paramSize,COMM_FLOAT,ROOT,STOPTAG,&status);
+            }
+        } else {
+		    comm->recvChunked(param,paramSize,COMM_FLOAT,ROOT,COMM_ANY_TAG,&status);
+        }
         count++;
         //printf("%d:%d\n", rank, count);
         
 		/*step 3: check whether ends*/
-		if(status.MPI_TAG == STOPTAG){
+		if(status.tag == STOPTAG){
             break;
         } 
         
         /*step 4: request for data*/
         if (indexI+batchSize >= dbSize){
-            std::random_shuffle(index,index+dbSize);
+            std::random_shuffle(index,index+dbSize,randGen);
+            if (bucketed) {
+                bucketByLength(index, dbSize, batchSize, order, randGen);
+            }
             indexI = 0;
         }
         for(int i=0;i<batchSize;i++){
@@ -163,9 +248,24 @@ void slaveDo(){
             indexI++;            
         }        
         dataset->getDataBatch(label, data, pickIndex, batchSize);        
+        if (seqLengths) {
+            dataset->getSeqLengths(inputLen, outputLen, pickIndex, batchSize);
+            model->setSeqLengths(inputLen, outputLen);
+        }
         //dataset->printOutData();
         /*step 5: calculate the grad*/      
-        float cost = model->computeGrad(grad, param, data, label);
+        if (stream != NULL) {
+            stream->begin(param, sparseGrad ? NULL : grad);
+        }
+        float cost;
+        int nnz = 0;
+        if (sparseGrad) {
+            cost = model->computeSparseGrad(&nnz, sparseMsgIndex(sparseMsg), sparseValue, param, data, label);
+        } else {
+            cost = model->computeGrad(grad, param, data, label);
+            grad[paramSize] = model->m_gradSqNorm;
+            grad[paramSize + 1] = cost;
+        }
         // printf("Slave[%d] cost: %f\n", rank, cost);
 
         // for (int i = 0; i < paramSize; i++) {
@@ -176,14 +276,40 @@ void slaveDo(){
 
         
         /*step 6: return to master*/
-        MPI_Send(grad, paramSize, MPI_FLOAT, ROOT, rank, MPI_COMM_WORLD);
+        if (stream != NULL) {
+            stream->finish();
+        }
+        if (sparseGrad) {
+            *(int *) sparseMsg = nnz;
+            sparseMsgInfo(sparseMsg)[0] = model->m_gradSqNorm;
+            sparseMsgInfo(sparseMsg)[1] = cost;
+            memcpy(sparseMsgValue(sparseMsg, nnz), sparseValue, sizeof(float) * nnz);
+            comm->sendChunked(sparseMsg, sparseMsgBytes(nnz), COMM_BYTE, ROOT, rank);
+        } else if (stream == NULL) {
+            comm->sendChunked(grad, paramSize + GRAD_INFO, COMM_FLOAT, ROOT, rank);
+        }
 	}
 
+    if (stream != NULL) {
+        delete stream;
+    }
+
+    if (sparseGrad) {
+        delete [] sparseMsg;
+        delete [] sparseValue;
+    }
 
     delete [] param;
     delete [] grad;
     delete [] label;
     delete [] data;
     delete [] index;
+    delete [] pickIndex;
+    delete [] inputLen;
+    delete [] outputLen;
+    if (bucketed) {
+        delete [] order.inputLen;
+        delete [] order.outputLen;
+    }
     delete dataset;
 }
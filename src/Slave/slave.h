@@ -1,8 +1,8 @@
 #ifndef SLAVE_h
 #define SLAVE_h
 
-#include<mpi.h>
 #include<stdio.h>
+#include "comm.h"
 
 
 #define WORKTAG 1
@@ -11,10 +11,10 @@
 
 
 struct slaveConfinfo{
-    int paramSize;
+    long paramSize;
     int algorithmType;
 };
 
-void slaveDo();
+void slaveDo(commBase *comm);
 #endif
 
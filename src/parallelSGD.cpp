@@ -1,18 +1,65 @@
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
 #include "master.h"
 #include "slave.h"
 
+/****************************************************************
+* Usage:
+*   mpirun -np N parallelSGD       one rank per MPI process
+*   parallelSGD --threads N        N ranks as threads of this process
+****************************************************************/
+
+void *rankThread (void *arg) {
+	commBase *comm = (commBase *) arg;
+	if (comm->rank() == ROOT) {
+		masterFunc(comm);
+	} else {
+		slaveDo(comm);
+	}
+	return NULL;
+}
+
+int runThreads (int nProc) {
+	if (nProc < 2) {
+		printf("Error: --threads needs at least 2 ranks (1 master + slaves).\n");
+		return -1;
+	}
+	threadHub *hub = new threadHub(nProc);
+	std::vector<threadComm *> comms;
+	std::vector<pthread_t> threads(nProc);
+	for (int rank=0; rank<nProc; ++rank) {
+		comms.push_back(new threadComm(hub, rank));
+	}
+	for (int rank=0; rank<nProc; ++rank) {
+		pthread_create(&threads[rank], NULL, rankThread, comms[rank]);
+	}
+	for (int rank=0; rank<nProc; ++rank) {
+		pthread_join(threads[rank], NULL);
+		delete comms[rank];
+	}
+	delete hub;
+	return 0;
+}
+
 int main(int argc, char ** argv) {
+	for (int i=1; i<argc-1; ++i) {
+		if (strcmp(argv[i], "--threads") == 0) {
+			return runThreads(atoi(argv[i+1]));
+		}
+	}
+
 	MPI_Init(&argc, &argv);
-	int worldSize, worldRank;
-	MPI_Comm_size(MPI_COMM_WORLD, &worldSize);
-	MPI_Comm_rank(MPI_COMM_WORLD, &worldRank);
+	mpiComm *comm = new mpiComm(MPI_COMM_WORLD);
 
-	if (worldRank == ROOT) {
-		masterFunc();
+	if (comm->rank() == ROOT) {
+		masterFunc(comm);
 	} else {
-		slaveDo();
+		slaveDo(comm);
 	}
 
+	delete comm;
 	MPI_Finalize();
 	return 0;
-}
\ No newline at end of file
+}